@@ -8,6 +8,13 @@ public class BoardingAction : ModuleRules
 	{
 		PCHUsage = PCHUsageMode.UseExplicitOrSharedPCHs;
 
-		PublicDependencyModuleNames.AddRange(new string[] { "Core", "CoreUObject", "Engine", "InputCore", "HeadMountedDisplay" });
+		PublicDependencyModuleNames.AddRange(new string[] { "Core", "CoreUObject", "Engine", "InputCore", "HeadMountedDisplay", "PhysicsCore" });
+
+		// ABoardingActionHUD's performance overlay and UBenchmarkSubsystem read the thread timings RenderCore keeps.
+		// The benchmark also writes its results, and reads its baseline, as JSON.
+		PrivateDependencyModuleNames.AddRange(new string[] { "RenderCore", "Json" });
+
+		// UPhysicsSubsystem talks to the physics scene directly for solver gravity.
+		SetupModulePhysicsSupport(Target);
 	}
 }
@@ -3,5 +3,7 @@
 #include "BoardingAction.h"
 #include "Modules/ModuleManager.h"
 
+CSV_DEFINE_CATEGORY_MODULE(BOARDINGACTION_API, BoardingAction, true);
+
 IMPLEMENT_PRIMARY_GAME_MODULE( FDefaultGameModuleImpl, BoardingAction, "BoardingAction" );
  
\ No newline at end of file
@@ -3,3 +3,18 @@
 #pragma once
 
 #include "CoreMinimal.h"
+#include "ProfilingDebugging/CpuProfilerTrace.h"
+#include "ProfilingDebugging/CountersTrace.h"
+#include "ProfilingDebugging/MiscTrace.h"
+#include "ProfilingDebugging/CsvProfiler.h"
+
+// "stat BoardingAction" for the game as a whole, or one of the others for a single system.
+DECLARE_STATS_GROUP(TEXT("BoardingAction"), STATGROUP_BoardingAction, STATCAT_Advanced);
+DECLARE_STATS_GROUP(TEXT("BoardingAction Gravity"), STATGROUP_BoardingActionGravity, STATCAT_Advanced);
+DECLARE_STATS_GROUP(TEXT("BoardingAction Projectiles"), STATGROUP_BoardingActionProjectiles, STATCAT_Advanced);
+DECLARE_STATS_GROUP(TEXT("BoardingAction Enemies"), STATGROUP_BoardingActionEnemies, STATCAT_Advanced);
+
+// Unreal Insights and the CSV profiler don't see the stats above, so the hot paths also get trace scopes, and the numbers
+// worth lining up against frame spikes go out as trace counters and CSV stats under this category. Gravity changes show
+// up as bookmarks in Insights and events in the CSV.
+CSV_DECLARE_CATEGORY_MODULE_EXTERN(BOARDINGACTION_API, BoardingAction);
@@ -0,0 +1,146 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "BoardingActionAssetManager.h"
+#include "BoardingActionGameMode.h"
+#include "BoardingActionHUD.h"
+#include "CrowdSubsystem.h"
+#include "ProjectileManagerSubsystem.h"
+#include "Engine/Engine.h"
+#include "Engine/StreamableManager.h"
+#include "Misc/CoreDelegates.h"
+#include "Misc/CommandLine.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "HAL/PlatformMemory.h"
+#include "HAL/PlatformFileManager.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogBoardingActionAssets, Log, All);
+
+UBoardingActionAssetManager::UBoardingActionAssetManager()
+{
+	preloadStartTime = 0.0;
+	preloadTime = -1.0;
+	bReportedStartup = false;
+}
+
+UBoardingActionAssetManager* UBoardingActionAssetManager::Get()
+{
+	return Cast<UBoardingActionAssetManager>(UAssetManager::GetIfValid());
+}
+
+void UBoardingActionAssetManager::StartInitialLoading()
+{
+	Super::StartInitialLoading();
+
+	FCoreUObjectDelegates::PreLoadMap.AddUObject(this, &UBoardingActionAssetManager::OnPreLoadMap);
+	FCoreUObjectDelegates::PostLoadMapWithWorld.AddUObject(this, &UBoardingActionAssetManager::OnPostLoadMap);
+}
+
+void UBoardingActionAssetManager::GetMatchAssets(TArray<FSoftObjectPath>& outAssets, bool bIncludeCosmetic) const
+{
+	outAssets.Add(GetDefault<ABoardingActionGameMode>()->PlayerPawnClass.ToSoftObjectPath());
+	outAssets.Add(GetDefault<UCrowdSubsystem>()->EnemyClass.ToSoftObjectPath());
+	if (bIncludeCosmetic)
+	{
+		outAssets.Add(GetDefault<ABoardingActionHUD>()->CrosshairTexture.ToSoftObjectPath());
+		outAssets.Add(GetDefault<UProjectileManagerSubsystem>()->ProjectileMesh);
+		outAssets.Add(GetDefault<UCrowdSubsystem>()->CrowdMesh);
+	}
+	// Native classes (the crowd's default enemy) are always loaded, and anything left blank in config has nothing to load.
+	outAssets.RemoveAll([](const FSoftObjectPath& asset) { return asset.IsNull() || asset.GetLongPackageName().StartsWith(TEXT("/Script/")); });
+}
+
+void UBoardingActionAssetManager::WaitForMatchAssets()
+{
+	if (matchAssets.IsValid() && matchAssets->IsLoadingInProgress())
+	{
+		matchAssets->WaitUntilComplete();
+	}
+}
+
+void UBoardingActionAssetManager::OnPreLoadMap(const FString& mapName)
+{
+	// Requested as the map starts loading, so they come in along with it. After the first map they're already resident
+	// and this completes straight away.
+	TArray<FSoftObjectPath> assets;
+	GetMatchAssets(assets, !IsRunningDedicatedServer());
+	if (assets.Num() == 0)
+	{
+		return;
+	}
+	preloadStartTime = FPlatformTime::Seconds();
+	preloadTime = -1.0;
+	matchAssets = GetStreamableManager().RequestAsyncLoad(assets, FStreamableDelegate::CreateUObject(this, &UBoardingActionAssetManager::OnMatchAssetsLoaded), FStreamableManager::AsyncLoadHighPriority);
+}
+
+void UBoardingActionAssetManager::OnMatchAssetsLoaded()
+{
+	preloadTime = FPlatformTime::Seconds() - preloadStartTime;
+	UE_LOG(LogBoardingActionAssets, Log, TEXT("Match assets loaded in %.1f ms"), preloadTime * 1000.0);
+}
+
+void UBoardingActionAssetManager::OnPostLoadMap(UWorld* loadedWorld)
+{
+	if (!bReportedStartup && !endFrameHandle.IsValid())
+	{
+		endFrameHandle = FCoreDelegates::OnEndFrame.AddUObject(this, &UBoardingActionAssetManager::ReportStartup);
+	}
+}
+
+void UBoardingActionAssetManager::ReportStartup()
+{
+	FCoreDelegates::OnEndFrame.Remove(endFrameHandle);
+	endFrameHandle.Reset();
+	bReportedStartup = true;
+
+	const double firstFrameTime = FPlatformTime::Seconds() - GStartTime;
+	const FPlatformMemoryStats memory = FPlatformMemory::GetStats();
+	const double residentMB = memory.UsedPhysical / (1024.0 * 1024.0);
+	const double peakMB = memory.PeakUsedPhysical / (1024.0 * 1024.0);
+	UE_LOG(LogBoardingActionAssets, Log, TEXT("First frame %.2f s after launch, %.1f MB resident (%.1f MB peak)"), firstFrameTime, residentMB, peakMB);
+
+	const TCHAR* commandLine = FCommandLine::Get();
+	if (!FParse::Param(commandLine, TEXT("StartupReport")))
+	{
+		return;
+	}
+
+	// One row per run, so a few launches from before a change and a few from after end up side by side. The label
+	// tells them apart.
+	FString label;
+	FParse::Value(commandLine, TEXT("StartupLabel="), label);
+	const FString path = FPaths::Combine(FPaths::ProjectSavedDir(), TEXT("Benchmarks"), TEXT("Startup.csv"));
+	FString row;
+	if (!FPlatformFileManager::Get().GetPlatformFile().FileExists(*path))
+	{
+		row = TEXT("Date,Label,DedicatedServer,FirstFrameSeconds,ResidentMB,PeakResidentMB,PreloadMs\n");
+	}
+	row += FString::Printf(TEXT("%s,%s,%d,%.3f,%.1f,%.1f,%.1f\n"), *FDateTime::Now().ToString(), *label, IsRunningDedicatedServer() ? 1 : 0,
+		firstFrameTime, residentMB, peakMB, preloadTime >= 0.0 ? preloadTime * 1000.0 : -1.0);
+	const bool bWritten = FFileHelper::SaveStringToFile(row, *path, FFileHelper::EEncodingOptions::AutoDetect, &IFileManager::Get(), FILEWRITE_Append);
+	if (bWritten)
+	{
+		UE_LOG(LogBoardingActionAssets, Log, TEXT("Added startup report to %s."), *path);
+	}
+	else
+	{
+		UE_LOG(LogBoardingActionAssets, Error, TEXT("Couldn't write the startup report to %s."), *path);
+	}
+	FPlatformMisc::RequestExitWithStatus(false, bWritten ? 0 : 2);
+}
+
+#if WITH_EDITOR
+void UBoardingActionAssetManager::ModifyCook(TArray<FName>& PackagesToCook, TArray<FName>& PackagesToNeverCook)
+{
+	Super::ModifyCook(PackagesToCook, PackagesToNeverCook);
+
+	// Config isn't saved in any package, so the cooker would never find these by following references.
+	TArray<FSoftObjectPath> assets;
+	GetMatchAssets(assets, true);
+	for (const FSoftObjectPath& asset : assets)
+	{
+		PackagesToCook.AddUnique(FName(*asset.GetLongPackageName()));
+	}
+}
+#endif
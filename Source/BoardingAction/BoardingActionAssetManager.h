@@ -0,0 +1,56 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Engine/AssetManager.h"
+#include "BoardingActionAssetManager.generated.h"
+
+struct FStreamableHandle;
+
+/**
+ * Loads what every match needs (the player pawn, the crowd's enemy, the crosshair, the batched projectile and crowd meshes)
+ * asynchronously as each map starts loading, instead of it being hard referenced and loaded at startup, or loaded the
+ * first time it's used in the middle of a match. Those assets are only soft referenced from config, so it also makes
+ * sure they're cooked. Set as the AssetManagerClassName in DefaultEngine.ini.
+ */
+UCLASS()
+class BOARDINGACTION_API UBoardingActionAssetManager : public UAssetManager
+{
+	GENERATED_BODY()
+
+public:
+	UBoardingActionAssetManager();
+
+	// Null if the project is set to use some other asset manager.
+	static UBoardingActionAssetManager* Get();
+
+	virtual void StartInitialLoading() override;
+
+	// For when one of the match's assets is needed right now. Only blocks if the preload hasn't finished yet.
+	void WaitForMatchAssets();
+
+#if WITH_EDITOR
+	virtual void ModifyCook(TArray<FName>& PackagesToCook, TArray<FName>& PackagesToNeverCook) override;
+#endif
+
+protected:
+	// Cosmetic assets are the ones only needed for drawing, which a dedicated server can skip.
+	void GetMatchAssets(TArray<FSoftObjectPath>& outAssets, bool bIncludeCosmetic) const;
+
+	void OnPreLoadMap(const FString& mapName);
+	void OnPostLoadMap(UWorld* loadedWorld);
+	void OnMatchAssetsLoaded();
+	// Logs how long the first frame took to get to and how much memory it took, once. With -StartupReport it also adds
+	// them as a row to Saved/Benchmarks/Startup.csv and quits, so runs from before and after a change can be compared.
+	void ReportStartup();
+
+	// Keeps the match's assets loaded between maps.
+	TSharedPtr<FStreamableHandle> matchAssets;
+	double preloadStartTime;
+	// How long the last preload took, in seconds, or negative if it hadn't finished.
+	double preloadTime;
+
+	FDelegateHandle endFrameHandle;
+	bool bReportedStartup;
+};
@@ -2,11 +2,15 @@
 
 #include "BoardingActionCharacter.h"
 #include "BoardingActionProjectile.h"
+#include "ProjectilePoolSubsystem.h"
+#include "ProjectileManagerSubsystem.h"
+#include "BoardingActionHUD.h"
 #include "Animation/AnimInstance.h"
 #include "Camera/CameraComponent.h"
 #include "Components/CapsuleComponent.h"
 #include "Components/InputComponent.h"
 #include "GameFramework/InputSettings.h"
+#include "GameFramework/PlayerController.h"
 #include "HeadMountedDisplayFunctionLibrary.h"
 #include "Kismet/GameplayStatics.h"
 #include "MotionControllerComponent.h"
@@ -17,7 +21,8 @@ DEFINE_LOG_CATEGORY_STATIC(LogFPChar, Warning, All);
 //////////////////////////////////////////////////////////////////////////
 // ABoardingActionCharacter
 
-ABoardingActionCharacter::ABoardingActionCharacter()
+ABoardingActionCharacter::ABoardingActionCharacter(const FObjectInitializer& ObjectInitializer)
+	: Super(ObjectInitializer.SetDefaultSubobjectClass<UGravityMovementComponent>(ACharacter::CharacterMovementComponentName))
 {
 	// Set size for collision capsule
 	GetCapsuleComponent()->InitCapsuleSize(55.f, 96.0f);
@@ -55,11 +60,39 @@ ABoardingActionCharacter::ABoardingActionCharacter()
 
 	// Default offset from the character location for projectiles to spawn
 	GunOffset = FVector(100.0f, 0.0f, 10.0f);
+	bUseProjectileManager = false;
 
 	// Uncomment the following line to turn motion controllers on by default:
 	//bUsingMotionControllers = true;
+}
+
+void ABoardingActionCharacter::PostInitializeComponents()
+{
+	Super::PostInitializeComponents();
+
+	// Done before BeginPlay, so none of it ever gets its tick registered or its animation set up.
+	// They still have to be created in the constructor, since the blueprint has overrides for all of them.
+	if (IsNetMode(NM_DedicatedServer))
+	{
+		StripCosmeticComponents();
+	}
+}
 
-	previousGravity = FVector{0, 0, -9.8f};
+void ABoardingActionCharacter::StripCosmeticComponents()
+{
+	// Children first, so nothing gets reattached on the way out.
+	USceneComponent* Cosmetics[] = { FP_MuzzleLocation, FP_Gun, Mesh1P, FirstPersonCameraComponent };
+	for (USceneComponent* Component : Cosmetics)
+	{
+		if (Component != nullptr)
+		{
+			Component->DestroyComponent();
+		}
+	}
+	FP_MuzzleLocation = nullptr;
+	FP_Gun = nullptr;
+	Mesh1P = nullptr;
+	FirstPersonCameraComponent = nullptr;
 }
 
 void ABoardingActionCharacter::BeginPlay()
@@ -67,16 +100,27 @@ void ABoardingActionCharacter::BeginPlay()
 	// Call the base class  
 	Super::BeginPlay();
 
-	rotGravity = (-GetActorUpVector()).ToOrientationRotator();
-	rotGravityPercent = 1;
-	oldRotation = GetActorRotation();
-
 	UWorld* world = GetWorld();
 	worldPhysics = world->GetSubsystem<UPhysicsSubsystem>();
+	projectilePool = world->GetSubsystem<UProjectilePoolSubsystem>();
+	projectileManager = world->GetSubsystem<UProjectileManagerSubsystem>();
+	// Spawn our rounds up front, so the first burst of fire doesn't hitch.
+	if (projectilePool != nullptr && !bUseProjectileManager)
+	{
+		projectilePool->Prewarm(ProjectileClass, projectilePool->PrewarmCount);
+	}
 
-	// Make sure we can add a tick:
-	PrimaryActorTick.bCanEverTick = true;
-	PrimaryActorTick.TickGroup = TG_PrePhysics;
+	// Gravity (and turning to match it) is all handled by the movement component now, so we don't need to tick.
+	if (UGravityMovementComponent* mover = Cast<UGravityMovementComponent>(GetCharacterMovement())) {
+		mover->GravityRotationRate = GravityRotationRate;
+	}
+	SetActorTickEnabled(false);
+
+	// Nothing left to set up on a dedicated server, see StripCosmeticComponents
+	if (Mesh1P == nullptr || FP_Gun == nullptr)
+	{
+		return;
+	}
 
 	//Attach gun mesh component to Skeleton, doing it here because the skeleton is not yet created in the constructor
 	FP_Gun->AttachToComponent(Mesh1P, FAttachmentTransformRules(EAttachmentRule::SnapToTarget, true), TEXT("GripPoint"));
@@ -92,45 +136,6 @@ void ABoardingActionCharacter::BeginPlay()
 	}
 }
 
-void ABoardingActionCharacter::Tick(float DeltaTime) {
-	Super::Tick(DeltaTime);
-	FVector gravVector = worldPhysics->GetGravity();
-	UCharacterMovementComponent* mover = FindComponentByClass<UCharacterMovementComponent>();
-	mover->AddImpulse(gravVector, true);
-	
-	if (previousGravity != gravVector) {
-		// Stuff for following the 180 degree rule. Not that we need it right now, because everything is actually working.
-		// I might add this later if I feel that the current gradual rotations are too jarring.
-		// Even simpler solution for following the 180 degree rule than this. If the DotProduct of the vector representing
-		// where the player is going to be rotated and the player's forward vector is < 0, multiply the vector by -actorForwardVector.
-		/*FVector plane = FVector::CrossProduct(worldPhysics->GetGravity(), GetActorRightVector());
-		plane.Normalize();
-		if (FVector::DotProduct(plane, lookRot) < 0) {
-			lookRot *= -plane;
-		}*/
-
-		FRotator newRot = UPhysicsSubsystem::GetRotatorFromGravity(worldPhysics->GetGravity());
-		rotGravity = newRot;
-		oldRotation = GetActorRotation();
-
-		//The transition should be gradual, so we increment in terms of the percentage of the rotation.
-		rotGravityPercent = 0;
-	}
-
-	if (rotGravityPercent < 1) {
-		rotGravityPercent += DeltaTime * GravityRotationRate;
-		if (rotGravityPercent > 1) {
-			rotGravityPercent = 1;
-		}
-
-		// We gradually transition from the oldRotation to the new one. Since these are all in global space, we can't just set the
-		// new rotation, so we have to transition away from the oldRotation (with 1 - rotGravityPercent).
-		SetActorRotation((1 - rotGravityPercent) * oldRotation + rotGravity * rotGravityPercent);
-	}
-
-	previousGravity = gravVector;
-}
-
 //////////////////////////////////////////////////////////////////////////
 // Input
 
@@ -146,6 +151,7 @@ void ABoardingActionCharacter::SetupPlayerInputComponent(class UInputComponent*
 	// Bind fire event
 	PlayerInputComponent->BindAction("Fire", IE_Pressed, this, &ABoardingActionCharacter::OnFire);
 	PlayerInputComponent->BindAction("RightClick", IE_Pressed, this, &ABoardingActionCharacter::OnRightClick);
+	PlayerInputComponent->BindAction("TogglePerfOverlay", IE_Pressed, this, &ABoardingActionCharacter::OnTogglePerfOverlay);
 
 	// Enable touchscreen input
 	EnableTouchscreenMovement(PlayerInputComponent);
@@ -166,32 +172,31 @@ void ABoardingActionCharacter::SetupPlayerInputComponent(class UInputComponent*
 void ABoardingActionCharacter::OnFire()
 {
 	// try and fire a projectile
-	/*if (ProjectileClass != nullptr)
+	if (ProjectileClass != nullptr)
 	{
-		UWorld* const World = GetWorld();
-		if (World != nullptr)
-		{
-			const FRotator SpawnRotation = GetControlRotation();
-			// MuzzleOffset is in camera space, so transform it to world space before offsetting from the character location to find the final muzzle position
-			const FVector SpawnLocation = ((FP_MuzzleLocation != nullptr) ? FP_MuzzleLocation->GetComponentLocation() : GetActorLocation()) + SpawnRotation.RotateVector(GunOffset);
-
-			//Set Spawn Collision Handling Override
-			FActorSpawnParameters ActorSpawnParams;
-			ActorSpawnParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AdjustIfPossibleButDontSpawnIfColliding;
+		const FRotator SpawnRotation = GetControlRotation();
+		// MuzzleOffset is in camera space, so transform it to world space before offsetting from the character location to find the final muzzle position
+		const FVector SpawnLocation = ((FP_MuzzleLocation != nullptr) ? FP_MuzzleLocation->GetComponentLocation() : GetActorLocation()) + SpawnRotation.RotateVector(GunOffset);
 
-			// spawn the projectile at the muzzle
-			World->SpawnActor<ABoardingActionProjectile>(ProjectileClass, SpawnLocation, SpawnRotation, ActorSpawnParams);
+		// fire from the muzzle, either as a batched round or as a pooled projectile, rather than spawning a new actor for every shot
+		if (bUseProjectileManager && projectileManager != nullptr)
+		{
+			projectileManager->Fire(ProjectileClass, SpawnLocation, SpawnRotation, this);
+		}
+		else if (projectilePool != nullptr)
+		{
+			projectilePool->Acquire(ProjectileClass, SpawnLocation, SpawnRotation, this, this);
 		}
 	}
 
-	// try and play the sound if specified
-	if (FireSound != nullptr)
+	// try and play the sound if specified, unless we're a dedicated server with nobody to hear it
+	if (FireSound != nullptr && !IsNetMode(NM_DedicatedServer))
 	{
 		UGameplayStatics::PlaySoundAtLocation(this, FireSound, GetActorLocation());
 	}
 
 	// try and play a firing animation if specified
-	if (FireAnimation != nullptr)
+	if (FireAnimation != nullptr && Mesh1P != nullptr)
 	{
 		// Get the animation object for the arms mesh
 		UAnimInstance* AnimInstance = Mesh1P->GetAnimInstance();
@@ -199,7 +204,17 @@ void ABoardingActionCharacter::OnFire()
 		{
 			AnimInstance->Montage_Play(FireAnimation, 1.f);
 		}
-	}*/
+	}
+}
+
+void ABoardingActionCharacter::OnTogglePerfOverlay()
+{
+	APlayerController* PlayerController = Cast<APlayerController>(GetController());
+	ABoardingActionHUD* HUD = PlayerController != nullptr ? PlayerController->GetHUD<ABoardingActionHUD>() : nullptr;
+	if (HUD != nullptr)
+	{
+		HUD->TogglePerfOverlay();
+	}
 }
 
 void ABoardingActionCharacter::OnResetVR()
@@ -233,6 +248,17 @@ void ABoardingActionCharacter::EndTouch(const ETouchIndex::Type FingerIndex, con
 }
 
 void ABoardingActionCharacter::OnRightClick() {
+	CycleGravity();
+	if (!HasAuthority()) {
+		ServerCycleGravity();
+	}
+}
+
+void ABoardingActionCharacter::ServerCycleGravity_Implementation() {
+	CycleGravity();
+}
+
+void ABoardingActionCharacter::CycleGravity() {
 	if (worldPhysics->GetGravity().Z == -9.8f) {
 		worldPhysics->SetGravity(0, 0, 9.8f);
 	}
@@ -5,7 +5,7 @@
 #include "CoreMinimal.h"
 #include "GameFramework/Character.h"
 #include "PhysicsSubsystem.h"
-#include "GameFramework/CharacterMovementComponent.h"
+#include "GravityMovementComponent.h"
 #include "BoardingActionCharacter.generated.h"
 
 class UInputComponent;
@@ -15,6 +15,8 @@ class UCameraComponent;
 class UMotionControllerComponent;
 class UAnimMontage;
 class USoundBase;
+class UProjectilePoolSubsystem;
+class UProjectileManagerSubsystem;
 
 UCLASS(config=Game)
 class ABoardingActionCharacter : public ACharacter
@@ -38,18 +40,14 @@ class ABoardingActionCharacter : public ACharacter
 	UCameraComponent* FirstPersonCameraComponent;
 
 public:
-	ABoardingActionCharacter();
+	ABoardingActionCharacter(const FObjectInitializer& ObjectInitializer);
 
 protected:
+	virtual void PostInitializeComponents() override;
 	virtual void BeginPlay();
 
-	virtual void Tick(float DeltaTime);
-
-	FVector previousGravity;
-
-	FRotator rotGravity;
-	FRotator oldRotation;
-	float rotGravityPercent;
+	/** Destroys the first person meshes, muzzle and camera, which a dedicated server has no use for */
+	void StripCosmeticComponents();
 
 public:
 	/** Base turn rate, in deg/sec. Other scaling may affect final turn rate. */
@@ -60,6 +58,7 @@ public:
 	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category=Camera)
 	float BaseLookUpRate;
 
+	/** Passed on to the UGravityMovementComponent, which does the actual turning when gravity changes. */
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category=Gameplay)
 	float GravityRotationRate;
 
@@ -71,6 +70,11 @@ public:
 	UPROPERTY(EditDefaultsOnly, Category=Projectile)
 	TSubclassOf<class ABoardingActionProjectile> ProjectileClass;
 
+	/** Fire rounds through UProjectileManagerSubsystem, which flies them like ProjectileClass would without spawning actors.
+	 *  Leave this off if ProjectileClass adds behaviour of its own. */
+	UPROPERTY(EditDefaultsOnly, Category=Projectile)
+	bool bUseProjectileManager;
+
 	/** Sound to play each time we fire */
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category=Gameplay)
 	USoundBase* FireSound;
@@ -86,6 +90,8 @@ public:
 protected:
 	
 	UPhysicsSubsystem* worldPhysics;
+	UProjectilePoolSubsystem* projectilePool;
+	UProjectileManagerSubsystem* projectileManager;
 
 	/** Fires a projectile. */
 	void OnFire();
@@ -93,6 +99,15 @@ protected:
 	/* Meant to be context sensitive (depending on how the player binds it). For now, switches gravity. */
 	void OnRightClick();
 
+	/** Moves gravity on to the next direction in the cycle. Clients do this straight away as a prediction, and the server's answer comes back through ABoardingActionGameState. */
+	void CycleGravity();
+
+	UFUNCTION(Server, Reliable)
+	void ServerCycleGravity();
+
+	/** Shows or hides the HUD's performance overlay. */
+	void OnTogglePerfOverlay();
+
 	/** Resets HMD orientation and position in VR. */
 	void OnResetVR();
 
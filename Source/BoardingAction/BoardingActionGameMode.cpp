@@ -3,15 +3,54 @@
 #include "BoardingActionGameMode.h"
 #include "BoardingActionHUD.h"
 #include "BoardingActionCharacter.h"
-#include "UObject/ConstructorHelpers.h"
+#include "BoardingActionGameState.h"
+#include "BoardingActionAssetManager.h"
+#include "Engine/Engine.h"
+#include "Kismet/GameplayStatics.h"
 
 ABoardingActionGameMode::ABoardingActionGameMode()
 	: Super()
 {
-	// set default pawn class to our Blueprinted character
-	static ConstructorHelpers::FClassFinder<APawn> PlayerPawnClassFinder(TEXT("/Game/FirstPersonCPP/Blueprints/FirstPersonCharacter"));
-	DefaultPawnClass = PlayerPawnClassFinder.Class;
+	// our Blueprinted character, resolved when a player needs one. The native character is only a fallback if it can't be loaded.
+	PlayerPawnClass = TSoftClassPtr<APawn>(FSoftObjectPath(TEXT("/Game/FirstPersonCPP/Blueprints/FirstPersonCharacter.FirstPersonCharacter_C")));
+	DefaultPawnClass = ABoardingActionCharacter::StaticClass();
 
 	// use our custom HUD class
 	HUDClass = ABoardingActionHUD::StaticClass();
-}
\ No newline at end of file
+
+	// replicates the global gravity
+	GameStateClass = ABoardingActionGameState::StaticClass();
+
+	ServerTickRate = 60;
+}
+
+void ABoardingActionGameMode::InitGame(const FString& MapName, const FString& Options, FString& ErrorMessage)
+{
+	Super::InitGame(MapName, Options, ErrorMessage);
+
+	// Nobody is watching a dedicated server, so rather than running as fast as it can, it runs at a fixed rate.
+	// Physics and gravity then always step by the same amount, and whatever time is left over goes to other matches on the box.
+	const int32 TickRate = UGameplayStatics::GetIntOption(Options, TEXT("TickRate"), ServerTickRate);
+	if (GetNetMode() == NM_DedicatedServer && TickRate > 0)
+	{
+		GEngine->bUseFixedFrameRate = true;
+		GEngine->FixedFrameRate = TickRate;
+	}
+}
+
+UClass* ABoardingActionGameMode::GetDefaultPawnClassForController_Implementation(AController* InController)
+{
+	// Normally preloaded with the map, so this only waits if someone's joining before it's finished (e.g. a listen server's own player)
+	if (PlayerPawnClass.IsPending())
+	{
+		if (UBoardingActionAssetManager* AssetManager = UBoardingActionAssetManager::Get())
+		{
+			AssetManager->WaitForMatchAssets();
+		}
+	}
+	if (UClass* PawnClass = PlayerPawnClass.LoadSynchronous())
+	{
+		return PawnClass;
+	}
+	return Super::GetDefaultPawnClassForController_Implementation(InController);
+}
@@ -6,13 +6,24 @@
 #include "GameFramework/GameModeBase.h"
 #include "BoardingActionGameMode.generated.h"
 
-UCLASS(minimalapi)
+UCLASS(minimalapi, config=Game)
 class ABoardingActionGameMode : public AGameModeBase
 {
 	GENERATED_BODY()
 
 public:
 	ABoardingActionGameMode();
+
+	virtual void InitGame(const FString& MapName, const FString& Options, FString& ErrorMessage) override;
+	virtual UClass* GetDefaultPawnClassForController_Implementation(AController* InController) override;
+
+	/** The pawn players get. Soft referenced, so it's loaded along with the first map by UBoardingActionAssetManager rather than at startup */
+	UPROPERTY(Config)
+	TSoftClassPtr<APawn> PlayerPawnClass;
+
+	/** Frames per second a dedicated server runs at, with every frame (and so every physics and gravity step) the same length. Can be overridden per match with ?TickRate= */
+	UPROPERTY(Config)
+	int32 ServerTickRate;
 };
 
 
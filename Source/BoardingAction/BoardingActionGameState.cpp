@@ -0,0 +1,130 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "BoardingActionGameState.h"
+#include "PhysicsSubsystem.h"
+#include "Net/UnrealNetwork.h"
+
+// How old (in seconds) a replicated gravity change can be and still get backdated. Anything older is a client joining
+// or catching up long after the change, where making up for all that time would fling everything.
+static const float MaxGravityAge = 0.5f;
+
+FReplicatedGravity FReplicatedGravity::Make(const FVector& gravity, float serverTime)
+{
+	FReplicatedGravity result;
+	result.ServerTime = serverTime;
+
+	const float strength = gravity.GetAbsMax();
+	const int32 orientation = UPhysicsSubsystem::FindGravityOrientation(gravity);
+	if (strength == 0.0f)
+	{
+		// No gravity at all, which any orientation can stand for.
+		return result;
+	}
+	if (orientation != INDEX_NONE && strength * 100.0f <= MAX_uint16)
+	{
+		result.Orientation = orientation;
+		result.Strength = FMath::RoundToInt(strength * 100.0f);
+		// Only take the short form if it really does come back out the same.
+		if (result.GetGravity() == gravity)
+		{
+			return result;
+		}
+	}
+	result.Orientation = CustomOrientation;
+	result.Strength = 0;
+	result.Custom = gravity;
+	return result;
+}
+
+FVector FReplicatedGravity::GetGravity() const
+{
+	if (Orientation == CustomOrientation)
+	{
+		return Custom;
+	}
+	if (Orientation >= UPhysicsSubsystem::GetGravityOrientationCount())
+	{
+		return FVector::ZeroVector;
+	}
+	// Back to the -1, 0, 1 form, so multiplying by the strength is exact.
+	const FVector direction = UPhysicsSubsystem::GetGravityOrientationDirection(Orientation);
+	const FVector axes{FMath::RoundToFloat(direction.X / direction.GetAbsMax()), FMath::RoundToFloat(direction.Y / direction.GetAbsMax()), FMath::RoundToFloat(direction.Z / direction.GetAbsMax())};
+	return axes * (Strength / 100.0f);
+}
+
+bool FReplicatedGravity::NetSerialize(FArchive& Ar, UPackageMap* Map, bool& bOutSuccess)
+{
+	uint32 orientation = Orientation;
+	Ar.SerializeBits(&orientation, OrientationBits);
+	Orientation = orientation;
+
+	bOutSuccess = true;
+	if (Orientation == CustomOrientation)
+	{
+		Custom.NetSerialize(Ar, Map, bOutSuccess);
+	}
+	else
+	{
+		Ar << Strength;
+	}
+	Ar << ServerTime;
+	return true;
+}
+
+void ABoardingActionGameState::BeginPlay()
+{
+	Super::BeginPlay();
+
+	worldPhysics = GetWorld()->GetSubsystem<UPhysicsSubsystem>();
+	if (worldPhysics != nullptr && HasAuthority())
+	{
+		// Whatever gravity the match starts with, so clients joining before the first change get it too.
+		Gravity = FReplicatedGravity::Make(worldPhysics->GetGravity(), GetServerWorldTimeSeconds());
+		worldPhysics->OnGravityChanged.AddUObject(this, &ABoardingActionGameState::OnServerGravityChanged);
+	}
+}
+
+void ABoardingActionGameState::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	if (worldPhysics != nullptr)
+	{
+		worldPhysics->OnGravityChanged.RemoveAll(this);
+	}
+	Super::EndPlay(EndPlayReason);
+}
+
+void ABoardingActionGameState::GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const
+{
+	Super::GetLifetimeReplicatedProps(OutLifetimeProps);
+
+	DOREPLIFETIME(ABoardingActionGameState, Gravity);
+}
+
+void ABoardingActionGameState::OnServerGravityChanged(const FVector& oldGravity, const FVector& newGravity)
+{
+	Gravity = FReplicatedGravity::Make(newGravity, GetServerWorldTimeSeconds());
+	// Gravity changes are rare, but everyone should hear about one as soon as possible.
+	ForceNetUpdate();
+}
+
+void ABoardingActionGameState::OnRep_Gravity()
+{
+	// Can come in before our BeginPlay.
+	if (worldPhysics == nullptr)
+	{
+		worldPhysics = GetWorld()->GetSubsystem<UPhysicsSubsystem>();
+	}
+	if (worldPhysics != nullptr)
+	{
+		// The first gravity we're sent is just how things are when we join, so there's nothing to catch up on.
+		float age = FMath::Max(GetServerWorldTimeSeconds() - Gravity.ServerTime, 0.0f);
+		if (!bReceivedGravity || age > MaxGravityAge)
+		{
+			age = 0.0f;
+		}
+		bReceivedGravity = true;
+		// If we predicted this change ourselves it's already the current gravity, and this does nothing.
+		worldPhysics->SetGravity(Gravity.GetGravity(), age);
+	}
+}
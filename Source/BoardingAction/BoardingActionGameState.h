@@ -0,0 +1,83 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "GameFramework/GameStateBase.h"
+#include "Engine/NetSerialization.h"
+#include "BoardingActionGameState.generated.h"
+
+class UPhysicsSubsystem;
+
+/**
+ * The global gravity as it goes over the network. Gravity almost always points along one of UPhysicsSubsystem's
+ * canonical orientations, so that's sent as an index plus a strength, and only anything else sends the whole vector.
+ */
+USTRUCT()
+struct FReplicatedGravity
+{
+	GENERATED_BODY()
+
+	// Index into UPhysicsSubsystem's gravity orientations, or CustomOrientation.
+	UPROPERTY()
+	uint8 Orientation = 0;
+
+	// The largest component of the gravity, in hundredths. The orientation's own components are all -1, 0 or 1,
+	// so something like (9.8, 9.8, 0) comes back out exactly.
+	UPROPERTY()
+	uint16 Strength = 0;
+
+	// Only sent when Orientation is CustomOrientation.
+	UPROPERTY()
+	FVector_NetQuantize100 Custom;
+
+	// The server's GetServerWorldTimeSeconds when the change happened.
+	UPROPERTY()
+	float ServerTime = 0.0f;
+
+	// Fits in OrientationBits, and is past the last canonical orientation.
+	static const uint8 CustomOrientation = 31;
+	static const int32 OrientationBits = 5;
+
+	static FReplicatedGravity Make(const FVector& gravity, float serverTime);
+	FVector GetGravity() const;
+
+	bool NetSerialize(FArchive& Ar, class UPackageMap* Map, bool& bOutSuccess);
+};
+
+template<>
+struct TStructOpsTypeTraits<FReplicatedGravity> : public TStructOpsTypeTraitsBase2<FReplicatedGravity>
+{
+	enum
+	{
+		WithNetSerializer = true
+	};
+};
+
+/**
+ * Sends the server's gravity to every client, once per change, rather than having anything replicate gravity per actor.
+ * Clients hand it to their own UPhysicsSubsystem, backdated by how long ago the server changed it, so their bodies
+ * and character transitions line up with the server's.
+ */
+UCLASS()
+class BOARDINGACTION_API ABoardingActionGameState : public AGameStateBase
+{
+	GENERATED_BODY()
+
+public:
+	virtual void BeginPlay() override;
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+	virtual void GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const override;
+
+protected:
+	UPROPERTY(ReplicatedUsing=OnRep_Gravity)
+	FReplicatedGravity Gravity;
+
+	UFUNCTION()
+	void OnRep_Gravity();
+
+	void OnServerGravityChanged(const FVector& oldGravity, const FVector& newGravity);
+
+	UPhysicsSubsystem* worldPhysics;
+	bool bReceivedGravity;
+};
@@ -1,35 +1,180 @@
 // Copyright Epic Games, Inc. All Rights Reserved.
 
 #include "BoardingActionHUD.h"
+#include "BoardingAction.h"
 #include "Engine/Canvas.h"
+#include "Engine/Engine.h"
+#include "Engine/Font.h"
 #include "Engine/Texture2D.h"
 #include "TextureResource.h"
 #include "CanvasItem.h"
-#include "UObject/ConstructorHelpers.h"
+#include "RenderCore.h"
+#include "Engine/AssetManager.h"
+#include "Engine/StreamableManager.h"
+#include "PhysicsSubsystem.h"
+#include "ProjectilePoolSubsystem.h"
+#include "ProjectileManagerSubsystem.h"
+#include "EnemySignificanceSubsystem.h"
+#include "CrowdSubsystem.h"
+#include "PhysicsLODSubsystem.h"
+#include "ShipSectionSubsystem.h"
+
+DECLARE_CYCLE_STAT(TEXT("Perf Overlay"), STAT_PerfOverlay, STATGROUP_BoardingAction);
 
 ABoardingActionHUD::ABoardingActionHUD()
 {
-	// Set the crosshair texture
-	static ConstructorHelpers::FObjectFinder<UTexture2D> CrosshairTexObj(TEXT("/Game/FirstPerson/Textures/FirstPersonCrosshair"));
-	CrosshairTex = CrosshairTexObj.Object;
+	// Set the crosshair texture. It's loaded in BeginPlay, normally having already been preloaded with the map.
+	CrosshairTexture = TSoftObjectPtr<UTexture2D>(FSoftObjectPath(TEXT("/Game/FirstPerson/Textures/FirstPersonCrosshair.FirstPersonCrosshair")));
+	CrosshairTex = nullptr;
+
+	bShowPerfOverlay = false;
+	PerfOverlayRefreshInterval = 0.25f;
+}
+
+void ABoardingActionHUD::BeginPlay()
+{
+	Super::BeginPlay();
+
+	// UBoardingActionAssetManager has usually loaded it already. If not, there's no crosshair until it has.
+	CrosshairTex = CrosshairTexture.Get();
+	if (CrosshairTex == nullptr && !CrosshairTexture.IsNull())
+	{
+		UAssetManager::GetStreamableManager().RequestAsyncLoad(CrosshairTexture.ToSoftObjectPath(), FStreamableDelegate::CreateUObject(this, &ABoardingActionHUD::OnCrosshairLoaded));
+	}
 }
 
+void ABoardingActionHUD::OnCrosshairLoaded()
+{
+	CrosshairTex = CrosshairTexture.Get();
+}
 
 void ABoardingActionHUD::DrawHUD()
 {
 	Super::DrawHUD();
 
 	// Draw very simple crosshair
+	if (CrosshairTex != nullptr && CrosshairTex->Resource != nullptr)
+	{
+		// find center of the Canvas
+		const FVector2D Center(Canvas->ClipX * 0.5f, Canvas->ClipY * 0.5f);
+
+		// offset by half the texture's dimensions so that the center of the texture aligns with the center of the Canvas
+		const FVector2D CrosshairDrawPosition( (Center.X),
+											   (Center.Y + 20.0f));
+
+		// draw the crosshair
+		FCanvasTileItem TileItem( CrosshairDrawPosition, CrosshairTex->Resource, FLinearColor::White);
+		TileItem.BlendMode = SE_BLEND_Translucent;
+		Canvas->DrawItem( TileItem );
+	}
+
+#if !UE_BUILD_SHIPPING
+	if (bShowPerfOverlay)
+	{
+		SCOPE_CYCLE_COUNTER(STAT_PerfOverlay);
+		UpdatePerfOverlay();
+		DrawPerfOverlay();
+	}
+#endif
+}
 
-	// find center of the Canvas
-	const FVector2D Center(Canvas->ClipX * 0.5f, Canvas->ClipY * 0.5f);
+void ABoardingActionHUD::TogglePerfOverlay()
+{
+	bShowPerfOverlay = !bShowPerfOverlay;
+	// Start the averages over, rather than including whatever happened while the overlay was hidden
+	PerfFrames = 0;
+	PerfOverlayLastRefresh = 0.0;
+}
+
+void ABoardingActionHUD::UpdatePerfOverlay()
+{
+	UPhysicsSubsystem* Physics = GetWorld()->GetSubsystem<UPhysicsSubsystem>();
+
+	if (PerfFrames == 0)
+	{
+		PerfFrameTime = PerfFrameTimeMax = PerfGameThreadTime = PerfPhysicsTime = PerfGravityPassTime = 0.0;
+		PerfGravityBodies = 0;
+	}
+	const double FrameTime = FApp::GetDeltaTime();
+	PerfFrames++;
+	PerfFrameTime += FrameTime;
+	PerfFrameTimeMax = FMath::Max(PerfFrameTimeMax, FrameTime);
+	PerfGameThreadTime += FPlatformTime::ToSeconds(GGameThreadTime);
+	if (Physics != nullptr)
+	{
+		PerfPhysicsTime += Physics->GetLastPhysicsStepTime();
+		PerfGravityPassTime += Physics->GetLastPassTime();
+		PerfGravityBodies += Physics->GetLastPassBodyCount();
+	}
+
+	const double Now = FPlatformTime::Seconds();
+	if (PerfOverlayLines.Num() > 0 && Now - PerfOverlayLastRefresh < PerfOverlayRefreshInterval)
+	{
+		return;
+	}
+	PerfOverlayLastRefresh = Now;
+
+	UWorld* World = GetWorld();
+	UProjectilePoolSubsystem* Pool = World->GetSubsystem<UProjectilePoolSubsystem>();
+	UProjectileManagerSubsystem* Projectiles = World->GetSubsystem<UProjectileManagerSubsystem>();
+	UEnemySignificanceSubsystem* Significance = World->GetSubsystem<UEnemySignificanceSubsystem>();
+	UCrowdSubsystem* Crowd = World->GetSubsystem<UCrowdSubsystem>();
+	UPhysicsLODSubsystem* PhysicsLOD = World->GetSubsystem<UPhysicsLODSubsystem>();
+	UShipSectionSubsystem* Sections = World->GetSubsystem<UShipSectionSubsystem>();
+
+	const double Frames = FMath::Max(PerfFrames, 1);
+	TArray<FString, TInlineAllocator<14>> Lines;
+	Lines.Add(FString::Printf(TEXT("Frame    %5.2f ms (max %5.2f)"), PerfFrameTime / Frames * 1000.0, PerfFrameTimeMax * 1000.0));
+	Lines.Add(FString::Printf(TEXT("Game     %5.2f ms"), PerfGameThreadTime / Frames * 1000.0));
+	Lines.Add(FString::Printf(TEXT("Physics  %5.2f ms"), PerfPhysicsTime / Frames * 1000.0));
+	Lines.Add(FString::Printf(TEXT("Gravity  %5.2f ms, %d bodies"), PerfGravityPassTime / Frames * 1000.0, FMath::RoundToInt(PerfGravityBodies / Frames)));
+	Lines.Add(FString::Printf(TEXT("Bodies  %d awake, %d asleep"), Physics != nullptr ? Physics->GetAwakeBodyCount() : 0, Physics != nullptr ? Physics->GetSleepingBodyCount() : 0));
+	Lines.Add(FString::Printf(TEXT("Physics LOD  %d ballistic"), PhysicsLOD != nullptr ? PhysicsLOD->GetBallisticCount() : 0));
+	Lines.Add(FString::Printf(TEXT("Wake ups pending  %d"), Physics != nullptr ? Physics->GetPendingWakeCount() : 0));
+	Lines.Add(FString::Printf(TEXT("Projectiles  %d pooled, %d batched"), Pool != nullptr ? Pool->GetActiveCount() : 0, Projectiles != nullptr ? Projectiles->GetLiveCount() : 0));
+	if (Significance != nullptr)
+	{
+		FString Tiers = TEXT("Enemies by tier ");
+		for (int32 Tier = 0; Tier < Significance->Tiers.Num(); Tier++)
+		{
+			Tiers += FString::Printf(TEXT(" %d"), Significance->GetTierCount(Tier));
+		}
+		Lines.Add(Tiers);
+	}
+	Lines.Add(FString::Printf(TEXT("Crowd  %d, %d promoted"), Crowd != nullptr ? Crowd->GetEntityCount() : 0, Crowd != nullptr ? Crowd->GetPromotedCount() : 0));
+	Lines.Add(FString::Printf(TEXT("Sections  %d resident, %d frozen, %d bodies saved"), Sections != nullptr ? Sections->GetResidentCount() : 0, Sections != nullptr ? Sections->GetFrozenCount() : 0, Sections != nullptr ? Sections->GetSavedBodyCount() : 0));
+	PerfFrames = 0;
+
+	// Measuring text is the expensive part, so only do it when the text changes
+	PerfOverlayLines.Reset();
+	PerfOverlaySize = FVector2D::ZeroVector;
+	PerfOverlayLineHeight = 0.0f;
+	for (const FString& Line : Lines)
+	{
+		float Width = 0.0f;
+		float Height = 0.0f;
+		Canvas->TextSize(GEngine->GetSmallFont(), Line, Width, Height);
+		PerfOverlayLines.Add(FText::FromString(Line));
+		PerfOverlaySize.X = FMath::Max(PerfOverlaySize.X, Width);
+		PerfOverlayLineHeight = FMath::Max(PerfOverlayLineHeight, Height);
+	}
+	PerfOverlaySize.Y = PerfOverlayLineHeight * PerfOverlayLines.Num();
+}
+
+void ABoardingActionHUD::DrawPerfOverlay()
+{
+	// One backing tile and one text item per line, all reusing the cached text and sizes
+	const FVector2D Padding(6.0f, 4.0f);
+	const FVector2D Position(16.0f, 16.0f);
 
-	// offset by half the texture's dimensions so that the center of the texture aligns with the center of the Canvas
-	const FVector2D CrosshairDrawPosition( (Center.X),
-										   (Center.Y + 20.0f));
+	FCanvasTileItem Background(Position - Padding, PerfOverlaySize + Padding * 2.0f, FLinearColor(0.0f, 0.0f, 0.0f, 0.5f));
+	Background.BlendMode = SE_BLEND_Translucent;
+	Canvas->DrawItem(Background);
 
-	// draw the crosshair
-	FCanvasTileItem TileItem( CrosshairDrawPosition, CrosshairTex->Resource, FLinearColor::White);
-	TileItem.BlendMode = SE_BLEND_Translucent;
-	Canvas->DrawItem( TileItem );
+	FCanvasTextItem TextItem(Position, FText::GetEmpty(), GEngine->GetSmallFont(), FLinearColor::White);
+	for (int32 Line = 0; Line < PerfOverlayLines.Num(); Line++)
+	{
+		TextItem.Text = PerfOverlayLines[Line];
+		Canvas->DrawItem(TextItem, Position.X, Position.Y + Line * PerfOverlayLineHeight);
+	}
 }
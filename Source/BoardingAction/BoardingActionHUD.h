@@ -6,7 +6,7 @@
 #include "GameFramework/HUD.h"
 #include "BoardingActionHUD.generated.h"
 
-UCLASS()
+UCLASS(config=Game)
 class ABoardingActionHUD : public AHUD
 {
 	GENERATED_BODY()
@@ -14,12 +14,51 @@ class ABoardingActionHUD : public AHUD
 public:
 	ABoardingActionHUD();
 
+	virtual void BeginPlay() override;
+
 	/** Primary draw call for the HUD */
 	virtual void DrawHUD() override;
 
+	/** Shows or hides the performance overlay. Also available as a console command. */
+	UFUNCTION(Exec)
+	void TogglePerfOverlay();
+
+	/** Whether the performance overlay starts out visible */
+	UPROPERTY(Config)
+	bool bShowPerfOverlay;
+
+	/** Seconds between refreshes of the overlay's text. Timings are averaged over the time in between. */
+	UPROPERTY(Config)
+	float PerfOverlayRefreshInterval;
+
+	/** Crosshair asset. Soft referenced, so it isn't loaded at startup, and a dedicated server (which never makes a HUD) doesn't load it at all */
+	UPROPERTY(Config)
+	TSoftObjectPtr<class UTexture2D> CrosshairTexture;
+
 private:
-	/** Crosshair asset pointer */
+	/** Crosshair asset pointer, once it's loaded */
+	UPROPERTY(Transient)
 	class UTexture2D* CrosshairTex;
 
+	void OnCrosshairLoaded();
+
+	/** Adds this frame's timings to the running averages, and rebuilds the overlay text when it's due */
+	void UpdatePerfOverlay();
+	void DrawPerfOverlay();
+
+	/** The overlay's text only changes a few times a second, so it's built and measured once and then redrawn as is */
+	TArray<FText> PerfOverlayLines;
+	FVector2D PerfOverlaySize;
+	float PerfOverlayLineHeight;
+	double PerfOverlayLastRefresh;
+
+	/** Sums since the last refresh */
+	int32 PerfFrames;
+	double PerfFrameTime;
+	double PerfFrameTimeMax;
+	double PerfGameThreadTime;
+	double PerfPhysicsTime;
+	double PerfGravityPassTime;
+	int32 PerfGravityBodies;
 };
 
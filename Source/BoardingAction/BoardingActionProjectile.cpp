@@ -1,8 +1,11 @@
 // Copyright Epic Games, Inc. All Rights Reserved.
 
 #include "BoardingActionProjectile.h"
+#include "BoardingAction.h"
 #include "GameFramework/ProjectileMovementComponent.h"
 #include "Components/SphereComponent.h"
+#include "ProjectilePoolSubsystem.h"
+#include "PhysicsSubsystem.h"
 
 ABoardingActionProjectile::ABoardingActionProjectile() 
 {
@@ -27,17 +30,96 @@ ABoardingActionProjectile::ABoardingActionProjectile()
 	ProjectileMovement->bRotationFollowsVelocity = true;
 	ProjectileMovement->bShouldBounce = true;
 
-	// Die after 3 seconds by default
-	InitialLifeSpan = 3.0f;
+	// Die after 3 seconds by default. This is set in BeginPlay (and again whenever we're fired from a pool) instead of
+	// through InitialLifeSpan, so that a pooled projectile can be reused.
+	ProjectileLifeSpan = 3.0f;
+	bActive = true;
+}
+
+void ABoardingActionProjectile::BeginPlay()
+{
+	Super::BeginPlay();
+
+	worldPhysics = GetWorld()->GetSubsystem<UPhysicsSubsystem>();
+
+	// Pooled projectiles are spawned deactivated, and get their life span when they're fired.
+	if (bActive)
+	{
+		SetLifeSpan(ProjectileLifeSpan);
+	}
+}
+
+void ABoardingActionProjectile::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	if (UProjectilePoolSubsystem* owningPool = pool.Get())
+	{
+		owningPool->OnProjectileDestroyed(this);
+		pool.Reset();
+	}
+	Super::EndPlay(EndPlayReason);
+}
+
+void ABoardingActionProjectile::LifeSpanExpired()
+{
+	Recycle();
+}
+
+void ABoardingActionProjectile::Recycle()
+{
+	if (UProjectilePoolSubsystem* owningPool = pool.Get())
+	{
+		owningPool->Release(this);
+	}
+	else
+	{
+		Destroy();
+	}
+}
+
+void ABoardingActionProjectile::Fire(const FVector& location, const FRotator& rotation)
+{
+	bActive = true;
+	SetActorLocationAndRotation(location, rotation, false, nullptr, ETeleportType::ResetPhysics);
+	SetActorHiddenInGame(false);
+	SetActorEnableCollision(true);
+
+	// The movement component lets go of its updated component once it comes to rest, so hook it back up.
+	ProjectileMovement->SetUpdatedComponent(CollisionComp);
+	ProjectileMovement->Velocity = rotation.Vector() * ProjectileMovement->InitialSpeed;
+	ProjectileMovement->Activate(true);
+
+	SetLifeSpan(ProjectileLifeSpan);
+}
+
+void ABoardingActionProjectile::Deactivate()
+{
+	bActive = false;
+	SetLifeSpan(0.0f);
+	ProjectileMovement->StopMovementImmediately();
+	ProjectileMovement->Deactivate();
+	SetActorEnableCollision(false);
+	SetActorHiddenInGame(true);
 }
 
 void ABoardingActionProjectile::OnHit(UPrimitiveComponent* HitComp, AActor* OtherActor, UPrimitiveComponent* OtherComp, FVector NormalImpulse, const FHitResult& Hit)
 {
+	TRACE_CPUPROFILER_EVENT_SCOPE(ABoardingActionProjectile::OnHit);
+	CSV_CUSTOM_STAT(BoardingAction, ProjectileHits, 1, ECsvCustomStatOp::Accumulate);
+	// The body that was actually hit, which for instanced props is the instance's own rather than the component's
+	FBodyInstance* OtherBody = (OtherComp != nullptr) ? OtherComp->GetBodyInstance(NAME_None, true, Hit.Item) : nullptr;
 	// Only add impulse and destroy projectile if we hit a physics
-	if ((OtherActor != nullptr) && (OtherActor != this) && (OtherComp != nullptr) && OtherComp->IsSimulatingPhysics())
+	if ((OtherActor != nullptr) && (OtherActor != this) && (OtherBody != nullptr) && OtherBody->IsInstanceSimulatingPhysics())
 	{
-		OtherComp->AddImpulseAtLocation(GetVelocity() * 100.0f, GetActorLocation());
+		// Queued rather than applied right away, so a burst of hits on the same body only costs one impulse.
+		if (worldPhysics != nullptr)
+		{
+			worldPhysics->QueueImpulseAtLocation(OtherComp, GetVelocity() * 100.0f, GetActorLocation(), Hit.Item);
+		}
+		else
+		{
+			OtherBody->AddImpulseAtPosition(GetVelocity() * 100.0f, GetActorLocation());
+		}
 
-		Destroy();
+		Recycle();
 	}
 }
\ No newline at end of file
@@ -8,6 +8,8 @@
 
 class USphereComponent;
 class UProjectileMovementComponent;
+class UProjectilePoolSubsystem;
+class UPhysicsSubsystem;
 
 UCLASS(config=Game)
 class ABoardingActionProjectile : public AActor
@@ -29,6 +31,32 @@ public:
 	UFUNCTION()
 	void OnHit(UPrimitiveComponent* HitComp, AActor* OtherActor, UPrimitiveComponent* OtherComp, FVector NormalImpulse, const FHitResult& Hit);
 
+	/** How long a fired projectile lives for before it's returned to its pool (or destroyed, if it isn't pooled) */
+	UPROPERTY(EditDefaultsOnly, Category=Projectile)
+	float ProjectileLifeSpan;
+
+	// Pooling, see UProjectilePoolSubsystem.
+	// Resets the projectile and sends it off from location, as if it had just been spawned there.
+	void Fire(const FVector& location, const FRotator& rotation);
+	// Hides the projectile and turns off its collision and movement until it's fired again.
+	void Deactivate();
+	bool IsActive() const { return bActive; }
+	void SetPool(UProjectilePoolSubsystem* newPool) { pool = newPool; }
+	UProjectilePoolSubsystem* GetPool() const { return pool.Get(); }
+
+protected:
+	virtual void BeginPlay() override;
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+	virtual void LifeSpanExpired() override;
+
+	// Goes back to the pool if we came from one, otherwise gets destroyed like a normal actor.
+	void Recycle();
+
+	TWeakObjectPtr<UProjectilePoolSubsystem> pool;
+	UPhysicsSubsystem* worldPhysics;
+	bool bActive;
+
+public:
 	/** Returns CollisionComp subobject **/
 	USphereComponent* GetCollisionComp() const { return CollisionComp; }
 	/** Returns ProjectileMovement subobject **/
@@ -2,11 +2,19 @@
 
 
 #include "Enemy.h"
+#include "BoardingAction.h"
+#include "GravityMovementComponent.h"
+#include "EnemySignificanceSubsystem.h"
+#include "PhysicsSubsystem.h"
+#include "PerceptionSubsystem.h"
+#include "Components/SkeletalMeshComponent.h"
 
 // Sets default values
-AEnemy::AEnemy()
+AEnemy::AEnemy(const FObjectInitializer& ObjectInitializer)
+	: Super(ObjectInitializer.SetDefaultSubobjectClass<UGravityMovementComponent>(ACharacter::CharacterMovementComponentName))
 {
  	// Set this character to call Tick() every frame.  You can turn this off to improve performance if you don't need it.
+	// How often it actually ticks is up to UEnemySignificanceSubsystem.
 	PrimaryActorTick.bCanEverTick = true;
 
 }
@@ -15,12 +23,60 @@ AEnemy::AEnemy()
 void AEnemy::BeginPlay()
 {
 	Super::BeginPlay();
-	
+
+	// The movement component registers itself with the physics subsystem in its own BeginPlay, which has already happened.
+	worldPhysics = GetWorld()->GetSubsystem<UPhysicsSubsystem>();
+	significance = GetWorld()->GetSubsystem<UEnemySignificanceSubsystem>();
+	perception = GetWorld()->GetSubsystem<UPerceptionSubsystem>();
+	if (significance != nullptr)
+	{
+		significance->RegisterEnemy(this);
+	}
+}
+
+void AEnemy::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	if (significance != nullptr)
+	{
+		significance->UnregisterEnemy(this);
+	}
+	if (perception != nullptr)
+	{
+		perception->RemoveObserver(this);
+	}
+	Super::EndPlay(EndPlayReason);
+}
+
+bool AEnemy::CanSee(AActor* target)
+{
+	return perception != nullptr && perception->CanSee(this, target);
+}
+
+void AEnemy::ApplySignificanceTier(const FEnemySignificanceTier& tier)
+{
+	SetActorTickInterval(tier.ActorTickInterval);
+
+	if (UCharacterMovementComponent* movement = GetCharacterMovement())
+	{
+		movement->SetComponentTickInterval(tier.MovementTickInterval);
+		if (worldPhysics != nullptr)
+		{
+			worldPhysics->SetMoverUpdateInterval(movement, tier.GravityUpdateInterval);
+		}
+	}
+
+	if (USkeletalMeshComponent* mesh = GetMesh())
+	{
+		mesh->SetComponentTickInterval(tier.AnimationTickInterval);
+		mesh->VisibilityBasedAnimTickOption = tier.bTickPoseWhenHidden ? EVisibilityBasedAnimTickOption::AlwaysTickPose : EVisibilityBasedAnimTickOption::OnlyTickMontagesWhenNotRendered;
+	}
 }
 
 // Called every frame
 void AEnemy::Tick(float DeltaTime)
 {
+	TRACE_CPUPROFILER_EVENT_SCOPE(AEnemy::Tick);
+	CSV_CUSTOM_STAT(BoardingAction, EnemyTicks, 1, ECsvCustomStatOp::Accumulate);
 	Super::Tick(DeltaTime);
 
 }
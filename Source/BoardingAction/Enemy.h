@@ -6,6 +6,11 @@
 #include "GameFramework/Character.h"
 #include "Enemy.generated.h"
 
+struct FEnemySignificanceTier;
+class UPhysicsSubsystem;
+class UEnemySignificanceSubsystem;
+class UPerceptionSubsystem;
+
 UCLASS()
 class BOARDINGACTION_API AEnemy : public ACharacter
 {
@@ -13,11 +18,16 @@ class BOARDINGACTION_API AEnemy : public ACharacter
 
 public:
 	// Sets default values for this character's properties
-	AEnemy();
+	AEnemy(const FObjectInitializer& ObjectInitializer);
 
 protected:
 	// Called when the game starts or when spawned
 	virtual void BeginPlay() override;
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
+	UPhysicsSubsystem* worldPhysics;
+	UEnemySignificanceSubsystem* significance;
+	UPerceptionSubsystem* perception;
 
 public:	
 	// Called every frame
@@ -26,4 +36,10 @@ public:
 	// Called to bind functionality to input
 	virtual void SetupPlayerInputComponent(class UInputComponent* PlayerInputComponent) override;
 
+	// Sets how often we tick, move, animate and get our gravity checked. Called by UEnemySignificanceSubsystem.
+	void ApplySignificanceTier(const FEnemySignificanceTier& tier);
+
+	// Line of sight to target, through the shared UPerceptionSubsystem. The answer can be a few frames old.
+	bool CanSee(AActor* target);
+
 };
@@ -0,0 +1,451 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "BenchmarkSubsystem.h"
+#include "BoardingAction.h"
+#include "BoardingActionProjectile.h"
+#include "Enemy.h"
+#include "GravityController.h"
+#include "GravityPropCollection.h"
+#include "PhysicsSubsystem.h"
+#include "ProjectilePoolSubsystem.h"
+#include "ProjectileManagerSubsystem.h"
+#include "CrowdSubsystem.h"
+#include "Engine/StaticMesh.h"
+#include "Engine/StaticMeshActor.h"
+#include "Engine/CollisionProfile.h"
+#include "Engine/World.h"
+#include "Misc/App.h"
+#include "Misc/CommandLine.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "RenderCore.h"
+#include "Dom/JsonObject.h"
+#include "Serialization/JsonReader.h"
+#include "Serialization/JsonSerializer.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogBenchmark, Log, All);
+
+// Same order ABoardingActionCharacter::OnRightClick cycles through.
+static const FVector BenchmarkGravitySequence[] = {
+	FVector(0.0f, 0.0f, -9.8f),
+	FVector(0.0f, 0.0f, 9.8f),
+	FVector(9.8f, 9.8f, 0.0f),
+	FVector(0.0f, 9.8f, 0.0f)
+};
+
+// Indices into metrics.
+enum EBenchmarkMetric
+{
+	FrameTimeMetric,
+	GameThreadMetric,
+	PhysicsStepMetric,
+	GravityPassMetric,
+	MetricCount
+};
+
+// Percentiles that get written out and compared to the baseline. Max is written out too, but it's too noisy to compare.
+static const float BenchmarkPercentiles[] = { 0.5f, 0.9f, 0.99f };
+static const TCHAR* BenchmarkPercentileNames[] = { TEXT("p50"), TEXT("p90"), TEXT("p99") };
+// Anything that changed by less than this (in ms) is noise, however big it is as a fraction.
+static const float RegressionFloor = 0.1f;
+
+// Exit codes.
+static const int32 BenchmarkPassed = 0;
+static const int32 BenchmarkRegressed = 1;
+static const int32 BenchmarkFailed = 2;
+
+float FBenchmarkMetric::GetPercentile(float p) const {
+	if (samples.Num() == 0) {
+		return 0.0f;
+	}
+	TArray<float> sorted = samples;
+	sorted.Sort();
+	int32 rank = FMath::Clamp(FMath::CeilToInt(p * sorted.Num()) - 1, 0, sorted.Num() - 1);
+	return sorted[rank];
+}
+
+float FBenchmarkMetric::GetMean() const {
+	if (samples.Num() == 0) {
+		return 0.0f;
+	}
+	double total = 0.0;
+	for (float sample : samples) {
+		total += sample;
+	}
+	return total / samples.Num();
+}
+
+UBenchmarkSubsystem::UBenchmarkSubsystem() {
+	WarmupTime = 3.0f;
+	Duration = 30.0f;
+	GravityChangeInterval = 5.0f;
+	PropCount = 1000;
+	bUseInstancedProps = false;
+	EnemyCount = 32;
+	CrowdCount = 512;
+	ProjectilesPerSecond = 200.0f;
+	bUseProjectileManager = true;
+	EnemyClass = AEnemy::StaticClass();
+	ProjectileClass = ABoardingActionProjectile::StaticClass();
+	CubeMesh = FSoftObjectPath(TEXT("/Engine/BasicShapes/Cube.Cube"));
+	ArenaSize = 6000.0f;
+	RandomSeed = 1;
+	OutputDirectory = TEXT("Saved/Benchmarks");
+	BaselineFile = TEXT("Benchmarks/Baseline.json");
+	RegressionTolerance = 0.1f;
+	phase = EBenchmarkPhase::Setup;
+}
+
+bool UBenchmarkSubsystem::ShouldCreateSubsystem(UObject* Outer) const {
+	if (!Super::ShouldCreateSubsystem(Outer) || !FParse::Param(FCommandLine::Get(), TEXT("GravityBenchmark"))) {
+		return false;
+	}
+	UWorld* world = Cast<UWorld>(Outer);
+	return world != nullptr && world->IsGameWorld();
+}
+
+void UBenchmarkSubsystem::Initialize(FSubsystemCollectionBase& Collection) {
+	worldPhysics = Cast<UPhysicsSubsystem>(Collection.InitializeDependency(UPhysicsSubsystem::StaticClass()));
+	ParseCommandLine();
+	random.Initialize(RandomSeed);
+
+	phase = EBenchmarkPhase::Setup;
+	phaseTime = 0.0f;
+	gravityTime = 0.0f;
+	gravityStep = 0;
+	projectileBudget = 0.0f;
+	lastFrameSeconds = FPlatformTime::Seconds();
+
+	metrics.SetNum(MetricCount);
+	metrics[FrameTimeMetric].name = TEXT("FrameTime");
+	metrics[GameThreadMetric].name = TEXT("GameThreadTime");
+	metrics[PhysicsStepMetric].name = TEXT("PhysicsStepTime");
+	metrics[GravityPassMetric].name = TEXT("GravityPassTime");
+
+	// Without a fixed time step, how much happens each frame depends on how fast the last one was.
+	if (!FApp::IsBenchmarking()) {
+		UE_LOG(LogBenchmark, Warning, TEXT("Not running with a fixed time step, pass -benchmark -fps=60 for results that can be compared between runs."));
+	}
+}
+
+void UBenchmarkSubsystem::Deinitialize() {
+	metrics.Empty();
+	bodyCounts.Empty();
+	projectileCounts.Empty();
+	worldPhysics = nullptr;
+}
+
+void UBenchmarkSubsystem::ParseCommandLine() {
+	const TCHAR* commandLine = FCommandLine::Get();
+	FParse::Value(commandLine, TEXT("BenchmarkWarmup="), WarmupTime);
+	FParse::Value(commandLine, TEXT("BenchmarkDuration="), Duration);
+	FParse::Value(commandLine, TEXT("BenchmarkGravityInterval="), GravityChangeInterval);
+	FParse::Value(commandLine, TEXT("BenchmarkProps="), PropCount);
+	FParse::Bool(commandLine, TEXT("BenchmarkInstancedProps="), bUseInstancedProps);
+	FParse::Value(commandLine, TEXT("BenchmarkEnemies="), EnemyCount);
+	FParse::Value(commandLine, TEXT("BenchmarkCrowd="), CrowdCount);
+	FParse::Value(commandLine, TEXT("BenchmarkProjectiles="), ProjectilesPerSecond);
+	FParse::Bool(commandLine, TEXT("BenchmarkProjectileManager="), bUseProjectileManager);
+	FParse::Value(commandLine, TEXT("BenchmarkSeed="), RandomSeed);
+	FParse::Value(commandLine, TEXT("BenchmarkOutput="), OutputDirectory);
+	FParse::Value(commandLine, TEXT("BenchmarkBaseline="), BaselineFile);
+	FParse::Value(commandLine, TEXT("BenchmarkTolerance="), RegressionTolerance);
+	bSaveBaseline = FParse::Param(commandLine, TEXT("BenchmarkSaveBaseline"));
+}
+
+void UBenchmarkSubsystem::Tick(float DeltaTime) {
+	const double now = FPlatformTime::Seconds();
+	const double frameSeconds = now - lastFrameSeconds;
+	lastFrameSeconds = now;
+
+	if (phase == EBenchmarkPhase::Setup) {
+		if (!GetWorld()->HasBegunPlay()) {
+			return;
+		}
+		BuildArena();
+		SpawnProps();
+		SpawnEnemies();
+		worldPhysics->SetGravity(BenchmarkGravitySequence[0].X, BenchmarkGravitySequence[0].Y, BenchmarkGravitySequence[0].Z);
+		UE_LOG(LogBenchmark, Log, TEXT("Spawned %d props, %d enemies and %d crowd entities, warming up for %.1fs."), PropCount, EnemyCount, CrowdCount, WarmupTime);
+		phase = EBenchmarkPhase::Warmup;
+		return;
+	}
+
+	FireProjectiles(DeltaTime);
+	gravityTime += DeltaTime;
+	if (gravityTime >= GravityChangeInterval) {
+		gravityTime -= GravityChangeInterval;
+		AdvanceGravity();
+	}
+
+	phaseTime += DeltaTime;
+	if (phase == EBenchmarkPhase::Warmup) {
+		if (phaseTime >= WarmupTime) {
+			UE_LOG(LogBenchmark, Log, TEXT("Recording for %.1fs."), Duration);
+			phase = EBenchmarkPhase::Recording;
+			phaseTime = 0.0f;
+		}
+		return;
+	}
+
+	Record(frameSeconds);
+	if (phaseTime >= Duration) {
+		phase = EBenchmarkPhase::Finished;
+		FPlatformMisc::RequestExitWithStatus(false, Finish());
+	}
+}
+
+AActor* UBenchmarkSubsystem::SpawnCube(const FVector& location, const FVector& scale, bool bSimulatePhysics) {
+	FActorSpawnParameters params;
+	params.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+	params.ObjectFlags |= RF_Transient;
+	AStaticMeshActor* cube = GetWorld()->SpawnActor<AStaticMeshActor>(location, FRotator::ZeroRotator, params);
+	if (cube == nullptr) {
+		return nullptr;
+	}
+	// Static components can't have their mesh set or be moved once they're registered, which they already are.
+	UStaticMeshComponent* mesh = cube->GetStaticMeshComponent();
+	mesh->SetMobility(EComponentMobility::Movable);
+	mesh->SetStaticMesh(Cast<UStaticMesh>(CubeMesh.TryLoad()));
+	cube->SetActorScale3D(scale);
+	if (bSimulatePhysics) {
+		mesh->SetCollisionProfileName(UCollisionProfile::PhysicsActor_ProfileName);
+		// Gravity comes from UPhysicsSubsystem, which turns the scene's back on itself if it's in Solver mode.
+		mesh->SetEnableGravity(false);
+		mesh->SetSimulatePhysics(true);
+	}
+	return cube;
+}
+
+void UBenchmarkSubsystem::BuildArena() {
+	// Six slabs around the origin, each a cube's width thick.
+	const float thickness = 100.0f;
+	const float span = (ArenaSize + thickness * 2.0f) / thickness;
+	for (int32 axis = 0; axis < 3; axis++) {
+		for (float side : { -1.0f, 1.0f }) {
+			FVector location = FVector::ZeroVector;
+			location[axis] = side * (ArenaSize + thickness) * 0.5f;
+			FVector scale(span);
+			scale[axis] = 1.0f;
+			SpawnCube(location, scale, false);
+		}
+	}
+}
+
+void UBenchmarkSubsystem::SpawnProps() {
+	const float extent = ArenaSize * 0.5f - 100.0f;
+	if (bUseInstancedProps) {
+		FActorSpawnParameters params;
+		params.ObjectFlags |= RF_Transient;
+		AActor* holder = GetWorld()->SpawnActor<AActor>(params);
+		UGravityPropCollection* props = NewObject<UGravityPropCollection>(holder);
+		props->SetStaticMesh(Cast<UStaticMesh>(CubeMesh.TryLoad()));
+		holder->SetRootComponent(props);
+		holder->AddInstanceComponent(props);
+		for (int32 i = 0; i < PropCount; i++) {
+			FVector location(random.FRandRange(-extent, extent), random.FRandRange(-extent, extent), random.FRandRange(-extent, extent));
+			props->AddInstanceWorldSpace(FTransform(FRotator::ZeroRotator, location, FVector(0.5f)));
+		}
+		// The instance bodies get made when it begins play, which registering it does, since the holder already has.
+		props->RegisterComponent();
+		return;
+	}
+	for (int32 i = 0; i < PropCount; i++) {
+		FVector location(random.FRandRange(-extent, extent), random.FRandRange(-extent, extent), random.FRandRange(-extent, extent));
+		AActor* prop = SpawnCube(location, FVector(0.5f), true);
+		if (prop == nullptr) {
+			continue;
+		}
+		// The actor has already begun play, so registering the controller registers the body with UPhysicsSubsystem too.
+		UGravityController* controller = NewObject<UGravityController>(prop);
+		prop->AddInstanceComponent(controller);
+		controller->RegisterComponent();
+	}
+}
+
+void UBenchmarkSubsystem::SpawnEnemies() {
+	const float extent = ArenaSize * 0.5f - 200.0f;
+	FActorSpawnParameters params;
+	params.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AdjustIfPossibleButAlwaysSpawn;
+	for (int32 i = 0; i < EnemyCount; i++) {
+		FVector location(random.FRandRange(-extent, extent), random.FRandRange(-extent, extent), random.FRandRange(-extent, extent));
+		AEnemy* enemy = GetWorld()->SpawnActor<AEnemy>(EnemyClass, FTransform(location), params);
+		// Spawned pawns don't get a controller by default, and movement doesn't run without one.
+		if (enemy != nullptr && enemy->GetController() == nullptr) {
+			enemy->SpawnDefaultController();
+		}
+	}
+
+	UCrowdSubsystem* crowd = GetWorld()->GetSubsystem<UCrowdSubsystem>();
+	if (crowd != nullptr && CrowdCount > 0) {
+		// On the floor for the first gravity in the sequence.
+		CrowdCount = crowd->AddEntities(FVector(0.0f, 0.0f, -ArenaSize * 0.5f), CrowdCount, extent);
+	}
+}
+
+void UBenchmarkSubsystem::FireProjectiles(float DeltaTime) {
+	if (ProjectileClass == nullptr) {
+		return;
+	}
+	UProjectileManagerSubsystem* projectileManager = GetWorld()->GetSubsystem<UProjectileManagerSubsystem>();
+	UProjectilePoolSubsystem* projectilePool = GetWorld()->GetSubsystem<UProjectilePoolSubsystem>();
+
+	const float extent = ArenaSize * 0.5f - 100.0f;
+	projectileBudget += ProjectilesPerSecond * DeltaTime;
+	while (projectileBudget >= 1.0f) {
+		projectileBudget -= 1.0f;
+		FVector location(random.FRandRange(-extent, extent), random.FRandRange(-extent, extent), random.FRandRange(-extent, extent));
+		FRotator rotation = random.GetUnitVector().Rotation();
+		if (bUseProjectileManager && projectileManager != nullptr) {
+			projectileManager->Fire(ProjectileClass, location, rotation);
+		}
+		else if (projectilePool != nullptr) {
+			projectilePool->Acquire(ProjectileClass, location, rotation);
+		}
+	}
+}
+
+void UBenchmarkSubsystem::AdvanceGravity() {
+	gravityStep = (gravityStep + 1) % UE_ARRAY_COUNT(BenchmarkGravitySequence);
+	const FVector& grav = BenchmarkGravitySequence[gravityStep];
+	worldPhysics->SetGravity(grav.X, grav.Y, grav.Z);
+}
+
+void UBenchmarkSubsystem::Record(double frameSeconds) {
+	metrics[FrameTimeMetric].samples.Add(frameSeconds * 1000.0);
+	metrics[GameThreadMetric].samples.Add(FPlatformTime::ToMilliseconds(GGameThreadTime));
+	metrics[PhysicsStepMetric].samples.Add(worldPhysics->GetLastPhysicsStepTime() * 1000.0);
+	metrics[GravityPassMetric].samples.Add(worldPhysics->GetLastPassTime() * 1000.0);
+	bodyCounts.Add(worldPhysics->GetLastPassBodyCount());
+
+	UProjectileManagerSubsystem* projectileManager = GetWorld()->GetSubsystem<UProjectileManagerSubsystem>();
+	UProjectilePoolSubsystem* projectilePool = GetWorld()->GetSubsystem<UProjectilePoolSubsystem>();
+	int32 projectiles = bUseProjectileManager ? (projectileManager != nullptr ? projectileManager->GetLiveCount() : 0) : (projectilePool != nullptr ? projectilePool->GetActiveCount() : 0);
+	projectileCounts.Add(projectiles);
+}
+
+FString UBenchmarkSubsystem::BuildSummaryJson() const {
+	TSharedRef<FJsonObject> summary = MakeShared<FJsonObject>();
+	summary->SetNumberField(TEXT("frames"), metrics[FrameTimeMetric].samples.Num());
+	summary->SetNumberField(TEXT("props"), PropCount);
+	summary->SetBoolField(TEXT("instancedProps"), bUseInstancedProps);
+	summary->SetNumberField(TEXT("enemies"), EnemyCount);
+	summary->SetNumberField(TEXT("crowd"), CrowdCount);
+	summary->SetNumberField(TEXT("projectilesPerSecond"), ProjectilesPerSecond);
+	summary->SetBoolField(TEXT("projectileManager"), bUseProjectileManager);
+	summary->SetStringField(TEXT("gravityMode"), StaticEnum<EGravityMode>()->GetNameStringByValue((int64)worldPhysics->GravityMode));
+
+	TSharedRef<FJsonObject> metricsObject = MakeShared<FJsonObject>();
+	for (const FBenchmarkMetric& metric : metrics) {
+		TSharedRef<FJsonObject> values = MakeShared<FJsonObject>();
+		values->SetNumberField(TEXT("mean"), metric.GetMean());
+		for (int32 i = 0; i < UE_ARRAY_COUNT(BenchmarkPercentiles); i++) {
+			values->SetNumberField(BenchmarkPercentileNames[i], metric.GetPercentile(BenchmarkPercentiles[i]));
+		}
+		values->SetNumberField(TEXT("max"), metric.GetPercentile(1.0f));
+		metricsObject->SetObjectField(metric.name, values);
+	}
+	summary->SetObjectField(TEXT("metrics"), metricsObject);
+
+	FString json;
+	TSharedRef<TJsonWriter<>> writer = TJsonWriterFactory<>::Create(&json);
+	FJsonSerializer::Serialize(summary, writer);
+	return json;
+}
+
+int32 UBenchmarkSubsystem::CompareToBaseline(const FString& baselinePath) const {
+	FString json;
+	if (!FFileHelper::LoadFileToString(json, *baselinePath)) {
+		return INDEX_NONE;
+	}
+	TSharedPtr<FJsonObject> baseline;
+	const TSharedPtr<FJsonObject>* baselineMetrics = nullptr;
+	if (!FJsonSerializer::Deserialize(TJsonReaderFactory<>::Create(json), baseline) || !baseline.IsValid() || !baseline->TryGetObjectField(TEXT("metrics"), baselineMetrics)) {
+		UE_LOG(LogBenchmark, Error, TEXT("Couldn't read the baseline in %s."), *baselinePath);
+		return INDEX_NONE;
+	}
+
+	int32 regressions = 0;
+	for (const FBenchmarkMetric& metric : metrics) {
+		const TSharedPtr<FJsonObject>* values = nullptr;
+		if (!(*baselineMetrics)->TryGetObjectField(metric.name, values)) {
+			continue;
+		}
+		for (int32 i = 0; i < UE_ARRAY_COUNT(BenchmarkPercentiles); i++) {
+			double expected = 0.0;
+			if (!(*values)->TryGetNumberField(BenchmarkPercentileNames[i], expected)) {
+				continue;
+			}
+			float actual = metric.GetPercentile(BenchmarkPercentiles[i]);
+			if (actual > expected * (1.0f + RegressionTolerance) && actual - expected > RegressionFloor) {
+				UE_LOG(LogBenchmark, Error, TEXT("%s %s regressed: %.3fms, baseline %.3fms."), *metric.name, BenchmarkPercentileNames[i], actual, expected);
+				regressions++;
+			}
+		}
+	}
+	return regressions;
+}
+
+int32 UBenchmarkSubsystem::Finish() {
+	const FString directory = FPaths::Combine(FPaths::ProjectDir(), OutputDirectory);
+	const FString name = FString::Printf(TEXT("Benchmark-%s"), *FDateTime::Now().ToString());
+
+	FString csv = TEXT("Frame,FrameTimeMs,GameThreadMs,PhysicsStepMs,GravityPassMs,GravityBodies,Projectiles\n");
+	for (int32 i = 0; i < bodyCounts.Num(); i++) {
+		csv += FString::Printf(TEXT("%d,%.3f,%.3f,%.3f,%.3f,%d,%d\n"), i,
+			metrics[FrameTimeMetric].samples[i], metrics[GameThreadMetric].samples[i], metrics[PhysicsStepMetric].samples[i],
+			metrics[GravityPassMetric].samples[i], bodyCounts[i], projectileCounts[i]);
+	}
+	const FString summary = BuildSummaryJson();
+	const FString csvPath = FPaths::Combine(directory, name + TEXT(".csv"));
+	const FString summaryPath = FPaths::Combine(directory, name + TEXT(".json"));
+	if (!FFileHelper::SaveStringToFile(csv, *csvPath) || !FFileHelper::SaveStringToFile(summary, *summaryPath)) {
+		UE_LOG(LogBenchmark, Error, TEXT("Couldn't write results to %s."), *directory);
+		return BenchmarkFailed;
+	}
+	UE_LOG(LogBenchmark, Log, TEXT("Wrote %d frames to %s."), bodyCounts.Num(), *csvPath);
+	for (const FBenchmarkMetric& metric : metrics) {
+		UE_LOG(LogBenchmark, Log, TEXT("%s: mean %.3fms, p50 %.3fms, p90 %.3fms, p99 %.3fms, max %.3fms"), *metric.name,
+			metric.GetMean(), metric.GetPercentile(0.5f), metric.GetPercentile(0.9f), metric.GetPercentile(0.99f), metric.GetPercentile(1.0f));
+	}
+
+	const FString baselinePath = FPaths::IsRelative(BaselineFile) ? FPaths::Combine(FPaths::ProjectDir(), BaselineFile) : BaselineFile;
+	if (bSaveBaseline) {
+		if (!FFileHelper::SaveStringToFile(summary, *baselinePath)) {
+			UE_LOG(LogBenchmark, Error, TEXT("Couldn't write the baseline to %s."), *baselinePath);
+			return BenchmarkFailed;
+		}
+		UE_LOG(LogBenchmark, Log, TEXT("Saved as the new baseline in %s."), *baselinePath);
+		return BenchmarkPassed;
+	}
+
+	int32 regressions = CompareToBaseline(baselinePath);
+	if (regressions == INDEX_NONE) {
+		UE_LOG(LogBenchmark, Warning, TEXT("No baseline to compare to in %s, run with -BenchmarkSaveBaseline to make one."), *baselinePath);
+		return BenchmarkPassed;
+	}
+	if (regressions > 0) {
+		UE_LOG(LogBenchmark, Error, TEXT("%d timings regressed by more than %.0f%%."), regressions, RegressionTolerance * 100.0f);
+		return BenchmarkRegressed;
+	}
+	UE_LOG(LogBenchmark, Log, TEXT("No regressions against %s."), *baselinePath);
+	return BenchmarkPassed;
+}
+
+ETickableTickType UBenchmarkSubsystem::GetTickableTickType() const {
+	// The CDO should never be ticked.
+	return IsTemplate() ? ETickableTickType::Never : ETickableTickType::Conditional;
+}
+
+bool UBenchmarkSubsystem::IsTickable() const {
+	return phase != EBenchmarkPhase::Finished;
+}
+
+UWorld* UBenchmarkSubsystem::GetTickableGameObjectWorld() const {
+	return GetWorld();
+}
+
+TStatId UBenchmarkSubsystem::GetStatId() const {
+	RETURN_QUICK_DECLARE_CYCLE_STAT(UBenchmarkSubsystem, STATGROUP_Tickables);
+}
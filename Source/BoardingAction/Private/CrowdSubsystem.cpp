@@ -0,0 +1,473 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "CrowdSubsystem.h"
+#include "BoardingAction.h"
+#include "Enemy.h"
+#include "PhysicsSubsystem.h"
+#include "Components/CapsuleComponent.h"
+#include "Components/InstancedStaticMeshComponent.h"
+#include "GameFramework/CharacterMovementComponent.h"
+#include "GameFramework/PlayerController.h"
+#include "Engine/StaticMesh.h"
+#include "Engine/World.h"
+#include "Engine/AssetManager.h"
+#include "Engine/StreamableManager.h"
+#include "Async/ParallelFor.h"
+
+DECLARE_CYCLE_STAT(TEXT("Crowd Simulate"), STAT_CrowdSimulate, STATGROUP_BoardingActionEnemies);
+DECLARE_CYCLE_STAT(TEXT("Crowd Promotion"), STAT_CrowdPromotion, STATGROUP_BoardingActionEnemies);
+DECLARE_CYCLE_STAT(TEXT("Crowd Instance Update"), STAT_CrowdInstances, STATGROUP_BoardingActionEnemies);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Crowd Entities"), STAT_CrowdEntities, STATGROUP_BoardingActionEnemies);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Crowd Promoted"), STAT_CrowdPromoted, STATGROUP_BoardingActionEnemies);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Crowd Promotions"), STAT_CrowdPromotions, STATGROUP_BoardingActionEnemies);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Crowd Demotions"), STAT_CrowdDemotions, STATGROUP_BoardingActionEnemies);
+
+// Entities are simulated in batches of this many on the task graph.
+static const int32 CrowdBatchSize = 128;
+// How quickly a walking entity turns its velocity towards where it wants to go, per second.
+static const float CrowdSteering = 8.0f;
+// Floors steeper than this (as the cosine against the entity's up) don't count as floors. Same as the character's default.
+static const float CrowdWalkableFloor = 0.71f;
+// If an entity's gravity turns by more than this (as a cosine), whatever it was standing on doesn't hold it up any more.
+static const float CrowdGravityFlipThreshold = 0.99f;
+
+// Which way is down for something feeling grav. Zero gravity leaves it with no down at all.
+static FVector GetDown(const FVector& grav) {
+	return grav.GetSafeNormal();
+}
+
+UCrowdSubsystem::UCrowdSubsystem() {
+	EnemyClass = AEnemy::StaticClass();
+	CrowdMesh = FSoftObjectPath(TEXT("/Game/StarterContent/Shapes/Shape_NarrowCapsule.Shape_NarrowCapsule"));
+	MaxEntities = 4096;
+	PromoteDistance = 3000.0f;
+	DemoteDistance = 4000.0f;
+	MaxPromotionsPerFrame = 4;
+	MaxPromoted = 64;
+	WalkSpeed = 300.0f;
+	GroundCheckInterval = 8;
+	StepHeight = 45.0f;
+	GroundProbeDistance = 60.0f;
+	EntityRadius = 34.0f;
+}
+
+void UCrowdSubsystem::Initialize(FSubsystemCollectionBase& Collection) {
+	worldPhysics = Cast<UPhysicsSubsystem>(Collection.InitializeDependency(UPhysicsSubsystem::StaticClass()));
+	queryParams = FCollisionQueryParams(SCENE_QUERY_STAT(Crowd), false);
+
+	// Loading it the first time something's promoted would hitch right as a player gets close. The asset manager has
+	// usually already loaded it along with the map, in which case this is done straight away.
+	enemyClass = EnemyClass.Get();
+	if (enemyClass == nullptr && !EnemyClass.IsNull()) {
+		enemyClassHandle = UAssetManager::GetStreamableManager().RequestAsyncLoad(EnemyClass.ToSoftObjectPath(), FStreamableDelegate::CreateUObject(this, &UCrowdSubsystem::OnEnemyClassLoaded));
+	}
+}
+
+void UCrowdSubsystem::OnEnemyClassLoaded() {
+	enemyClass = EnemyClass.Get();
+	enemyClassHandle.Reset();
+}
+
+void UCrowdSubsystem::Deinitialize() {
+	positions.Empty();
+	velocities.Empty();
+	gravities.Empty();
+	states.Empty();
+	animationTimes.Empty();
+	traces.Empty();
+	wallTraces.Empty();
+	actors.Empty();
+	promotedCount = 0;
+	if (enemyClassHandle.IsValid()) {
+		enemyClassHandle->CancelHandle();
+		enemyClassHandle.Reset();
+	}
+	enemyClass = nullptr;
+	renderActor = nullptr;
+	instances = nullptr;
+	drawnCount = 0;
+	worldPhysics = nullptr;
+}
+
+bool UCrowdSubsystem::AddEntity(const FVector& location) {
+	if (positions.Num() >= MaxEntities) {
+		return false;
+	}
+
+	// A dedicated server has nothing to draw them with.
+	if (renderActor == nullptr && GetWorld()->GetNetMode() != NM_DedicatedServer) {
+		FActorSpawnParameters params;
+		params.ObjectFlags |= RF_Transient;
+		renderActor = GetWorld()->SpawnActor<AActor>(params);
+		instances = NewObject<UInstancedStaticMeshComponent>(renderActor);
+		instances->SetStaticMesh(Cast<UStaticMesh>(CrowdMesh.TryLoad()));
+		instances->NumCustomDataFloats = 2;
+		instances->SetCollisionEnabled(ECollisionEnabled::NoCollision);
+		instances->SetCanEverAffectNavigation(false);
+		renderActor->SetRootComponent(instances);
+		instances->RegisterComponent();
+	}
+
+	positions.Add(location);
+	velocities.Add(FVector::ZeroVector);
+	gravities.Add(worldPhysics->GetGravityAt(location));
+	// It'll find out whether there's actually a floor under it on its first ground check.
+	states.Add(ECrowdEntityState::Grounded);
+	animationTimes.Add(FMath::FRand());
+	traces.Add(FTraceHandle());
+	wallTraces.Add(FTraceHandle());
+	actors.Add(nullptr);
+	return true;
+}
+
+int32 UCrowdSubsystem::AddEntities(const FVector& location, int32 count, float radius) {
+	const FVector down = GetDown(worldPhysics->GetGravityAt(location));
+	const FQuat orientation = FQuat::FindBetweenNormals(FVector::DownVector, down.IsZero() ? FVector::DownVector : down);
+	int32 added = 0;
+	for (int32 i = 0; i < count; i++) {
+		// Uniform over the disc, then turned so the disc lies on the floor.
+		float angle = FMath::FRand() * 2.0f * PI;
+		float distance = radius * FMath::Sqrt(FMath::FRand());
+		if (!AddEntity(location + orientation.RotateVector(FVector{FMath::Cos(angle) * distance, FMath::Sin(angle) * distance, 0.0f}))) {
+			break;
+		}
+		added++;
+	}
+	return added;
+}
+
+void UCrowdSubsystem::RemoveAtSwap(int32 index) {
+	// Not the actor, since GC will have nulled it out if the enemy was destroyed.
+	if (states[index] == ECrowdEntityState::Promoted) {
+		promotedCount--;
+	}
+	positions.RemoveAtSwap(index, 1, false);
+	velocities.RemoveAtSwap(index, 1, false);
+	gravities.RemoveAtSwap(index, 1, false);
+	states.RemoveAtSwap(index, 1, false);
+	animationTimes.RemoveAtSwap(index, 1, false);
+	traces.RemoveAtSwap(index, 1, false);
+	wallTraces.RemoveAtSwap(index, 1, false);
+	actors.RemoveAtSwap(index, 1, false);
+}
+
+void UCrowdSubsystem::Tick(float DeltaTime) {
+	frame++;
+
+	playerLocations.Reset();
+	for (FConstPlayerControllerIterator it = GetWorld()->GetPlayerControllerIterator(); it; ++it) {
+		if (APawn* pawn = it->IsValid() ? (*it)->GetPawn() : nullptr) {
+			playerLocations.Add(pawn->GetActorLocation());
+		}
+	}
+
+	ResolveTraces();
+	UpdatePromotions();
+	Simulate(DeltaTime);
+	QueueTraces(DeltaTime);
+	UpdateInstances();
+
+	SET_DWORD_STAT(STAT_CrowdEntities, positions.Num());
+	SET_DWORD_STAT(STAT_CrowdPromoted, promotedCount);
+}
+
+void UCrowdSubsystem::ResolveTraces() {
+	UWorld* world = GetWorld();
+	FTraceDatum datum;
+	for (int32 i = 0; i < positions.Num(); i++) {
+		// Walls first, so a floor found this frame is found from where the entity ends up.
+		if (wallTraces[i].IsValid() && world->QueryTraceData(wallTraces[i], datum)) {
+			wallTraces[i] = FTraceHandle();
+			const FHitResult* hit = datum.OutHits.FindByPredicate([](const FHitResult& result) { return result.bBlockingHit; });
+			if (hit != nullptr && states[i] != ECrowdEntityState::Promoted) {
+				HitWall(i, *hit);
+			}
+		}
+
+		if (!traces[i].IsValid() || !world->QueryTraceData(traces[i], datum)) {
+			continue;
+		}
+		traces[i] = FTraceHandle();
+		if (states[i] == ECrowdEntityState::Promoted) {
+			continue;
+		}
+
+		const FVector down = GetDown(gravities[i]);
+		const FHitResult* hit = datum.OutHits.FindByPredicate([](const FHitResult& result) { return result.bBlockingHit; });
+		const bool bFloor = hit != nullptr && !down.IsZero() && FVector::DotProduct(hit->ImpactNormal, -down) >= CrowdWalkableFloor;
+
+		if (states[i] == ECrowdEntityState::Grounded) {
+			if (bFloor) {
+				// Only snap along gravity, so whatever walking it's done since the trace is kept.
+				positions[i] += down * FVector::DotProduct(hit->ImpactPoint - positions[i], down);
+			}
+			else {
+				states[i] = ECrowdEntityState::Falling;
+			}
+		}
+		else if (bFloor) {
+			// It's fallen a frame further since then, so put it back on the floor it hit.
+			states[i] = ECrowdEntityState::Grounded;
+			positions[i] = hit->ImpactPoint;
+			velocities[i] -= down * FVector::DotProduct(velocities[i], down);
+		}
+		else if (hit != nullptr) {
+			// Fell into a wall, or something too steep to stand on.
+			HitWall(i, *hit);
+		}
+	}
+}
+
+void UCrowdSubsystem::HitWall(int32 index, const FHitResult& hit) {
+	const FVector down = GetDown(gravities[index]);
+	// Anything it could stand on is left to the floor checks, which step it up onto it.
+	if (!down.IsZero() && FVector::DotProduct(hit.ImpactNormal, -down) >= CrowdWalkableFloor) {
+		return;
+	}
+	// Only the part of the wall that faces across gravity matters, so a leaning wall doesn't lift it off the floor.
+	FVector normal = hit.ImpactNormal - down * FVector::DotProduct(hit.ImpactNormal, down);
+	if (!normal.Normalize()) {
+		return;
+	}
+	// The trace was sent last frame, so it may have got closer (or through) since. Put it back on this side.
+	const float distance = FVector::DotProduct(positions[index] - hit.ImpactPoint, normal);
+	if (distance < EntityRadius) {
+		positions[index] += normal * (EntityRadius - distance);
+	}
+	// Slide along the wall rather than into it.
+	const float into = FVector::DotProduct(velocities[index], normal);
+	if (into < 0.0f) {
+		velocities[index] -= normal * into;
+	}
+}
+
+void UCrowdSubsystem::Simulate(float DeltaTime) {
+	SCOPE_CYCLE_COUNTER(STAT_CrowdSimulate);
+
+	const int32 count = positions.Num();
+	stepGravity.SetNumUninitialized(count, false);
+	worldPhysics->GetGravityAtLocations(positions, stepGravity);
+
+	const float steering = FMath::Min(1.0f, CrowdSteering * DeltaTime);
+	const float reciprocalWalkSpeed = WalkSpeed > 0.0f ? 1.0f / WalkSpeed : 0.0f;
+	ParallelFor(FMath::DivideAndRoundUp(count, CrowdBatchSize), [&](int32 batch) {
+		const int32 end = FMath::Min((batch + 1) * CrowdBatchSize, count);
+		for (int32 i = batch * CrowdBatchSize; i < end; i++) {
+			if (states[i] == ECrowdEntityState::Promoted) {
+				continue;
+			}
+
+			const FVector grav = stepGravity[i];
+			const FVector down = GetDown(grav);
+			// The floor it was on isn't underneath it any more once gravity turns.
+			if (states[i] == ECrowdEntityState::Grounded && FVector::DotProduct(down, GetDown(gravities[i])) < CrowdGravityFlipThreshold) {
+				states[i] = ECrowdEntityState::Falling;
+			}
+			gravities[i] = grav;
+
+			FVector position = positions[i];
+			FVector velocity = velocities[i];
+			if (states[i] == ECrowdEntityState::Grounded) {
+				FVector goal = position;
+				float best = MAX_FLT;
+				for (const FVector& player : playerLocations) {
+					float distanceSquared = FVector::DistSquared(player, position);
+					if (distanceSquared < best) {
+						best = distanceSquared;
+						goal = player;
+					}
+				}
+				// Walk along the floor, so only the part of the way there that's perpendicular to gravity counts.
+				FVector toGoal = goal - position;
+				toGoal -= down * FVector::DotProduct(toGoal, down);
+				velocity += (toGoal.GetSafeNormal() * WalkSpeed - velocity) * steering;
+				animationTimes[i] += DeltaTime * velocity.Size() * reciprocalWalkSpeed;
+			}
+			else {
+				velocity += worldPhysics->GravityToAcceleration(grav) * DeltaTime;
+				animationTimes[i] += DeltaTime;
+			}
+			positions[i] = position + velocity * DeltaTime;
+			velocities[i] = velocity;
+		}
+	}, count < CrowdBatchSize * 2);
+}
+
+void UCrowdSubsystem::QueueTraces(float DeltaTime) {
+	UWorld* world = GetWorld();
+	FCollisionObjectQueryParams floors;
+	floors.AddObjectTypesToQuery(ECC_WorldStatic);
+	floors.AddObjectTypesToQuery(ECC_WorldDynamic);
+
+	for (int32 i = 0; i < positions.Num(); i++) {
+		const FVector down = GetDown(gravities[i]);
+		if (states[i] == ECrowdEntityState::Promoted || down.IsZero()) {
+			continue;
+		}
+		if (states[i] == ECrowdEntityState::Falling) {
+			// The distance it's just covered, plus a step further down so it can't slip through a thin floor.
+			traces[i] = world->AsyncLineTraceByObjectType(EAsyncTraceType::Single, positions[i] - velocities[i] * DeltaTime, positions[i] + down * StepHeight, floors, queryParams);
+			continue;
+		}
+
+		// Look ahead along the walk, from above step height so steps don't count as walls. Far enough for this step
+		// and the next, since the answer only comes back next frame.
+		const FVector walk = velocities[i] - down * FVector::DotProduct(velocities[i], down);
+		if (!walk.IsNearlyZero()) {
+			const FVector start = positions[i] - down * StepHeight;
+			wallTraces[i] = world->AsyncLineTraceByObjectType(EAsyncTraceType::Single, start, start + walk * (2.0f * DeltaTime) + walk.GetSafeNormal() * EntityRadius, floors, queryParams);
+		}
+		// Offset by the index so the ground checks are spread over the interval.
+		if ((frame + i) % FMath::Max(GroundCheckInterval, 1) == 0) {
+			traces[i] = world->AsyncLineTraceByObjectType(EAsyncTraceType::Single, positions[i] - down * StepHeight, positions[i] + down * GroundProbeDistance, floors, queryParams);
+		}
+	}
+}
+
+void UCrowdSubsystem::UpdatePromotions() {
+	SCOPE_CYCLE_COUNTER(STAT_CrowdPromotion);
+
+	auto distanceToPlayers = [this](const FVector& location) {
+		float best = MAX_FLT;
+		for (const FVector& player : playerLocations) {
+			best = FMath::Min(best, FVector::DistSquared(player, location));
+		}
+		return best;
+	};
+
+	int32 promotions = 0;
+	// Failed spawns count against the budget too, since trying still costs a collision check.
+	int32 attempts = 0;
+	const float promoteSquared = FMath::Square(PromoteDistance);
+	const float demoteSquared = FMath::Square(FMath::Max(DemoteDistance, PromoteDistance));
+	// Backwards, since an enemy that's been killed takes its entity with it.
+	for (int32 i = positions.Num() - 1; i >= 0; i--) {
+		if (states[i] == ECrowdEntityState::Promoted) {
+			AEnemy* enemy = actors[i];
+			if (!IsValid(enemy)) {
+				RemoveAtSwap(i);
+			}
+			else if (distanceToPlayers(enemy->GetActorLocation()) > demoteSquared) {
+				Demote(i);
+			}
+		}
+		else if (enemyClass != nullptr && attempts < MaxPromotionsPerFrame && promotedCount < MaxPromoted && distanceToPlayers(positions[i]) < promoteSquared) {
+			attempts++;
+			if (Promote(i)) {
+				promotions++;
+			}
+		}
+	}
+	INC_DWORD_STAT_BY(STAT_CrowdPromotions, promotions);
+}
+
+bool UCrowdSubsystem::Promote(int32 index) {
+	if (enemyHalfHeight <= 0.0f) {
+		enemyHalfHeight = enemyClass->GetDefaultObject<AEnemy>()->GetCapsuleComponent()->GetScaledCapsuleHalfHeight();
+	}
+
+	const FVector down = GetDown(gravities[index]);
+	const FVector up = down.IsZero() ? FVector::UpVector : -down;
+	FVector facing = velocities[index] - up * FVector::DotProduct(velocities[index], up);
+	const FQuat rotation = facing.IsNearlyZero() ? FRotationMatrix::MakeFromZ(up).ToQuat() : FRotationMatrix::MakeFromZX(up, facing).ToQuat();
+
+	FActorSpawnParameters params;
+	// An entity squeezed somewhere a character doesn't fit stays in the crowd and tries again later, rather than
+	// having its enemy pushed into (or through) the geometry.
+	params.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AdjustIfPossibleButDontSpawnIfColliding;
+	AEnemy* enemy = GetWorld()->SpawnActor<AEnemy>(enemyClass, FTransform(rotation, positions[index] + up * enemyHalfHeight), params);
+	if (enemy == nullptr) {
+		return false;
+	}
+
+	if (UCharacterMovementComponent* movement = enemy->GetCharacterMovement()) {
+		movement->Velocity = velocities[index];
+		if (states[index] == ECrowdEntityState::Falling) {
+			movement->SetMovementMode(MOVE_Falling);
+		}
+	}
+	states[index] = ECrowdEntityState::Promoted;
+	actors[index] = enemy;
+	traces[index] = FTraceHandle();
+	wallTraces[index] = FTraceHandle();
+	promotedCount++;
+	return true;
+}
+
+void UCrowdSubsystem::Demote(int32 index) {
+	AEnemy* enemy = actors[index];
+	const FVector location = enemy->GetActorLocation();
+	const FVector grav = worldPhysics->GetGravityAt(location);
+	const FVector down = GetDown(grav);
+	const UCharacterMovementComponent* movement = enemy->GetCharacterMovement();
+
+	positions[index] = location + down * (down.IsZero() ? 0.0f : enemy->GetCapsuleComponent()->GetScaledCapsuleHalfHeight());
+	velocities[index] = enemy->GetVelocity();
+	gravities[index] = grav;
+	states[index] = movement != nullptr && movement->IsFalling() ? ECrowdEntityState::Falling : ECrowdEntityState::Grounded;
+	actors[index] = nullptr;
+	promotedCount--;
+	enemy->Destroy();
+	INC_DWORD_STAT(STAT_CrowdDemotions);
+}
+
+void UCrowdSubsystem::UpdateInstances() {
+	SCOPE_CYCLE_COUNTER(STAT_CrowdInstances);
+
+	if (instances == nullptr) {
+		return;
+	}
+
+	// Instances are never removed, just shrunk out of sight, so the mesh doesn't have to shuffle its instance data around.
+	const int32 count = positions.Num();
+	const int32 instanceCount = FMath::Max(count, instances->GetInstanceCount());
+	instanceTransforms.SetNumUninitialized(instanceCount, false);
+	ParallelFor(FMath::DivideAndRoundUp(instanceCount, CrowdBatchSize), [&](int32 batch) {
+		const int32 end = FMath::Min((batch + 1) * CrowdBatchSize, instanceCount);
+		for (int32 i = batch * CrowdBatchSize; i < end; i++) {
+			if (i >= count || states[i] == ECrowdEntityState::Promoted) {
+				instanceTransforms[i] = FTransform(FQuat::Identity, FVector::ZeroVector, FVector::ZeroVector);
+				continue;
+			}
+			const FVector down = GetDown(gravities[i]);
+			const FVector up = down.IsZero() ? FVector::UpVector : -down;
+			const FVector facing = velocities[i] - up * FVector::DotProduct(velocities[i], up);
+			const FMatrix rotation = facing.IsNearlyZero() ? FRotationMatrix::MakeFromZ(up) : FRotationMatrix::MakeFromZX(up, facing);
+			instanceTransforms[i] = FTransform(rotation.ToQuat(), positions[i]);
+		}
+	}, instanceCount < CrowdBatchSize * 2);
+
+	for (int32 i = instances->GetInstanceCount(); i < instanceCount; i++) {
+		instances->AddInstanceWorldSpace(instanceTransforms[i]);
+	}
+	// Custom data goes in first without dirtying anything, since the transform update dirties the render state anyway.
+	for (int32 i = 0; i < count; i++) {
+		if (states[i] != ECrowdEntityState::Promoted) {
+			instances->SetCustomDataValue(i, 0, animationTimes[i], false);
+			instances->SetCustomDataValue(i, 1, velocities[i].Size(), false);
+		}
+	}
+	if (instanceCount > 0) {
+		instances->BatchUpdateInstancesTransforms(0, instanceTransforms, true, true, true);
+	}
+	drawnCount = count;
+}
+
+ETickableTickType UCrowdSubsystem::GetTickableTickType() const {
+	// The CDO should never be ticked.
+	return IsTemplate() ? ETickableTickType::Never : ETickableTickType::Conditional;
+}
+
+bool UCrowdSubsystem::IsTickable() const {
+	// Keep going for one more tick after the last entity is gone, so its instance gets hidden.
+	return positions.Num() > 0 || drawnCount > 0;
+}
+
+UWorld* UCrowdSubsystem::GetTickableGameObjectWorld() const {
+	return GetWorld();
+}
+
+TStatId UCrowdSubsystem::GetStatId() const {
+	RETURN_QUICK_DECLARE_CYCLE_STAT(UCrowdSubsystem, STATGROUP_Tickables);
+}
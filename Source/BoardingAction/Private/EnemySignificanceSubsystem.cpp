@@ -0,0 +1,171 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "EnemySignificanceSubsystem.h"
+#include "BoardingAction.h"
+#include "Enemy.h"
+#include "GameFramework/PlayerController.h"
+#include "Engine/World.h"
+
+DECLARE_CYCLE_STAT(TEXT("Enemy Significance"), STAT_EnemySignificance, STATGROUP_BoardingActionEnemies);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Enemies Tier 0"), STAT_EnemiesTier0, STATGROUP_BoardingActionEnemies);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Enemies Tier 1"), STAT_EnemiesTier1, STATGROUP_BoardingActionEnemies);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Enemies Tier 2"), STAT_EnemiesTier2, STATGROUP_BoardingActionEnemies);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Enemies Tier 3+"), STAT_EnemiesTier3, STATGROUP_BoardingActionEnemies);
+
+// How recently an enemy has to have been on screen to count as seen.
+static const float RecentlyRenderedTolerance = 0.25f;
+
+static FEnemySignificanceTier MakeTier(float maxDistance, int32 maxCount, float actorInterval, float movementInterval, float animationInterval, int32 gravityInterval, bool bTickPoseWhenHidden) {
+	FEnemySignificanceTier tier;
+	tier.MaxDistance = maxDistance;
+	tier.MaxCount = maxCount;
+	tier.ActorTickInterval = actorInterval;
+	tier.MovementTickInterval = movementInterval;
+	tier.AnimationTickInterval = animationInterval;
+	tier.GravityUpdateInterval = gravityInterval;
+	tier.bTickPoseWhenHidden = bTickPoseWhenHidden;
+	return tier;
+}
+
+UEnemySignificanceSubsystem::UEnemySignificanceSubsystem() {
+	Tiers.Add(MakeTier(2500.0f, 16, 0.0f, 0.0f, 0.0f, 1, true));
+	Tiers.Add(MakeTier(6000.0f, 48, 0.066f, 0.033f, 0.066f, 2, true));
+	Tiers.Add(MakeTier(15000.0f, 0, 0.2f, 0.1f, 0.25f, 4, false));
+	Tiers.Add(MakeTier(BIG_NUMBER, 0, 1.0f, 0.25f, 1.0f, 8, false));
+	UpdateInterval = 0.25f;
+	HiddenDistanceScale = 2.0f;
+	Hysteresis = 0.1f;
+}
+
+void UEnemySignificanceSubsystem::Deinitialize() {
+	enemies.Empty();
+	enemyTiers.Empty();
+	enemyScores.Empty();
+	tierCounts.Empty();
+}
+
+void UEnemySignificanceSubsystem::RegisterEnemy(AEnemy* enemy) {
+	if (enemy == nullptr || enemies.Contains(enemy) || Tiers.Num() == 0) {
+		return;
+	}
+	enemies.Add(enemy);
+	// Everything starts out fully significant, and gets turned down on the next ranking if it can be.
+	enemyTiers.Add(0);
+	enemyScores.Add(0.0f);
+	enemy->ApplySignificanceTier(Tiers[0]);
+	// Rank soon, so a whole wave spawning in doesn't spend long ticking at full rate.
+	timeSinceRank = FMath::Max(timeSinceRank, UpdateInterval * 0.5f);
+}
+
+void UEnemySignificanceSubsystem::UnregisterEnemy(AEnemy* enemy) {
+	int32 index = enemies.Find(enemy);
+	if (index != INDEX_NONE) {
+		enemies.RemoveAtSwap(index, 1, false);
+		enemyTiers.RemoveAtSwap(index, 1, false);
+		enemyScores.RemoveAtSwap(index, 1, false);
+	}
+}
+
+void UEnemySignificanceSubsystem::Tick(float DeltaTime) {
+	timeSinceRank += DeltaTime;
+	if (timeSinceRank >= UpdateInterval) {
+		timeSinceRank = 0.0f;
+		Rank();
+	}
+}
+
+int32 UEnemySignificanceSubsystem::GetTierForDistance(float distance, int32 currentTier) const {
+	int32 tier = FMath::Min(currentTier, Tiers.Num() - 1);
+	while (tier < Tiers.Num() - 1 && distance > Tiers[tier].MaxDistance * (1.0f + Hysteresis)) {
+		tier++;
+	}
+	while (tier > 0 && distance < Tiers[tier - 1].MaxDistance * (1.0f - Hysteresis)) {
+		tier--;
+	}
+	return tier;
+}
+
+void UEnemySignificanceSubsystem::Rank() {
+	SCOPE_CYCLE_COUNTER(STAT_EnemySignificance);
+
+	if (Tiers.Num() == 0) {
+		return;
+	}
+
+	TArray<FVector, TInlineAllocator<4>> viewpoints;
+	for (FConstPlayerControllerIterator it = GetWorld()->GetPlayerControllerIterator(); it; ++it) {
+		if (APlayerController* controller = it->Get()) {
+			FVector location;
+			FRotator rotation;
+			controller->GetPlayerViewPoint(location, rotation);
+			viewpoints.Add(location);
+		}
+	}
+
+	rankOrder.Reset(enemies.Num());
+	for (int32 i = 0; i < enemies.Num(); i++) {
+		AEnemy* enemy = enemies[i];
+		if (!IsValid(enemy)) {
+			continue;
+		}
+		FVector location = enemy->GetActorLocation();
+		float distanceSquared = viewpoints.Num() > 0 ? MAX_FLT : 0.0f;
+		for (const FVector& viewpoint : viewpoints) {
+			distanceSquared = FMath::Min(distanceSquared, FVector::DistSquared(viewpoint, location));
+		}
+		float score = FMath::Sqrt(distanceSquared);
+		if (!enemy->WasRecentlyRendered(RecentlyRenderedTolerance)) {
+			score *= HiddenDistanceScale;
+		}
+		enemyScores[i] = score;
+		rankOrder.Add(i);
+	}
+	rankOrder.Sort([this](int32 a, int32 b) { return enemyScores[a] < enemyScores[b]; });
+
+	tierCounts.Reset();
+	tierCounts.SetNumZeroed(Tiers.Num());
+	for (int32 index : rankOrder) {
+		const int32 current = enemyTiers[index];
+		int32 tier = GetTierForDistance(enemyScores[index], current);
+		// Closest first, so whoever overflows a full tier is the furthest away.
+		while (tier < Tiers.Num() - 1 && Tiers[tier].MaxCount > 0 && tierCounts[tier] >= Tiers[tier].MaxCount) {
+			tier++;
+		}
+		// Stepping down one tier at a time keeps an enemy from going straight from full rate to barely updating.
+		// Stepping up happens right away, since that's someone coming closer.
+		tier = FMath::Min(tier, current + 1);
+		tierCounts[tier]++;
+
+		if (tier != current) {
+			enemyTiers[index] = tier;
+			enemies[index]->ApplySignificanceTier(Tiers[tier]);
+		}
+	}
+
+	SET_DWORD_STAT(STAT_EnemiesTier0, GetTierCount(0));
+	SET_DWORD_STAT(STAT_EnemiesTier1, GetTierCount(1));
+	SET_DWORD_STAT(STAT_EnemiesTier2, GetTierCount(2));
+	int32 rest = 0;
+	for (int32 tier = 3; tier < tierCounts.Num(); tier++) {
+		rest += tierCounts[tier];
+	}
+	SET_DWORD_STAT(STAT_EnemiesTier3, rest);
+}
+
+ETickableTickType UEnemySignificanceSubsystem::GetTickableTickType() const {
+	// The CDO should never be ticked.
+	return IsTemplate() ? ETickableTickType::Never : ETickableTickType::Conditional;
+}
+
+bool UEnemySignificanceSubsystem::IsTickable() const {
+	return enemies.Num() > 0;
+}
+
+UWorld* UEnemySignificanceSubsystem::GetTickableGameObjectWorld() const {
+	return GetWorld();
+}
+
+TStatId UEnemySignificanceSubsystem::GetStatId() const {
+	RETURN_QUICK_DECLARE_CYCLE_STAT(UEnemySignificanceSubsystem, STATGROUP_Tickables);
+}
@@ -2,15 +2,17 @@
 
 
 #include "GravityController.h"
+#include "PhysicsLODSubsystem.h"
 
 // Sets default values for this component's properties
 UGravityController::UGravityController()
 {
-	// Set this component to be initialized when the game starts, and to be ticked every frame.  You can turn these features
-	// off to improve performance if you don't need them.
-	PrimaryComponentTick.bCanEverTick = true;
+	// Gravity is applied by the UPhysicsSubsystem's batched pass, so there's no need for a tick of our own.
+	PrimaryComponentTick.bCanEverTick = false;
 
-	// ...
+	GravityScale = 1.0f;
+	bUseSolverGravity = true;
+	bAllowPhysicsLOD = true;
 }
 
 
@@ -21,19 +23,35 @@ void UGravityController::BeginPlay()
 	parent = GetOwner();
 	UWorld* world = GetWorld();
 	worldPhysics = world->GetSubsystem<UPhysicsSubsystem>();
+	physicsLOD = bAllowPhysicsLOD ? world->GetSubsystem<UPhysicsLODSubsystem>() : nullptr;
 	mesh = parent->FindComponentByClass<UPrimitiveComponent>();
 
-	// ...
-	
+	RegisterWithSubsystem();
 }
 
 
-// Called every frame
-void UGravityController::TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction)
+void UGravityController::EndPlay(const EEndPlayReason::Type EndPlayReason)
 {
-	Super::TickComponent(DeltaTime, TickType, ThisTickFunction);
-	mesh->AddImpulse(worldPhysics->GetGravity(), NAME_None, true);
+	UnregisterFromSubsystem();
+	Super::EndPlay(EndPlayReason);
+}
+
+void UGravityController::RegisterWithSubsystem() {
+	if (worldPhysics != nullptr) {
+		worldPhysics->RegisterBody(mesh, GravityScale, bUseSolverGravity);
+	}
+	if (physicsLOD != nullptr) {
+		physicsLOD->RegisterBody(mesh, GravityScale, bUseSolverGravity);
+	}
+}
 
-	// ...
+void UGravityController::UnregisterFromSubsystem() {
+	// First, since a ballistic body gets registered with worldPhysics again on the way out.
+	if (physicsLOD != nullptr) {
+		physicsLOD->UnregisterBody(mesh);
+	}
+	if (worldPhysics != nullptr) {
+		worldPhysics->UnregisterBody(mesh);
+	}
 }
 
@@ -0,0 +1,42 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "GravityFieldComponent.h"
+#include "PhysicsSubsystem.h"
+
+UGravityFieldComponent::UGravityFieldComponent()
+{
+	PrimaryComponentTick.bCanEverTick = false;
+
+	Shape = EGravityFieldShape::Directional;
+	Extent = FVector{500, 500, 500};
+	Strength = 9.8f;
+	Direction = FVector::DownVector;
+	Priority = 0;
+}
+
+void UGravityFieldComponent::BeginPlay()
+{
+	Super::BeginPlay();
+	worldPhysics = GetWorld()->GetSubsystem<UPhysicsSubsystem>();
+	if (worldPhysics != nullptr) {
+		worldPhysics->RegisterField(this);
+	}
+}
+
+void UGravityFieldComponent::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	if (worldPhysics != nullptr) {
+		worldPhysics->UnregisterField(this);
+	}
+	Super::EndPlay(EndPlayReason);
+}
+
+void UGravityFieldComponent::OnUpdateTransform(EUpdateTransformFlags UpdateTransformFlags, ETeleportType Teleport)
+{
+	Super::OnUpdateTransform(UpdateTransformFlags, Teleport);
+	// The subsystem keeps a snapshot of where we are in its grid, so it needs to rebuild that.
+	if (worldPhysics != nullptr) {
+		worldPhysics->MarkFieldsDirty();
+	}
+}
@@ -0,0 +1,840 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "GravityMovementComponent.h"
+#include "BoardingAction.h"
+#include "Components/CapsuleComponent.h"
+#include "GameFramework/Character.h"
+#include "GameFramework/PhysicsVolume.h"
+#include "Engine/World.h"
+
+// Same as the engine's limit on how steep the side of a step can be for us to step up it when there's nothing to stand on.
+static const float MaxStepSideUp = 0.08f;
+// A surface is a vertical wall if its normal is within this of perpendicular to gravity. Same as the base class.
+static const float VerticalSlopeNormal = 0.001f;
+
+UGravityMovementComponent::UGravityMovementComponent()
+{
+	GravityRotationRate = 1.0f;
+	GravityTransitionAngle = 5.0f;
+	gravity = FVector{0, 0, -9.8f};
+	gravityDirection = FVector::DownVector;
+	transitionDirection = FVector::DownVector;
+	rotGravityPercent = 1;
+}
+
+void UGravityMovementComponent::BeginPlay()
+{
+	Super::BeginPlay();
+
+	rotGravity = UpdatedComponent != nullptr ? UpdatedComponent->GetComponentQuat() : FQuat::Identity;
+	oldRotation = rotGravity;
+
+	worldPhysics = GetWorld()->GetSubsystem<UPhysicsSubsystem>();
+	if (worldPhysics != nullptr) {
+		gravityAcceleration = worldPhysics->GravityToAcceleration(gravity);
+		// We apply gravity ourselves, so we only want to hear about it changing.
+		worldPhysics->RegisterMover(this, FOnLocalGravityChanged::CreateUObject(this, &UGravityMovementComponent::OnLocalGravityChanged), false);
+		worldPhysics->OnGravityChanged.AddUObject(this, &UGravityMovementComponent::OnGravityChanged);
+		SetGravity(worldPhysics->GetGravityAt(GetActorLocation()));
+	}
+}
+
+void UGravityMovementComponent::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	if (worldPhysics != nullptr) {
+		worldPhysics->UnregisterMover(this);
+		worldPhysics->OnGravityChanged.RemoveAll(this);
+	}
+	Super::EndPlay(EndPlayReason);
+}
+
+void UGravityMovementComponent::OnGravityChanged(const FVector& oldGravity, const FVector& newGravity) {
+	// We might be inside a gravity field that the global change doesn't reach, so ask for the gravity where we actually are.
+	// The change might also have happened a while ago on the server, in which case we're already partway through turning.
+	SetGravity(worldPhysics->GetGravityAt(GetActorLocation()), GetWorld()->GetTimeSeconds() - worldPhysics->GetGravityChangeTime());
+}
+
+void UGravityMovementComponent::OnLocalGravityChanged(const FVector& oldGravity, const FVector& newGravity) {
+	SetGravity(newGravity);
+}
+
+void UGravityMovementComponent::SetGravity(const FVector& newGravity, float age) {
+	if (gravity == newGravity) {
+		return;
+	}
+	TRACE_CPUPROFILER_EVENT_SCOPE(UGravityMovementComponent::SetGravity);
+	// With no gravity there's no down, so keep using the last one for floors.
+	const bool bWasZero = gravity.IsNearlyZero();
+	const bool bIsZero = newGravity.IsNearlyZero();
+	const FVector newDirection = bIsZero ? gravityDirection : newGravity.GetSafeNormal();
+	// Only turning on or off, or a big enough change of direction, is worth turning the capsule for. Anything smaller
+	// just changes how hard (and which way, for falling and floors) we're pulled.
+	const bool bTurn = bWasZero != bIsZero || FVector::DotProduct(newDirection, transitionDirection) < FMath::Cos(FMath::DegreesToRadians(GravityTransitionAngle));
+
+	gravity = newGravity;
+	gravityAcceleration = worldPhysics->GravityToAcceleration(newGravity);
+	gravityDirection = newDirection;
+
+	if (!bTurn || UpdatedComponent == nullptr) {
+		return;
+	}
+	transitionDirection = newDirection;
+
+	// Stuff for following the 180 degree rule. Not that we need it right now, because everything is actually working.
+	// I might add this later if I feel that the current gradual rotations are too jarring.
+	// Even simpler solution for following the 180 degree rule than this. If the DotProduct of the vector representing
+	// where the player is going to be rotated and the player's forward vector is < 0, multiply the vector by -actorForwardVector.
+	/*FVector plane = FVector::CrossProduct(worldPhysics->GetGravity(), GetActorRightVector());
+	plane.Normalize();
+	if (FVector::DotProduct(plane, lookRot) < 0) {
+		lookRot *= -plane;
+	}*/
+
+	rotGravity = worldPhysics->GetOrientationFromGravity(newGravity);
+	oldRotation = UpdatedComponent->GetComponentQuat();
+	//The transition should be gradual, so we increment in terms of the percentage of the rotation.
+	// Kept short of 1 so that PhysicsRotation still gets to finish it off.
+	rotGravityPercent = FMath::Clamp(age * GravityRotationRate, 0.0f, 1.0f - KINDA_SMALL_NUMBER);
+
+	// The floor we were standing on might be a wall now. If it's still walkable we stay on it, and just look for it
+	// along the new gravity next time.
+	if (IsMovingOnGround()) {
+		bForceNextFloorCheck = true;
+		if (!CurrentFloor.IsWalkableFloor() || !IsWalkable(CurrentFloor.HitResult)) {
+			SetMovementMode(MOVE_Falling);
+		}
+	}
+}
+
+bool UGravityMovementComponent::IsDefaultGravityDirection() const {
+	return gravityDirection.Equals(FVector::DownVector);
+}
+
+float UGravityMovementComponent::GetGravityScaleFactor() const {
+	// The base class takes its gravity from the physics volume, which is the world's unless the volume overrides it,
+	// then scales it by GravityScale. Ours comes from UPhysicsSubsystem, so only how the volume differs from the world
+	// carries over.
+	float volumeScale = 1.0f;
+	const float worldGravityZ = GetWorld() != nullptr ? GetWorld()->GetDefaultGravityZ() : 0.0f;
+	if (worldGravityZ != 0.0f) {
+		volumeScale = GetPhysicsVolume()->GetGravityZ() / worldGravityZ;
+	}
+	return GravityScale * volumeScale;
+}
+
+float UGravityMovementComponent::GetGravityZ() const {
+	// In our own frame, gravity always points down. Anything that only cares about how strong it is (like jump height) still works.
+	return -gravityAcceleration.Size() * GetGravityScaleFactor();
+}
+
+FVector UGravityMovementComponent::NewFallingVelocity(const FVector& InitialVelocity, const FVector& Gravity, float DeltaTime) const {
+	// Ignore the Z only gravity we're handed, and use the real one.
+	FVector result = InitialVelocity;
+	if (DeltaTime > 0.f) {
+		result += gravityAcceleration * (GetGravityScaleFactor() * DeltaTime);
+
+		// Don't exceed terminal velocity, measured along gravity.
+		const float terminalLimit = FMath::Abs(GetPhysicsVolume()->TerminalVelocity);
+		const float fallSpeed = FVector::DotProduct(result, gravityDirection);
+		if (fallSpeed > terminalLimit) {
+			result += gravityDirection * (terminalLimit - fallSpeed);
+		}
+	}
+	return result;
+}
+
+bool UGravityMovementComponent::DoJump(bool bReplayingMoves) {
+	if (IsDefaultGravityDirection()) {
+		return Super::DoJump(bReplayingMoves);
+	}
+
+	if (CharacterOwner && CharacterOwner->CanJump()) {
+		// Same as the base class, but "up" is away from gravity.
+		if (!bConstrainToPlane || FMath::Abs(PlaneConstraintNormal | gravityDirection) != 1.f) {
+			const float upSpeed = -FVector::DotProduct(Velocity, gravityDirection);
+			Velocity -= gravityDirection * (FMath::Max(upSpeed, JumpZVelocity) - upSpeed);
+			SetMovementMode(MOVE_Falling);
+			return true;
+		}
+	}
+	return false;
+}
+
+bool UGravityMovementComponent::IsWalkable(const FHitResult& Hit) const {
+	if (IsDefaultGravityDirection()) {
+		return Super::IsWalkable(Hit);
+	}
+	if (!Hit.IsValidBlockingHit()) {
+		return false;
+	}
+	// The base class compares the normal's Z against the walkable limit, so we do the same against our own up.
+	return FVector::DotProduct(Hit.ImpactNormal, -gravityDirection) >= GetWalkableFloorZ();
+}
+
+bool UGravityMovementComponent::IsValidLandingSpot(const FVector& CapsuleLocation, const FHitResult& Hit) const {
+	if (IsDefaultGravityDirection()) {
+		return Super::IsValidLandingSpot(CapsuleLocation, Hit);
+	}
+	if (!Hit.bBlockingHit || Hit.bStartPenetrating) {
+		return false;
+	}
+	// Reject hits above our center, and anything we can't stand on.
+	if (FVector::DotProduct(Hit.Normal, -gravityDirection) < KINDA_SMALL_NUMBER || !IsWalkable(Hit)) {
+		return false;
+	}
+
+	FFindFloorResult floorResult;
+	FindFloor(CapsuleLocation, floorResult, false, &Hit);
+	return floorResult.IsWalkableFloor();
+}
+
+void UGravityMovementComponent::ComputeFloorDist(const FVector& CapsuleLocation, float LineDistance, float SweepDistance, FFindFloorResult& OutFloorResult, float SweepRadius, const FHitResult* DownwardSweepResult) const {
+	if (IsDefaultGravityDirection()) {
+		Super::ComputeFloorDist(CapsuleLocation, LineDistance, SweepDistance, OutFloorResult, SweepRadius, DownwardSweepResult);
+		return;
+	}
+
+	// A cut down version of the base class' floor check, sweeping along gravity instead of -Z.
+	OutFloorResult.Clear();
+
+	float pawnRadius, pawnHalfHeight;
+	CharacterOwner->GetCapsuleComponent()->GetScaledCapsuleSize(pawnRadius, pawnHalfHeight);
+
+	FCollisionQueryParams queryParams(SCENE_QUERY_STAT(GravityComputeFloorDist), false, CharacterOwner);
+	FCollisionResponseParams responseParams;
+	InitCollisionParams(queryParams, responseParams);
+	const ECollisionChannel collisionChannel = UpdatedComponent->GetCollisionObjectType();
+	const FQuat rotation = UpdatedComponent->GetComponentQuat();
+
+	if (SweepDistance > 0.f && SweepRadius > 0.f) {
+		// Shrink the capsule so the sweep starts inside it and doesn't pick up walls we're already touching.
+		const float shrinkHeight = (pawnHalfHeight - pawnRadius) * 0.9f;
+		const float traceDist = SweepDistance + shrinkHeight;
+		FCollisionShape capsuleShape = FCollisionShape::MakeCapsule(SweepRadius, pawnHalfHeight - shrinkHeight);
+
+		FHitResult hit(1.f);
+		if (GetWorld()->SweepSingleByChannel(hit, CapsuleLocation, CapsuleLocation + gravityDirection * traceDist, rotation, collisionChannel, capsuleShape, queryParams, responseParams)) {
+			const float sweepResult = FMath::Max(-MAX_FLOOR_DIST, hit.Time * traceDist - shrinkHeight);
+			OutFloorResult.SetFromSweep(hit, sweepResult, false);
+			if (hit.IsValidBlockingHit() && IsWalkable(hit) && sweepResult <= SweepDistance) {
+				OutFloorResult.bWalkableFloor = true;
+				return;
+			}
+		}
+	}
+
+	// Nothing in the way, so there's no point in doing a line trace.
+	if (!OutFloorResult.bBlockingHit && !OutFloorResult.HitResult.bStartPenetrating) {
+		OutFloorResult.FloorDist = SweepDistance;
+		return;
+	}
+
+	if (LineDistance > 0.f) {
+		const float traceDist = LineDistance + pawnHalfHeight;
+		FHitResult hit(1.f);
+		if (GetWorld()->LineTraceSingleByChannel(hit, CapsuleLocation, CapsuleLocation + gravityDirection * traceDist, collisionChannel, queryParams, responseParams) && hit.Time > 0.f) {
+			const float lineResult = FMath::Max(-MAX_FLOOR_DIST, hit.Time * traceDist - pawnHalfHeight);
+			OutFloorResult.bBlockingHit = true;
+			if (lineResult <= LineDistance && IsWalkable(hit)) {
+				OutFloorResult.SetFromLineTrace(hit, OutFloorResult.FloorDist, lineResult, true);
+				return;
+			}
+		}
+	}
+
+	OutFloorResult.bWalkableFloor = false;
+}
+
+FVector UGravityMovementComponent::ConstrainInputAcceleration(const FVector& InputAcceleration) const {
+	if (IsDefaultGravityDirection()) {
+		return Super::ConstrainInputAcceleration(InputAcceleration);
+	}
+	// Walking and falling pawns can't push themselves along gravity, whichever way it points.
+	FVector newAccel = InputAcceleration;
+	if (IsMovingOnGround() || IsFalling()) {
+		newAccel = FVector::VectorPlaneProject(newAccel, gravityDirection);
+	}
+	return newAccel;
+}
+
+void UGravityMovementComponent::MaintainHorizontalGroundVelocity() {
+	if (IsDefaultGravityDirection()) {
+		Super::MaintainHorizontalGroundVelocity();
+		return;
+	}
+
+	const float verticalSpeed = FVector::DotProduct(Velocity, gravityDirection);
+	if (verticalSpeed != 0.f) {
+		if (bMaintainHorizontalGroundVelocity) {
+			// Ramp movement already maintained the velocity, so we just want to remove the vertical component.
+			Velocity -= gravityDirection * verticalSpeed;
+		}
+		else {
+			// Rescale velocity to be horizontal but maintain magnitude of last update.
+			Velocity = FVector::VectorPlaneProject(Velocity, gravityDirection).GetSafeNormal() * Velocity.Size();
+		}
+	}
+}
+
+FVector UGravityMovementComponent::ComputeGroundMovementDelta(const FVector& Delta, const FHitResult& RampHit, const bool bHitFromLineTrace) const {
+	if (IsDefaultGravityDirection()) {
+		return Super::ComputeGroundMovementDelta(Delta, RampHit, bHitFromLineTrace);
+	}
+
+	const FVector floorNormal = RampHit.ImpactNormal;
+	const FVector up = -gravityDirection;
+	const float floorUp = FVector::DotProduct(floorNormal, up);
+	if (floorUp < (1.f - KINDA_SMALL_NUMBER) && floorUp > KINDA_SMALL_NUMBER && !bHitFromLineTrace && IsWalkable(RampHit)) {
+		// Move along the ramp, keeping the same speed as the flat move would have had.
+		const FVector rampMove = FVector::VectorPlaneProject(Delta, floorNormal);
+		return bMaintainHorizontalGroundVelocity ? rampMove.GetSafeNormal() * Delta.Size() : rampMove;
+	}
+	return Delta;
+}
+
+void UGravityMovementComponent::PhysicsRotation(float DeltaTime) {
+	Super::PhysicsRotation(DeltaTime);
+
+	if (rotGravityPercent >= 1 || UpdatedComponent == nullptr) {
+		return;
+	}
+	TRACE_CPUPROFILER_EVENT_SCOPE(UGravityMovementComponent::GravityTransition);
+	CSV_CUSTOM_STAT(BoardingAction, GravityTransitions, 1, ECsvCustomStatOp::Accumulate);
+
+	rotGravityPercent = FMath::Min(rotGravityPercent + DeltaTime * GravityRotationRate, 1.0f);
+
+	// Turning the capsule here means it happens as part of the movement update, rather than as another SetActorRotation
+	// (and all the overlap updates that come with it) every frame.
+	MoveUpdatedComponent(FVector::ZeroVector, FQuat::Slerp(oldRotation, rotGravity, rotGravityPercent), false);
+}
+
+bool UGravityMovementComponent::IsWithinGravityEdgeTolerance(const FVector& CapsuleLocation, const FVector& TestImpactPoint, float CapsuleRadius) const {
+	const float distFromCenterSq = FVector::VectorPlaneProject(TestImpactPoint - CapsuleLocation, gravityDirection).SizeSquared();
+	const float reducedRadiusSq = FMath::Square(FMath::Max(SWEEP_EDGE_REJECT_DISTANCE + KINDA_SMALL_NUMBER, CapsuleRadius - SWEEP_EDGE_REJECT_DISTANCE));
+	return distFromCenterSq < reducedRadiusSq;
+}
+
+void UGravityMovementComponent::PhysWalking(float deltaTime, int32 Iterations) {
+	if (IsDefaultGravityDirection()) {
+		Super::PhysWalking(deltaTime, Iterations);
+		return;
+	}
+	TRACE_CPUPROFILER_EVENT_SCOPE(UGravityMovementComponent::PhysWalking);
+
+	// The base class' walking loop, with everything it does along Z done along gravity instead.
+	if (deltaTime < MIN_TICK_TIME) {
+		return;
+	}
+	if (!CharacterOwner || (!CharacterOwner->Controller && !bRunPhysicsWithNoController && !HasAnimRootMotion() && !CurrentRootMotion.HasOverrideVelocity() && CharacterOwner->GetLocalRole() != ROLE_SimulatedProxy)) {
+		Acceleration = FVector::ZeroVector;
+		Velocity = FVector::ZeroVector;
+		return;
+	}
+	if (!UpdatedComponent->IsQueryCollisionEnabled()) {
+		SetMovementMode(MOVE_Walking);
+		return;
+	}
+
+	bJustTeleported = false;
+	bool bCheckedFall = false;
+	bool bTriedLedgeMove = false;
+	float remainingTime = deltaTime;
+
+	while (remainingTime >= MIN_TICK_TIME && Iterations < MaxSimulationIterations && CharacterOwner
+		&& (CharacterOwner->Controller || bRunPhysicsWithNoController || HasAnimRootMotion() || CurrentRootMotion.HasOverrideVelocity() || CharacterOwner->GetLocalRole() == ROLE_SimulatedProxy)) {
+		Iterations++;
+		bJustTeleported = false;
+		const float timeTick = GetSimulationTimeStep(remainingTime, Iterations);
+		remainingTime -= timeTick;
+
+		UPrimitiveComponent* const oldBase = GetMovementBase();
+		const FVector previousBaseLocation = oldBase != nullptr ? oldBase->GetComponentLocation() : FVector::ZeroVector;
+		const FVector oldLocation = UpdatedComponent->GetComponentLocation();
+		const FFindFloorResult oldFloor = CurrentFloor;
+
+		RestorePreAdditiveRootMotionVelocity();
+
+		// Keep velocity and acceleration across gravity.
+		MaintainHorizontalGroundVelocity();
+		const FVector oldVelocity = Velocity;
+		Acceleration = FVector::VectorPlaneProject(Acceleration, gravityDirection);
+
+		if (!HasAnimRootMotion() && !CurrentRootMotion.HasOverrideVelocity()) {
+			CalcVelocity(timeTick, GroundFriction, false, GetMaxBrakingDeceleration());
+		}
+		ApplyRootMotionToVelocity(timeTick);
+
+		if (IsFalling()) {
+			// Root motion could have put us into falling. Nothing has moved yet, so hand over the whole tick.
+			StartNewPhysics(remainingTime + timeTick, Iterations - 1);
+			return;
+		}
+
+		const FVector moveVelocity = Velocity;
+		const FVector delta = timeTick * moveVelocity;
+		const bool bZeroDelta = delta.IsNearlyZero();
+		FStepDownResult stepDownResult;
+
+		if (bZeroDelta) {
+			remainingTime = 0.f;
+		}
+		else {
+			MoveAlongFloor(moveVelocity, timeTick, &stepDownResult);
+
+			if (IsFalling()) {
+				// Walked off something, so give back whatever part of the tick we didn't use.
+				const float desiredDist = delta.Size();
+				if (desiredDist > KINDA_SMALL_NUMBER) {
+					const float actualDist = FVector::VectorPlaneProject(UpdatedComponent->GetComponentLocation() - oldLocation, gravityDirection).Size();
+					remainingTime += timeTick * (1.f - FMath::Min(1.f, actualDist / desiredDist));
+				}
+				StartNewPhysics(remainingTime, Iterations);
+				return;
+			}
+			else if (IsSwimming()) {
+				StartSwimming(oldLocation, oldVelocity, timeTick, remainingTime, Iterations);
+				return;
+			}
+		}
+
+		// StepUp might have already found the floor for us.
+		if (stepDownResult.bComputedFloor) {
+			CurrentFloor = stepDownResult.FloorResult;
+		}
+		else {
+			FindFloor(UpdatedComponent->GetComponentLocation(), CurrentFloor, bZeroDelta, nullptr);
+		}
+
+		const bool bCheckLedges = !CanWalkOffLedges();
+		if (bCheckLedges && !CurrentFloor.IsWalkableFloor()) {
+			const FVector newDelta = bTriedLedgeMove ? FVector::ZeroVector : GetLedgeMove(oldLocation, delta, gravityDirection);
+			if (!newDelta.IsZero()) {
+				// Go back and try moving along the ledge instead, but only once.
+				RevertMove(oldLocation, oldBase, previousBaseLocation, oldFloor, false);
+				bTriedLedgeMove = true;
+				Velocity = newDelta / timeTick;
+				remainingTime += timeTick;
+				continue;
+			}
+
+			const bool bMustJump = bZeroDelta || oldBase == nullptr || (!oldBase->IsQueryCollisionEnabled() && MovementBaseUtility::IsDynamicBase(oldBase));
+			if ((bMustJump || !bCheckedFall) && CheckFall(oldFloor, CurrentFloor.HitResult, delta, oldLocation, remainingTime, timeTick, Iterations, bMustJump)) {
+				return;
+			}
+			bCheckedFall = true;
+
+			RevertMove(oldLocation, oldBase, previousBaseLocation, oldFloor, true);
+			remainingTime = 0.f;
+			break;
+		}
+
+		if (CurrentFloor.IsWalkableFloor()) {
+			if (ShouldCatchAir(oldFloor, CurrentFloor)) {
+				HandleWalkingOffLedge(oldFloor.HitResult.ImpactNormal, oldFloor.HitResult.Normal, oldLocation, timeTick);
+				if (IsMovingOnGround()) {
+					StartFalling(Iterations, remainingTime, timeTick, delta, oldLocation);
+				}
+				return;
+			}
+			AdjustFloorHeight();
+			SetBase(CurrentFloor.HitResult.Component.Get(), CurrentFloor.HitResult.BoneName);
+		}
+		else if (CurrentFloor.HitResult.bStartPenetrating && remainingTime <= 0.f) {
+			// The floor check started inside the floor. Rather than moving further into it, try to pop back out against gravity.
+			FHitResult hit(CurrentFloor.HitResult);
+			hit.TraceEnd = hit.TraceStart - gravityDirection * MAX_FLOOR_DIST;
+			const FVector requestedAdjustment = GetPenetrationAdjustment(hit);
+			ResolvePenetration(requestedAdjustment, hit, UpdatedComponent->GetComponentQuat());
+			bForceNextFloorCheck = true;
+		}
+
+		if (IsSwimming()) {
+			StartSwimming(oldLocation, Velocity, timeTick, remainingTime, Iterations);
+			return;
+		}
+
+		if (!CurrentFloor.IsWalkableFloor() && !CurrentFloor.HitResult.bStartPenetrating) {
+			const bool bMustJump = bJustTeleported || bZeroDelta || oldBase == nullptr || (!oldBase->IsQueryCollisionEnabled() && MovementBaseUtility::IsDynamicBase(oldBase));
+			if ((bMustJump || !bCheckedFall) && CheckFall(oldFloor, CurrentFloor.HitResult, delta, oldLocation, remainingTime, timeTick, Iterations, bMustJump)) {
+				return;
+			}
+			bCheckedFall = true;
+		}
+
+		// Make velocity reflect the move we actually made.
+		if (IsMovingOnGround() && !bJustTeleported && !HasAnimRootMotion() && !CurrentRootMotion.HasOverrideVelocity() && timeTick >= MIN_TICK_TIME) {
+			Velocity = (UpdatedComponent->GetComponentLocation() - oldLocation) / timeTick;
+			MaintainHorizontalGroundVelocity();
+		}
+
+		// Didn't move at all, and neither will any more iterations.
+		if (UpdatedComponent->GetComponentLocation() == oldLocation) {
+			remainingTime = 0.f;
+			break;
+		}
+	}
+
+	if (IsMovingOnGround()) {
+		MaintainHorizontalGroundVelocity();
+	}
+}
+
+void UGravityMovementComponent::MoveAlongFloor(const FVector& InVelocity, float DeltaSeconds, FStepDownResult* OutStepDownResult) {
+	if (IsDefaultGravityDirection()) {
+		Super::MoveAlongFloor(InVelocity, DeltaSeconds, OutStepDownResult);
+		return;
+	}
+	if (!CurrentFloor.IsWalkableFloor()) {
+		return;
+	}
+
+	const FVector up = -gravityDirection;
+	const FVector delta = FVector::VectorPlaneProject(InVelocity, gravityDirection) * DeltaSeconds;
+	FHitResult hit(1.f);
+	FVector rampVector = ComputeGroundMovementDelta(delta, CurrentFloor.HitResult, CurrentFloor.bLineTrace);
+	SafeMoveUpdatedComponent(rampVector, UpdatedComponent->GetComponentQuat(), true, hit);
+	float lastMoveTimeSlice = DeltaSeconds;
+
+	if (hit.bStartPenetrating) {
+		// Deflect off it, otherwise we'd do nothing for the rest of the update and appear to hitch.
+		HandleImpact(hit);
+		SlideAlongSurface(delta, 1.f, hit.Normal, hit, true);
+		if (hit.bStartPenetrating) {
+			OnCharacterStuckInGeometry(&hit);
+		}
+		return;
+	}
+	if (!hit.IsValidBlockingHit()) {
+		return;
+	}
+
+	// Ran into something, most likely another ramp, but possibly a barrier.
+	float percentTimeApplied = hit.Time;
+	if (hit.Time > 0.f && FVector::DotProduct(hit.Normal, up) > KINDA_SMALL_NUMBER && IsWalkable(hit)) {
+		// Another walkable ramp.
+		const float initialPercentRemaining = 1.f - percentTimeApplied;
+		rampVector = ComputeGroundMovementDelta(delta * initialPercentRemaining, hit, false);
+		lastMoveTimeSlice = initialPercentRemaining * lastMoveTimeSlice;
+		SafeMoveUpdatedComponent(rampVector, UpdatedComponent->GetComponentQuat(), true, hit);
+		percentTimeApplied = FMath::Clamp(percentTimeApplied + hit.Time * initialPercentRemaining, 0.f, 1.f);
+	}
+
+	if (!hit.IsValidBlockingHit()) {
+		return;
+	}
+	if (CanStepUp(hit) || (CharacterOwner->GetMovementBase() != nullptr && CharacterOwner->GetMovementBase()->GetOwner() == hit.GetActor())) {
+		// A barrier, so try stepping up it, away from gravity.
+		const FVector preStepUpLocation = UpdatedComponent->GetComponentLocation();
+		if (!StepUp(gravityDirection, delta * (1.f - percentTimeApplied), hit, OutStepDownResult)) {
+			HandleImpact(hit, lastMoveTimeSlice, rampVector);
+			SlideAlongSurface(delta, 1.f - percentTimeApplied, hit.Normal, hit, true);
+		}
+		else if (!bMaintainHorizontalGroundVelocity) {
+			// Don't count the step's height in the velocity, only how far across gravity it took us.
+			bJustTeleported = true;
+			const float stepUpTimeSlice = (1.f - percentTimeApplied) * DeltaSeconds;
+			if (!HasAnimRootMotion() && !CurrentRootMotion.HasOverrideVelocity() && stepUpTimeSlice >= KINDA_SMALL_NUMBER) {
+				Velocity = FVector::VectorPlaneProject((UpdatedComponent->GetComponentLocation() - preStepUpLocation) / stepUpTimeSlice, gravityDirection);
+			}
+		}
+	}
+	else if (hit.Component.IsValid() && !hit.Component.Get()->CanCharacterStepUp(CharacterOwner)) {
+		HandleImpact(hit, lastMoveTimeSlice, rampVector);
+		SlideAlongSurface(delta, 1.f - percentTimeApplied, hit.Normal, hit, true);
+	}
+}
+
+bool UGravityMovementComponent::StepUp(const FVector& GravDir, const FVector& Delta, const FHitResult& InHit, FStepDownResult* OutStepDownResult) {
+	if (IsDefaultGravityDirection()) {
+		return Super::StepUp(GravDir, Delta, InHit, OutStepDownResult);
+	}
+	if (!CanStepUp(InHit) || MaxStepHeight <= 0.f || GravDir.IsZero()) {
+		return false;
+	}
+
+	// The base class' step up, with heights measured away from GravDir instead of along Z.
+	const FVector up = -GravDir.GetSafeNormal();
+	const FVector oldLocation = UpdatedComponent->GetComponentLocation();
+	const float oldHeight = FVector::DotProduct(oldLocation, up);
+	float pawnRadius, pawnHalfHeight;
+	CharacterOwner->GetCapsuleComponent()->GetScaledCapsuleSize(pawnRadius, pawnHalfHeight);
+
+	// Don't bother if it's the top of the capsule that's hitting something.
+	const float initialImpactHeight = FVector::DotProduct(InHit.ImpactPoint, up);
+	if (initialImpactHeight > oldHeight + (pawnHalfHeight - pawnRadius)) {
+		return false;
+	}
+
+	float stepTravelUpHeight = MaxStepHeight;
+	float stepTravelDownHeight = stepTravelUpHeight;
+	const float stepSideUp = FVector::DotProduct(InHit.ImpactNormal, up);
+	float pawnInitialFloorBaseHeight = oldHeight - pawnHalfHeight;
+	float pawnFloorPointHeight = pawnInitialFloorBaseHeight;
+
+	if (IsMovingOnGround() && CurrentFloor.IsWalkableFloor()) {
+		// We float a variable amount off the floor, so the max step height has to be from where we actually touch it.
+		const float floorDist = FMath::Max(0.f, CurrentFloor.GetDistanceToFloor());
+		pawnInitialFloorBaseHeight -= floorDist;
+		stepTravelUpHeight = FMath::Max(stepTravelUpHeight - floorDist, 0.f);
+		stepTravelDownHeight = MaxStepHeight + MAX_FLOOR_DIST * 2.f;
+
+		const bool bHitVerticalFace = !IsWithinGravityEdgeTolerance(InHit.Location, InHit.ImpactPoint, pawnRadius);
+		if (!CurrentFloor.bLineTrace && !bHitVerticalFace) {
+			pawnFloorPointHeight = FVector::DotProduct(CurrentFloor.HitResult.ImpactPoint, up);
+		}
+		else {
+			pawnFloorPointHeight -= CurrentFloor.FloorDist;
+		}
+	}
+
+	// Don't step up if the impact is below us.
+	if (initialImpactHeight <= pawnInitialFloorBaseHeight) {
+		return false;
+	}
+
+	// None of the moves below count until they've all worked out.
+	FScopedMovementUpdate scopedStepUpMovement(UpdatedComponent, EScopedUpdate::DeferredUpdates);
+
+	// Up
+	FHitResult sweepUpHit(1.f);
+	const FQuat pawnRotation = UpdatedComponent->GetComponentQuat();
+	MoveUpdatedComponent(up * stepTravelUpHeight, pawnRotation, true, &sweepUpHit);
+	if (sweepUpHit.bStartPenetrating) {
+		scopedStepUpMovement.RevertMove();
+		return false;
+	}
+
+	// Forward
+	FHitResult hit(1.f);
+	MoveUpdatedComponent(Delta, pawnRotation, true, &hit);
+	if (hit.bBlockingHit) {
+		if (hit.bStartPenetrating) {
+			scopedStepUpMovement.RevertMove();
+			return false;
+		}
+
+		// Something above us as well as ahead, so let it know about the upward hit too.
+		if (sweepUpHit.bBlockingHit) {
+			HandleImpact(sweepUpHit);
+		}
+
+		HandleImpact(hit);
+		if (IsFalling()) {
+			return true;
+		}
+
+		const float forwardHitTime = hit.Time;
+		const float forwardSlideAmount = SlideAlongSurface(Delta, 1.f - hit.Time, hit.Normal, hit, true);
+		if (IsFalling()) {
+			scopedStepUpMovement.RevertMove();
+			return false;
+		}
+		// Got nowhere, so there's no point stepping up.
+		if (forwardHitTime == 0.f && forwardSlideAmount == 0.f) {
+			scopedStepUpMovement.RevertMove();
+			return false;
+		}
+	}
+
+	// Down
+	MoveUpdatedComponent(-up * stepTravelDownHeight, UpdatedComponent->GetComponentQuat(), true, &hit);
+	if (hit.bStartPenetrating) {
+		scopedStepUpMovement.RevertMove();
+		return false;
+	}
+
+	FStepDownResult stepDownResult;
+	if (hit.IsValidBlockingHit()) {
+		// Would this have taken us higher than a step can?
+		const float deltaHeight = FVector::DotProduct(hit.ImpactPoint, up) - pawnFloorPointHeight;
+		if (deltaHeight > MaxStepHeight) {
+			scopedStepUpMovement.RevertMove();
+			return false;
+		}
+
+		if (!IsWalkable(hit)) {
+			// Facing back at us, or leaving us higher than we started. Stepping down onto it is fine, we'll just slide off.
+			if ((Delta | hit.ImpactNormal) < 0.f || FVector::DotProduct(hit.Location, up) > oldHeight) {
+				scopedStepUpMovement.RevertMove();
+				return false;
+			}
+		}
+
+		// Too close to the edge of the capsule, which FindFloor wouldn't accept either.
+		if (!IsWithinGravityEdgeTolerance(hit.Location, hit.ImpactPoint, pawnRadius)) {
+			scopedStepUpMovement.RevertMove();
+			return false;
+		}
+
+		if (deltaHeight > 0.f && !CanStepUp(hit)) {
+			scopedStepUpMovement.RevertMove();
+			return false;
+		}
+
+		// Almost always finds the floor, which saves doing it again afterwards.
+		if (OutStepDownResult != nullptr) {
+			FindFloor(UpdatedComponent->GetComponentLocation(), stepDownResult.FloorResult, false, &hit);
+			// Ending up higher without anything to perch on means it was a real step we can't stand on, so slide along it instead.
+			if (FVector::DotProduct(hit.Location, up) > oldHeight && !stepDownResult.FloorResult.bBlockingHit && stepSideUp < MaxStepSideUp) {
+				scopedStepUpMovement.RevertMove();
+				return false;
+			}
+			stepDownResult.bComputedFloor = true;
+		}
+	}
+
+	if (OutStepDownResult != nullptr) {
+		*OutStepDownResult = stepDownResult;
+	}
+
+	// Don't count the height we just gained in the velocity.
+	bJustTeleported |= !bMaintainHorizontalGroundVelocity;
+	return true;
+}
+
+void UGravityMovementComponent::AdjustFloorHeight() {
+	if (IsDefaultGravityDirection()) {
+		Super::AdjustFloorHeight();
+		return;
+	}
+	if (!CurrentFloor.IsWalkableFloor()) {
+		return;
+	}
+
+	float oldFloorDist = CurrentFloor.FloorDist;
+	if (CurrentFloor.bLineTrace) {
+		// This would have us climbing unwalkable walls.
+		if (oldFloorDist < MIN_FLOOR_DIST && CurrentFloor.LineDist >= MIN_FLOOR_DIST) {
+			return;
+		}
+		oldFloorDist = CurrentFloor.LineDist;
+	}
+
+	// Float a steady distance off the floor, measured along gravity.
+	if (oldFloorDist >= MIN_FLOOR_DIST && oldFloorDist <= MAX_FLOOR_DIST) {
+		return;
+	}
+	const FVector up = -gravityDirection;
+	FHitResult adjustHit(1.f);
+	const float initialHeight = FVector::DotProduct(UpdatedComponent->GetComponentLocation(), up);
+	const float moveDist = (MIN_FLOOR_DIST + MAX_FLOOR_DIST) * 0.5f - oldFloorDist;
+	SafeMoveUpdatedComponent(up * moveDist, UpdatedComponent->GetComponentQuat(), true, adjustHit);
+
+	const float currentHeight = FVector::DotProduct(UpdatedComponent->GetComponentLocation(), up);
+	if (!adjustHit.IsValidBlockingHit()) {
+		CurrentFloor.FloorDist += moveDist;
+	}
+	else if (moveDist > 0.f) {
+		CurrentFloor.FloorDist += currentHeight - initialHeight;
+	}
+	else {
+		CurrentFloor.FloorDist = currentHeight - FVector::DotProduct(adjustHit.Location, up);
+		if (IsWalkable(adjustHit)) {
+			CurrentFloor.SetFromSweep(adjustHit, CurrentFloor.FloorDist, true);
+		}
+	}
+
+	// Don't count the adjustment in the velocity, and check the floor again next time since it's probably changed.
+	bJustTeleported |= !bMaintainHorizontalGroundVelocity || oldFloorDist < 0.f;
+	if (CharacterOwner && CharacterOwner->GetLocalRole() != ROLE_SimulatedProxy) {
+		bForceNextFloorCheck = true;
+	}
+}
+
+float UGravityMovementComponent::SlideAlongSurface(const FVector& Delta, float Time, const FVector& InNormal, FHitResult& Hit, bool bHandleImpact) {
+	if (IsDefaultGravityDirection() || !IsMovingOnGround()) {
+		return Super::SlideAlongSurface(Delta, Time, InNormal, Hit, bHandleImpact);
+	}
+
+	// The base class' adjustments for walking, against our own up.
+	const FVector up = -gravityDirection;
+	FVector normal = InNormal;
+	const float normalUp = FVector::DotProduct(normal, up);
+	if (normalUp > 0.f) {
+		// Don't get pushed up something we can't walk on.
+		if (!IsWalkable(Hit)) {
+			normal = FVector::VectorPlaneProject(normal, gravityDirection).GetSafeNormal();
+		}
+	}
+	else if (normalUp < -KINDA_SMALL_NUMBER) {
+		// Don't get pushed down into the floor when the hit is on the top half of the capsule.
+		if (CurrentFloor.FloorDist < MIN_FLOOR_DIST && CurrentFloor.bBlockingHit) {
+			const FVector floorNormal = CurrentFloor.HitResult.Normal;
+			const bool bFloorOpposedToMovement = (Delta | floorNormal) < 0.f && FVector::DotProduct(floorNormal, up) < 1.f - DELTA;
+			if (bFloorOpposedToMovement) {
+				normal = floorNormal;
+			}
+			normal = FVector::VectorPlaneProject(normal, gravityDirection).GetSafeNormal();
+		}
+	}
+	// Skip over the base class, which would redo all of that against Z.
+	return UPawnMovementComponent::SlideAlongSurface(Delta, Time, normal, Hit, bHandleImpact);
+}
+
+FVector UGravityMovementComponent::GetFallingLateralAcceleration(float DeltaTime) {
+	if (IsDefaultGravityDirection()) {
+		return Super::GetFallingLateralAcceleration(DeltaTime);
+	}
+
+	// No acceleration along gravity, rather than none along Z.
+	FVector fallAcceleration = FVector::VectorPlaneProject(Acceleration, gravityDirection);
+	if (!HasAnimRootMotion() && fallAcceleration.SizeSquared() > 0.f) {
+		fallAcceleration = GetAirControl(DeltaTime, AirControl, fallAcceleration);
+		fallAcceleration = fallAcceleration.GetClampedToMaxSize(GetMaxAcceleration());
+	}
+	return fallAcceleration;
+}
+
+float UGravityMovementComponent::BoostAirControl(float DeltaTime, float TickAirControl, const FVector& FallAcceleration) {
+	if (IsDefaultGravityDirection()) {
+		return Super::BoostAirControl(DeltaTime, TickAirControl, FallAcceleration);
+	}
+	// The boost is for when we're barely moving sideways, measured across gravity.
+	if (AirControlBoostMultiplier > 0.f && FVector::VectorPlaneProject(Velocity, gravityDirection).SizeSquared() < FMath::Square(AirControlBoostVelocityThreshold)) {
+		TickAirControl = FMath::Min(1.f, AirControlBoostMultiplier * TickAirControl);
+	}
+	return TickAirControl;
+}
+
+FVector UGravityMovementComponent::LimitAirControl(float DeltaTime, const FVector& FallAcceleration, const FHitResult& HitResult, bool bCheckForValidLandingSpot) {
+	if (IsDefaultGravityDirection()) {
+		return Super::LimitAirControl(DeltaTime, FallAcceleration, HitResult, bCheckForValidLandingSpot);
+	}
+
+	FVector result = FallAcceleration;
+	if (HitResult.IsValidBlockingHit() && FVector::DotProduct(HitResult.Normal, -gravityDirection) > VerticalSlopeNormal) {
+		if (!bCheckForValidLandingSpot || !IsValidLandingSpot(HitResult.Location, HitResult)) {
+			// Accelerating into the wall is limited to along it, so it can't push us up it, with "up" away from gravity.
+			if (FVector::DotProduct(FallAcceleration, HitResult.Normal) < 0.f) {
+				const FVector wallNormal = FVector::VectorPlaneProject(HitResult.Normal, gravityDirection).GetSafeNormal();
+				result = FVector::VectorPlaneProject(FallAcceleration, wallNormal);
+			}
+		}
+	}
+	else if (HitResult.bStartPenetrating) {
+		// Only allow moving out of the penetration.
+		return FVector::DotProduct(result, HitResult.Normal) > 0.f ? result : FVector::ZeroVector;
+	}
+	return result;
+}
+
+FVector UGravityMovementComponent::GetLedgeMove(const FVector& OldLocation, const FVector& Delta, const FVector& GravDir) const {
+	if (IsDefaultGravityDirection()) {
+		return Super::GetLedgeMove(OldLocation, Delta, GravDir);
+	}
+	if (!HasValidData() || Delta.IsZero()) {
+		return FVector::ZeroVector;
+	}
+
+	// Sideways relative to gravity, rather than in the XY plane. Left first, then right.
+	FVector sideDir = FVector::CrossProduct(Delta, -GravDir);
+	if (CheckLedgeDirection(OldLocation, sideDir, GravDir)) {
+		return sideDir;
+	}
+	sideDir *= -1.f;
+	if (CheckLedgeDirection(OldLocation, sideDir, GravDir)) {
+		return sideDir;
+	}
+	return FVector::ZeroVector;
+}
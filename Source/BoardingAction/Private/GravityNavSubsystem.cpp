@@ -0,0 +1,251 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "GravityNavSubsystem.h"
+#include "BoardingAction.h"
+#include "GravityNavVolume.h"
+#include "PhysicsSubsystem.h"
+#include "Async/Async.h"
+#include "Algo/Reverse.h"
+
+DEFINE_LOG_CATEGORY(LogGravityNav);
+
+DECLARE_CYCLE_STAT(TEXT("Gravity Nav Batch"), STAT_GravityNavBatch, STATGROUP_BoardingActionEnemies);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Gravity Nav Queries"), STAT_GravityNavQueries, STATGROUP_BoardingActionEnemies);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Gravity Nav Failed Queries"), STAT_GravityNavFailed, STATGROUP_BoardingActionEnemies);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Gravity Nav Pending Queries"), STAT_GravityNavPending, STATGROUP_BoardingActionEnemies);
+
+static uint32 MakeCellKey(int32 x, int32 y) {
+	return uint32(x) << 16 | uint32(y);
+}
+
+FGravityNavSearchGraph::FGravityNavSearchGraph(const FGravityNavGraph& graph)
+	: orientation(graph.Orientation), frame(graph.Frame), cellSize(graph.CellSize), firstEdge(graph.FirstEdge), edges(graph.Edges) {
+	locations.SetNumUninitialized(graph.Nodes.Num());
+	for (int32 i = 0; i < graph.Nodes.Num(); i++) {
+		locations[i] = graph.GetNodeLocation(i);
+		cells.FindOrAdd(MakeCellKey(graph.Nodes[i].X, graph.Nodes[i].Y)).Add(i);
+	}
+}
+
+int32 FGravityNavSearchGraph::FindNearestNode(const FVector& location, float maxDistance) const {
+	if (cellSize <= 0.0f) {
+		return INDEX_NONE;
+	}
+	const FVector local = frame.InverseTransformPosition(location);
+	const int32 centerX = FMath::RoundToInt(local.X / cellSize);
+	const int32 centerY = FMath::RoundToInt(local.Y / cellSize);
+	const int32 reach = FMath::CeilToInt(maxDistance / cellSize);
+
+	int32 best = INDEX_NONE;
+	float bestDistance = FMath::Square(maxDistance);
+	for (int32 x = FMath::Max(centerX - reach, 0); x <= FMath::Min(centerX + reach, int32(MAX_uint16)); x++) {
+		for (int32 y = FMath::Max(centerY - reach, 0); y <= FMath::Min(centerY + reach, int32(MAX_uint16)); y++) {
+			const TArray<int32, TInlineAllocator<2>>* nodes = cells.Find(MakeCellKey(x, y));
+			if (nodes == nullptr) {
+				continue;
+			}
+			for (int32 node : *nodes) {
+				float distance = FVector::DistSquared(locations[node], location);
+				if (distance <= bestDistance) {
+					best = node;
+					bestDistance = distance;
+				}
+			}
+		}
+	}
+	return best;
+}
+
+bool FGravityNavSearchGraph::FindPath(int32 start, int32 goal, int32 maxVisits, TArray<FVector>& outPath) const {
+	struct FOpenNode
+	{
+		int32 node;
+		float estimate;
+		bool operator<(const FOpenNode& other) const { return estimate < other.estimate; }
+	};
+
+	// Sparse, since a search normally only touches a small part of the graph.
+	TMap<int32, float> costs;
+	TMap<int32, int32> parents;
+	TArray<FOpenNode> open;
+
+	costs.Add(start, 0.0f);
+	parents.Add(start, INDEX_NONE);
+	open.HeapPush(FOpenNode{start, FVector::Dist(locations[start], locations[goal])});
+
+	int32 visits = 0;
+	while (open.Num() > 0 && visits < maxVisits) {
+		FOpenNode current;
+		open.HeapPop(current, false);
+		if (current.node == goal) {
+			outPath.Reset();
+			for (int32 node = goal; node != INDEX_NONE; node = parents[node]) {
+				outPath.Add(locations[node]);
+			}
+			Algo::Reverse(outPath);
+			return true;
+		}
+
+		const float cost = costs[current.node];
+		// There's a cheaper way here further up the heap, which has already been handled.
+		if (current.estimate > cost + FVector::Dist(locations[current.node], locations[goal]) + KINDA_SMALL_NUMBER) {
+			continue;
+		}
+		visits++;
+
+		for (int32 edge = firstEdge[current.node]; edge < firstEdge[current.node + 1]; edge++) {
+			const int32 next = edges[edge];
+			const float nextCost = cost + FVector::Dist(locations[current.node], locations[next]);
+			const float* known = costs.Find(next);
+			if (known == nullptr || nextCost < *known) {
+				costs.Add(next, nextCost);
+				parents.Add(next, current.node);
+				open.HeapPush(FOpenNode{next, nextCost + FVector::Dist(locations[next], locations[goal])});
+			}
+		}
+	}
+	return false;
+}
+
+UGravityNavSubsystem::UGravityNavSubsystem() {
+	MaxQueriesPerBatch = 64;
+	MaxSearchVisits = 20000;
+	MaxSnapDistance = 200.0f;
+}
+
+void UGravityNavSubsystem::Initialize(FSubsystemCollectionBase& Collection) {
+	worldPhysics = Cast<UPhysicsSubsystem>(Collection.InitializeDependency(UPhysicsSubsystem::StaticClass()));
+	worldPhysics->OnGravityChanged.AddUObject(this, &UGravityNavSubsystem::OnGravityChanged);
+	completed = MakeShared<TQueue<FPathResult, EQueueMode::Mpsc>, ESPMode::ThreadSafe>();
+	activeGraphs = MakeShared<TArray<FSearchGraphPtr>, ESPMode::ThreadSafe>();
+	activeOrientation = UPhysicsSubsystem::FindGravityOrientation(worldPhysics->GetGravity());
+}
+
+void UGravityNavSubsystem::Deinitialize() {
+	if (worldPhysics != nullptr) {
+		worldPhysics->OnGravityChanged.RemoveAll(this);
+	}
+	volumes.Empty();
+	volumeGraphs.Empty();
+	activeGraphs = MakeShared<TArray<FSearchGraphPtr>, ESPMode::ThreadSafe>();
+	pendingQueries.Empty();
+	callbacks.Empty();
+}
+
+void UGravityNavSubsystem::RegisterVolume(AGravityNavVolume* volume) {
+	if (volume == nullptr || volumes.Contains(volume)) {
+		return;
+	}
+	if (volume->Graphs.Num() == 0) {
+		UE_LOG(LogGravityNav, Warning, TEXT("%s has no navigation graphs, build them in the editor."), *volume->GetName());
+	}
+
+	// Unpacked up front, so switching orientation later is just a pointer swap.
+	TArray<FSearchGraphPtr>& graphs = volumeGraphs.AddDefaulted_GetRef();
+	graphs.SetNum(UPhysicsSubsystem::GetGravityOrientationCount());
+	for (const FGravityNavGraph& graph : volume->Graphs) {
+		if (graphs.IsValidIndex(graph.Orientation)) {
+			graphs[graph.Orientation] = MakeShared<FGravityNavSearchGraph, ESPMode::ThreadSafe>(graph);
+		}
+	}
+	volumes.Add(volume);
+	SetActiveOrientation(activeOrientation);
+}
+
+void UGravityNavSubsystem::UnregisterVolume(AGravityNavVolume* volume) {
+	int32 index = volumes.Find(volume);
+	if (index != INDEX_NONE) {
+		volumes.RemoveAt(index);
+		volumeGraphs.RemoveAt(index);
+		SetActiveOrientation(activeOrientation);
+	}
+}
+
+void UGravityNavSubsystem::OnGravityChanged(const FVector& oldGravity, const FVector& newGravity) {
+	SetActiveOrientation(UPhysicsSubsystem::FindGravityOrientation(newGravity));
+}
+
+void UGravityNavSubsystem::SetActiveOrientation(int32 orientation) {
+	activeOrientation = orientation;
+	// A fresh array rather than editing the old one, since a batch on a worker thread might still be reading it.
+	TSharedRef<TArray<FSearchGraphPtr>, ESPMode::ThreadSafe> graphs = MakeShared<TArray<FSearchGraphPtr>, ESPMode::ThreadSafe>();
+	if (orientation != INDEX_NONE) {
+		for (const TArray<FSearchGraphPtr>& volume : volumeGraphs) {
+			if (volume[orientation].IsValid()) {
+				graphs->Add(volume[orientation]);
+			}
+		}
+	}
+	activeGraphs = graphs;
+}
+
+void UGravityNavSubsystem::RequestPath(const FVector& start, const FVector& goal, FOnGravityPathFound onFound) {
+	int32 id = nextQueryId++;
+	pendingQueries.Add(FPathQuery{id, start, goal});
+	callbacks.Add(id, onFound);
+}
+
+void UGravityNavSubsystem::Tick(float DeltaTime) {
+	if (pendingQueries.Num() > 0) {
+		DispatchBatch();
+	}
+
+	FPathResult result;
+	while (completed->Dequeue(result)) {
+		FOnGravityPathFound onFound;
+		if (!callbacks.RemoveAndCopyValue(result.id, onFound)) {
+			continue;
+		}
+		// Gravity changed while this was being worked out, so the path is along floors that aren't floors any more.
+		const bool bSuccess = result.bSuccess && result.orientation == activeOrientation;
+		if (!bSuccess) {
+			INC_DWORD_STAT(STAT_GravityNavFailed);
+			result.path.Reset();
+		}
+		onFound.ExecuteIfBound(bSuccess, result.path);
+	}
+	SET_DWORD_STAT(STAT_GravityNavPending, callbacks.Num());
+}
+
+void UGravityNavSubsystem::DispatchBatch() {
+	const int32 count = FMath::Min(pendingQueries.Num(), FMath::Max(MaxQueriesPerBatch, 1));
+	TArray<FPathQuery> batch(pendingQueries.GetData(), count);
+	pendingQueries.RemoveAt(0, count, false);
+	INC_DWORD_STAT_BY(STAT_GravityNavQueries, count);
+
+	Async(EAsyncExecution::ThreadPool, [batch = MoveTemp(batch), graphs = activeGraphs, orientation = activeOrientation, results = completed, maxVisits = MaxSearchVisits, snapDistance = MaxSnapDistance]() {
+		SCOPE_CYCLE_COUNTER(STAT_GravityNavBatch);
+		for (const FPathQuery& query : batch) {
+			FPathResult result{query.id, orientation, false};
+			// The start decides which volume's graph to use. Paths don't cross between volumes.
+			for (const FSearchGraphPtr& graph : *graphs) {
+				int32 start = graph->FindNearestNode(query.start, snapDistance);
+				if (start == INDEX_NONE) {
+					continue;
+				}
+				int32 goal = graph->FindNearestNode(query.goal, snapDistance);
+				result.bSuccess = goal != INDEX_NONE && graph->FindPath(start, goal, maxVisits, result.path);
+				break;
+			}
+			results->Enqueue(MoveTemp(result));
+		}
+	});
+}
+
+ETickableTickType UGravityNavSubsystem::GetTickableTickType() const {
+	// The CDO should never be ticked.
+	return IsTemplate() ? ETickableTickType::Never : ETickableTickType::Conditional;
+}
+
+bool UGravityNavSubsystem::IsTickable() const {
+	return callbacks.Num() > 0;
+}
+
+UWorld* UGravityNavSubsystem::GetTickableGameObjectWorld() const {
+	return GetWorld();
+}
+
+TStatId UGravityNavSubsystem::GetStatId() const {
+	RETURN_QUICK_DECLARE_CYCLE_STAT(UGravityNavSubsystem, STATGROUP_Tickables);
+}
@@ -0,0 +1,150 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "GravityNavVolume.h"
+#include "GravityNavSubsystem.h"
+#include "PhysicsSubsystem.h"
+#include "Components/BoxComponent.h"
+#include "Engine/World.h"
+
+// Neighbouring cells, straight and diagonal.
+static const int32 NeighbourOffsets[][2] = {{1, 0}, {-1, 0}, {0, 1}, {0, -1}, {1, 1}, {1, -1}, {-1, 1}, {-1, -1}};
+
+AGravityNavVolume::AGravityNavVolume()
+{
+	PrimaryActorTick.bCanEverTick = false;
+
+	Bounds = CreateDefaultSubobject<UBoxComponent>(TEXT("Bounds"));
+	Bounds->InitBoxExtent(FVector{2000, 2000, 1000});
+	Bounds->SetCollisionEnabled(ECollisionEnabled::NoCollision);
+	Bounds->SetCanEverAffectNavigation(false);
+	RootComponent = Bounds;
+
+	CellSize = 50.0f;
+	AgentRadius = 34.0f;
+	AgentHalfHeight = 88.0f;
+	StepHeight = 45.0f;
+	WalkableFloorZ = 0.71f;
+	MaxLayersPerColumn = 8;
+}
+
+void AGravityNavVolume::BeginPlay()
+{
+	Super::BeginPlay();
+	navigation = GetWorld()->GetSubsystem<UGravityNavSubsystem>();
+	if (navigation != nullptr) {
+		navigation->RegisterVolume(this);
+	}
+}
+
+void AGravityNavVolume::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	if (navigation != nullptr) {
+		navigation->UnregisterVolume(this);
+	}
+	Super::EndPlay(EndPlayReason);
+}
+
+#if WITH_EDITOR
+void AGravityNavVolume::BuildGraphs()
+{
+	Modify();
+	Graphs.Reset();
+	for (int32 i = 0; i < UPhysicsSubsystem::GetGravityOrientationCount(); i++) {
+		BuildGraph(i, Graphs.AddDefaulted_GetRef());
+		UE_LOG(LogGravityNav, Log, TEXT("%s: orientation %d has %d nodes and %d edges."), *GetName(), i, Graphs.Last().Nodes.Num(), Graphs.Last().Edges.Num());
+	}
+}
+
+void AGravityNavVolume::BuildGraph(int32 orientation, FGravityNavGraph& graph) const
+{
+	UWorld* world = GetWorld();
+	const FVector down = UPhysicsSubsystem::GetGravityOrientationDirection(orientation).GetSafeNormal();
+	const FVector up = -down;
+	const FQuat rotation = UPhysicsSubsystem::ComputeOrientationFromGravity(down);
+
+	// The volume's corners in the graph's frame, which has Z pointing up.
+	FBox local(ForceInit);
+	const FTransform& volume = Bounds->GetComponentTransform();
+	const FVector extent = Bounds->GetUnscaledBoxExtent();
+	for (int32 corner = 0; corner < 8; corner++) {
+		FVector point{(corner & 1) ? extent.X : -extent.X, (corner & 2) ? extent.Y : -extent.Y, (corner & 4) ? extent.Z : -extent.Z};
+		local += rotation.UnrotateVector(volume.TransformPosition(point));
+	}
+
+	graph.Orientation = orientation;
+	graph.CellSize = CellSize;
+	graph.Frame = FTransform(rotation, rotation.RotateVector(local.Min));
+	const FVector size = local.GetSize();
+	const int32 columns = FMath::Min(FMath::CeilToInt(size.X / CellSize) + 1, int32(MAX_uint16));
+	const int32 rows = FMath::Min(FMath::CeilToInt(size.Y / CellSize) + 1, int32(MAX_uint16));
+
+	// Only static geometry counts, since anything that moves won't be where it was when we baked.
+	FCollisionObjectQueryParams floors(ECC_WorldStatic);
+	FCollisionQueryParams params(SCENE_QUERY_STAT(GravityNavBuild), false, this);
+	const FCollisionShape agent = FCollisionShape::MakeCapsule(AgentRadius, AgentHalfHeight);
+
+	// Find every floor in every column, top down.
+	TMap<uint32, TArray<int32, TInlineAllocator<2>>> cells;
+	for (int32 x = 0; x < columns; x++) {
+		for (int32 y = 0; y < rows; y++) {
+			FVector start = graph.Frame.TransformPosition(FVector{x * CellSize, y * CellSize, size.Z});
+			const FVector end = graph.Frame.TransformPosition(FVector{x * CellSize, y * CellSize, 0.0f});
+			for (int32 layer = 0; layer < MaxLayersPerColumn; layer++) {
+				FHitResult hit;
+				if (!world->LineTraceSingleByObjectType(hit, start, end, floors, params)) {
+					break;
+				}
+				// Tracing on from just under a floor starts inside it, which just hits it again. Step through and carry on.
+				start = hit.ImpactPoint + down * (hit.bStartPenetrating ? AgentHalfHeight : 1.0f);
+				if (hit.bStartPenetrating || FVector::DotProduct(hit.ImpactNormal, up) < WalkableFloorZ) {
+					continue;
+				}
+				// Room to stand, with the capsule turned to match gravity.
+				FVector center = hit.ImpactPoint + up * (AgentHalfHeight + 1.0f);
+				if (world->OverlapAnyTestByObjectType(center, rotation, floors, agent, params)) {
+					continue;
+				}
+				FGravityNavNode node;
+				node.X = x;
+				node.Y = y;
+				node.Height = graph.Frame.InverseTransformPosition(hit.ImpactPoint).Z;
+				cells.FindOrAdd(uint32(x) << 16 | uint32(y)).Add(graph.Nodes.Add(node));
+			}
+		}
+	}
+
+	// Link each node to the closest floor in each neighbouring column, if it can step or walk up to it without a wall in the way.
+	const float maxSlope = FMath::Tan(FMath::Acos(FMath::Clamp(WalkableFloorZ, 0.0f, 1.0f)));
+	graph.FirstEdge.SetNumUninitialized(graph.Nodes.Num() + 1);
+	for (int32 i = 0; i < graph.Nodes.Num(); i++) {
+		graph.FirstEdge[i] = graph.Edges.Num();
+		const FGravityNavNode& node = graph.Nodes[i];
+		const FVector from = graph.GetNodeLocation(i) + up * StepHeight;
+		for (const auto& offset : NeighbourOffsets) {
+			int32 x = node.X + offset[0];
+			int32 y = node.Y + offset[1];
+			const TArray<int32, TInlineAllocator<2>>* neighbours = x >= 0 && y >= 0 ? cells.Find(uint32(x) << 16 | uint32(y)) : nullptr;
+			if (neighbours == nullptr) {
+				continue;
+			}
+			const float distance = CellSize * FMath::Sqrt(float(offset[0] * offset[0] + offset[1] * offset[1]));
+			const float maxRise = StepHeight + distance * maxSlope;
+
+			int32 best = INDEX_NONE;
+			float bestRise = MAX_FLT;
+			for (int32 neighbour : *neighbours) {
+				float rise = FMath::Abs(graph.Nodes[neighbour].Height - node.Height);
+				if (rise <= maxRise && rise < bestRise) {
+					best = neighbour;
+					bestRise = rise;
+				}
+			}
+			if (best != INDEX_NONE && !world->LineTraceTestByObjectType(from, graph.GetNodeLocation(best) + up * StepHeight, floors, params)) {
+				graph.Edges.Add(best);
+			}
+		}
+	}
+	graph.FirstEdge[graph.Nodes.Num()] = graph.Edges.Num();
+}
+#endif
@@ -0,0 +1,139 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "GravityPropCollection.h"
+#include "BoardingAction.h"
+#include "PhysicsSubsystem.h"
+#include "PhysicsEngine/BodySetup.h"
+#include "Engine/CollisionProfile.h"
+#include "Engine/World.h"
+
+DECLARE_CYCLE_STAT(TEXT("Prop Collection Sync"), STAT_PropCollectionSync, STATGROUP_BoardingActionGravity);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Prop Instances Moved"), STAT_PropInstancesMoved, STATGROUP_BoardingActionGravity);
+
+UGravityPropCollection::UGravityPropCollection() {
+	// Runs after physics so the instances show where the bodies are this frame, not last frame.
+	PrimaryComponentTick.bCanEverTick = true;
+	PrimaryComponentTick.TickGroup = TG_PostPhysics;
+
+	Mobility = EComponentMobility::Movable;
+	SetCollisionProfileName(UCollisionProfile::PhysicsActor_ProfileName);
+	// Gravity comes from UPhysicsSubsystem, which turns the scene's back on itself if it's in Solver mode.
+	BodyInstance.bEnableGravity = false;
+	// Nothing in here stays put long enough to be worth baking into the nav mesh.
+	bCanEverAffectNavigation = false;
+
+	GravityScale = 1.0f;
+	bUseSolverGravity = true;
+}
+
+bool UGravityPropCollection::ShouldCreatePhysicsState() const {
+	UWorld* world = GetWorld();
+	if (world != nullptr && world->IsGameWorld()) {
+		return false;
+	}
+	return Super::ShouldCreatePhysicsState();
+}
+
+void UGravityPropCollection::BeginPlay() {
+	Super::BeginPlay();
+
+	CreateInstanceBodies();
+	worldPhysics = GetWorld()->GetSubsystem<UPhysicsSubsystem>();
+	if (worldPhysics != nullptr) {
+		for (int32 i = 0; i < InstanceBodies.Num(); i++) {
+			if (InstanceBodies[i] != nullptr) {
+				worldPhysics->RegisterInstanceBody(this, i, GravityScale, bUseSolverGravity);
+			}
+		}
+	}
+
+	// Servers still simulate the bodies, but nobody's looking at the instances.
+	SetComponentTickEnabled(!IsNetMode(NM_DedicatedServer));
+}
+
+void UGravityPropCollection::EndPlay(const EEndPlayReason::Type EndPlayReason) {
+	if (worldPhysics != nullptr) {
+		for (int32 i = 0; i < InstanceBodies.Num(); i++) {
+			worldPhysics->UnregisterInstanceBody(this, i);
+		}
+	}
+	DestroyInstanceBodies();
+	Super::EndPlay(EndPlayReason);
+}
+
+void UGravityPropCollection::CreateInstanceBodies() {
+	FPhysScene* scene = GetWorld()->GetPhysicsScene();
+	UBodySetup* bodySetup = GetBodySetup();
+	if (scene == nullptr || bodySetup == nullptr) {
+		return;
+	}
+
+	// Same as UInstancedStaticMeshComponent does for its own instance bodies, except that ours simulate.
+	const int32 count = PerInstanceSMData.Num();
+	InstanceBodies.SetNumZeroed(count);
+	instanceScales.SetNumUninitialized(count);
+	for (int32 i = 0; i < count; i++) {
+		const FTransform transform = FTransform(PerInstanceSMData[i].Transform) * GetComponentTransform();
+		instanceScales[i] = transform.GetScale3D();
+		if (instanceScales[i].IsNearlyZero()) {
+			continue;
+		}
+		FBodyInstance* body = new FBodyInstance();
+		body->CopyBodyInstancePropertiesFrom(&BodyInstance);
+		// Hits and overlaps report this as the Item, which is how everything else finds its way back to the instance.
+		body->InstanceBodyIndex = i;
+		body->bAutoWeld = false;
+		body->bSimulatePhysics = true;
+		body->InitBody(bodySetup, transform, this, scene);
+		InstanceBodies[i] = body;
+	}
+}
+
+void UGravityPropCollection::DestroyInstanceBodies() {
+	for (FBodyInstance*& body : InstanceBodies) {
+		if (body != nullptr) {
+			body->TermBody();
+			delete body;
+			body = nullptr;
+		}
+	}
+	InstanceBodies.Empty();
+	instanceScales.Empty();
+}
+
+void UGravityPropCollection::TeleportInstance(int32 instance, const FTransform& transform) {
+	if (!PerInstanceSMData.IsValidIndex(instance)) {
+		return;
+	}
+	FTransform scaled = transform;
+	scaled.SetScale3D(instanceScales.IsValidIndex(instance) ? instanceScales[instance] : FTransform(PerInstanceSMData[instance].Transform).GetScale3D());
+	if (FBodyInstance* body = InstanceBodies.IsValidIndex(instance) ? InstanceBodies[instance] : nullptr) {
+		body->SetBodyTransform(scaled, ETeleportType::TeleportPhysics);
+	}
+	// A sleeping body won't get picked up by the tick, so the instance has to move now.
+	UpdateInstanceTransform(instance, scaled, true, true, true);
+}
+
+void UGravityPropCollection::TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction) {
+	Super::TickComponent(DeltaTime, TickType, ThisTickFunction);
+	SCOPE_CYCLE_COUNTER(STAT_PropCollectionSync);
+	TRACE_CPUPROFILER_EVENT_SCOPE(UGravityPropCollection::Sync);
+
+	// Sleeping bodies haven't moved, so most frames most of a settled pile gets skipped.
+	int32 moved = 0;
+	for (int32 i = 0; i < InstanceBodies.Num(); i++) {
+		FBodyInstance* body = InstanceBodies[i];
+		if (body == nullptr || !body->IsInstanceAwake()) {
+			continue;
+		}
+		FTransform transform = body->GetUnrealWorldTransform();
+		transform.SetScale3D(instanceScales[i]);
+		UpdateInstanceTransform(i, transform, true, false, true);
+		moved++;
+	}
+	if (moved > 0) {
+		MarkRenderStateDirty();
+	}
+	INC_DWORD_STAT_BY(STAT_PropInstancesMoved, moved);
+}
@@ -2,13 +2,13 @@
 
 
 #include "PawnGravityController.h"
+#include "GravityMovementComponent.h"
 
 // Sets default values for this component's properties
 UPawnGravityController::UPawnGravityController()
 {
-	// Set this component to be initialized when the game starts, and to be ticked every frame.  You can turn these features
-	// off to improve performance if you don't need them.
-	PrimaryComponentTick.bCanEverTick = true;
+	// Gravity is applied by the UPhysicsSubsystem's batched pass, so there's no need for a tick of our own.
+	PrimaryComponentTick.bCanEverTick = false;
 
 	// ...
 }
@@ -17,19 +17,22 @@ UPawnGravityController::UPawnGravityController()
 // Called when the game starts
 void UPawnGravityController::BeginPlay()
 {
+	// We need the mover before the base class registers us.
+	mover = GetOwner()->FindComponentByClass<UCharacterMovementComponent>();
 	Super::BeginPlay();
-	mover = parent->FindComponentByClass<UCharacterMovementComponent>();
-
-	// ...
-	
 }
 
 
-// Called every frame
-void UPawnGravityController::TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction)
-{
-	Super::TickComponent(DeltaTime, TickType, ThisTickFunction);
-	mover->AddImpulse(worldPhysics->GetGravity(), true);
-	// ...
+void UPawnGravityController::RegisterWithSubsystem() {
+	// A UGravityMovementComponent handles gravity (and its own registration) by itself, so there's nothing for us to do.
+	if (worldPhysics != nullptr && mover != nullptr && !mover->IsA<UGravityMovementComponent>()) {
+		worldPhysics->RegisterMover(mover);
+	}
+}
+
+void UPawnGravityController::UnregisterFromSubsystem() {
+	if (worldPhysics != nullptr && mover != nullptr && !mover->IsA<UGravityMovementComponent>()) {
+		worldPhysics->UnregisterMover(mover);
+	}
 }
 
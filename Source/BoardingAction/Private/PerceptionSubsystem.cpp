@@ -0,0 +1,187 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "PerceptionSubsystem.h"
+#include "BoardingAction.h"
+#include "Engine/World.h"
+
+DECLARE_CYCLE_STAT(TEXT("Perception"), STAT_Perception, STATGROUP_BoardingActionEnemies);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Perception Requests"), STAT_PerceptionRequests, STATGROUP_BoardingActionEnemies);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Perception Traces"), STAT_PerceptionTraces, STATGROUP_BoardingActionEnemies);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Perception Budget Overrun"), STAT_PerceptionOverrun, STATGROUP_BoardingActionEnemies);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Perception Cached Pairs"), STAT_PerceptionPairs, STATGROUP_BoardingActionEnemies);
+
+// How often the cache is swept for pairs nobody's asking about, in seconds.
+static const float ForgetSweepInterval = 1.0f;
+
+UPerceptionSubsystem::UPerceptionSubsystem() {
+	TraceBudgetPerFrame = 64;
+	MaxStaleness = 0.25f;
+	ForgetAfter = 5.0f;
+	TraceChannel = ECC_Visibility;
+}
+
+void UPerceptionSubsystem::Initialize(FSubsystemCollectionBase& Collection) {
+	queryParams = FCollisionQueryParams(SCENE_QUERY_STAT(Perception), false);
+}
+
+void UPerceptionSubsystem::Deinitialize() {
+	entries.Empty();
+	queue.Empty();
+	inFlight.Empty();
+}
+
+bool UPerceptionSubsystem::CanSee(AActor* observer, AActor* target, float* outAge) {
+	if (observer == nullptr || target == nullptr) {
+		return false;
+	}
+	INC_DWORD_STAT(STAT_PerceptionRequests);
+
+	const double now = GetWorld()->GetTimeSeconds();
+	FPerceptionKey key{observer, target};
+	FPerceptionEntry& entry = entries.FindOrAdd(key);
+	entry.requestedTime = now;
+
+	const float age = entry.bEverTraced ? float(now - entry.tracedTime) : MAX_FLT;
+	if (age > MaxStaleness && !entry.bQueued && !entry.trace.IsValid()) {
+		entry.bQueued = true;
+		queue.Add(key);
+	}
+	if (outAge != nullptr) {
+		*outAge = age;
+	}
+	return entry.bVisible;
+}
+
+void UPerceptionSubsystem::RemoveObserver(AActor* observer) {
+	for (auto it = entries.CreateIterator(); it; ++it) {
+		if (it.Key().Key == observer) {
+			it.RemoveCurrent();
+		}
+	}
+	// Whatever's left in the queues for it is skipped once its entry can't be found.
+}
+
+void UPerceptionSubsystem::Tick(float DeltaTime) {
+	SCOPE_CYCLE_COUNTER(STAT_Perception);
+
+	ResolveTraces();
+	SendTraces();
+
+	timeSinceForget += DeltaTime;
+	if (timeSinceForget >= ForgetSweepInterval) {
+		timeSinceForget = 0.0;
+		ForgetUnused();
+	}
+	SET_DWORD_STAT(STAT_PerceptionPairs, entries.Num());
+}
+
+void UPerceptionSubsystem::ResolveTraces() {
+	UWorld* world = GetWorld();
+	const double now = world->GetTimeSeconds();
+	FTraceDatum datum;
+	for (int32 i = inFlight.Num() - 1; i >= 0; i--) {
+		FPerceptionEntry* entry = entries.Find(inFlight[i]);
+		// No trace on the entry means this is left over from an entry that's since been dropped and asked for again.
+		if (entry == nullptr || !entry->trace.IsValid()) {
+			inFlight.RemoveAtSwap(i, 1, false);
+			continue;
+		}
+		if (!world->QueryTraceData(entry->trace, datum)) {
+			// Async traces only live for a frame, so if it isn't ready now it never will be. Try again.
+			if (!world->IsTraceHandleValid(entry->trace, false)) {
+				entry->trace = FTraceHandle();
+				if (!entry->bQueued) {
+					entry->bQueued = true;
+					queue.Add(inFlight[i]);
+				}
+				inFlight.RemoveAtSwap(i, 1, false);
+			}
+			continue;
+		}
+		entry->trace = FTraceHandle();
+		entry->bVisible = !datum.OutHits.ContainsByPredicate([](const FHitResult& hit) { return hit.bBlockingHit; });
+		entry->bEverTraced = true;
+		entry->tracedTime = now;
+		inFlight.RemoveAtSwap(i, 1, false);
+	}
+}
+
+void UPerceptionSubsystem::SendTraces() {
+	if (queue.Num() == 0) {
+		return;
+	}
+
+	// Pairs that have never been traced go first, then whichever answer is oldest.
+	queue.Sort([this](const FPerceptionKey& a, const FPerceptionKey& b) {
+		const FPerceptionEntry* entryA = entries.Find(a);
+		const FPerceptionEntry* entryB = entries.Find(b);
+		const double timeA = entryA != nullptr && entryA->bEverTraced ? entryA->tracedTime : -1.0;
+		const double timeB = entryB != nullptr && entryB->bEverTraced ? entryB->tracedTime : -1.0;
+		return timeA < timeB;
+	});
+
+	UWorld* world = GetWorld();
+	int32 sent = 0;
+	int32 handled = 0;
+	for (; handled < queue.Num() && sent < TraceBudgetPerFrame; handled++) {
+		const FPerceptionKey& key = queue[handled];
+		FPerceptionEntry* entry = entries.Find(key);
+		AActor* observer = key.Key.Get();
+		AActor* target = key.Value.Get();
+		if (entry == nullptr || observer == nullptr || target == nullptr) {
+			entries.Remove(key);
+			continue;
+		}
+		// Already sent by an earlier copy of the same pair.
+		if (!entry->bQueued) {
+			continue;
+		}
+		entry->bQueued = false;
+
+		FVector eyes;
+		FRotator rotation;
+		observer->GetActorEyesViewPoint(eyes, rotation);
+		FCollisionQueryParams params = queryParams;
+		params.AddIgnoredActor(observer);
+		params.AddIgnoredActor(target);
+		entry->trace = world->AsyncLineTraceByChannel(EAsyncTraceType::Single, eyes, target->GetActorLocation(), TraceChannel, params);
+		inFlight.Add(key);
+		sent++;
+	}
+	queue.RemoveAt(0, handled, false);
+
+	INC_DWORD_STAT_BY(STAT_PerceptionTraces, sent);
+	// Whatever's still queued has to wait for a later frame, and gets staler while it does.
+	INC_DWORD_STAT_BY(STAT_PerceptionOverrun, queue.Num());
+}
+
+void UPerceptionSubsystem::ForgetUnused() {
+	const double cutoff = GetWorld()->GetTimeSeconds() - ForgetAfter;
+	for (auto it = entries.CreateIterator(); it; ++it) {
+		// Pairs that are still queued or in flight are kept until they're done, or asking for them again would make a
+		// new entry that queues them a second time. Once either actor is gone nobody can ask again.
+		const FPerceptionEntry& entry = it.Value();
+		const bool bPending = entry.bQueued || entry.trace.IsValid();
+		if ((entry.requestedTime < cutoff && !bPending) || !it.Key().Key.IsValid() || !it.Key().Value.IsValid()) {
+			it.RemoveCurrent();
+		}
+	}
+}
+
+ETickableTickType UPerceptionSubsystem::GetTickableTickType() const {
+	// The CDO should never be ticked.
+	return IsTemplate() ? ETickableTickType::Never : ETickableTickType::Conditional;
+}
+
+bool UPerceptionSubsystem::IsTickable() const {
+	return entries.Num() > 0 || inFlight.Num() > 0;
+}
+
+UWorld* UPerceptionSubsystem::GetTickableGameObjectWorld() const {
+	return GetWorld();
+}
+
+TStatId UPerceptionSubsystem::GetStatId() const {
+	RETURN_QUICK_DECLARE_CYCLE_STAT(UPerceptionSubsystem, STATGROUP_Tickables);
+}
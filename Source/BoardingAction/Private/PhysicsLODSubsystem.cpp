@@ -0,0 +1,305 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "PhysicsLODSubsystem.h"
+#include "BoardingAction.h"
+#include "PhysicsSubsystem.h"
+#include "GameFramework/PlayerController.h"
+#include "Engine/World.h"
+
+DECLARE_CYCLE_STAT(TEXT("Physics LOD Update"), STAT_PhysicsLODUpdate, STATGROUP_BoardingActionGravity);
+DECLARE_CYCLE_STAT(TEXT("Physics LOD Ballistic Step"), STAT_PhysicsLODStep, STATGROUP_BoardingActionGravity);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Physics LOD Ballistic Bodies"), STAT_PhysicsLODBallistic, STATGROUP_BoardingActionGravity);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Physics LOD Demotions"), STAT_PhysicsLODDemotions, STATGROUP_BoardingActionGravity);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Physics LOD Promotions"), STAT_PhysicsLODPromotions, STATGROUP_BoardingActionGravity);
+
+TRACE_DECLARE_INT_COUNTER(PhysicsLODBallisticCounter, TEXT("BoardingAction/Physics LOD Ballistic Bodies"));
+
+// Bodies going slower than this (cm/s) are about to settle, and the physics scene will put them to sleep, so there's
+// nothing to gain from taking them out of it.
+static const float MinDemoteSpeed = 10.0f;
+
+UPhysicsLODSubsystem::UPhysicsLODSubsystem() {
+	DemoteDistance = 8000.0f;
+	PromoteDistance = 6000.0f;
+	UpdateInterval = 0.25f;
+	MaxTransitionsPerUpdate = 32;
+	SettleTime = 5.0f;
+}
+
+void UPhysicsLODSubsystem::Initialize(FSubsystemCollectionBase& Collection) {
+	worldPhysics = Cast<UPhysicsSubsystem>(Collection.InitializeDependency(UPhysicsSubsystem::StaticClass()));
+	queryParams = FCollisionQueryParams(SCENE_QUERY_STAT(PhysicsLOD), false);
+	ballisticCount = 0;
+	timeSinceUpdate = 0.0f;
+}
+
+void UPhysicsLODSubsystem::Deinitialize() {
+	bodies.Empty();
+	scales.Empty();
+	allowSolverGravity.Empty();
+	ballistic.Empty();
+	settleUntil.Empty();
+	pathOrigins.Empty();
+	pathVelocities.Empty();
+	pathRotations.Empty();
+	pathAngularVelocities.Empty();
+	pathAccelerations.Empty();
+	pathTimes.Empty();
+	lastLocations.Empty();
+	sweeps.Empty();
+	ballisticCount = 0;
+	worldPhysics = nullptr;
+}
+
+void UPhysicsLODSubsystem::RegisterBody(UPrimitiveComponent* body, float gravityScale, bool bAllowSolverGravity) {
+	if (body == nullptr || bodies.Contains(body)) {
+		return;
+	}
+	bodies.Add(body);
+	scales.Add(gravityScale);
+	allowSolverGravity.Add(bAllowSolverGravity);
+	ballistic.Add(false);
+	settleUntil.Add(0.0f);
+	pathOrigins.Add(FVector::ZeroVector);
+	pathVelocities.Add(FVector::ZeroVector);
+	pathRotations.Add(FQuat::Identity);
+	pathAngularVelocities.Add(FVector::ZeroVector);
+	pathAccelerations.Add(FVector::ZeroVector);
+	pathTimes.Add(0.0f);
+	lastLocations.Add(FVector::ZeroVector);
+	sweeps.Add(FTraceHandle());
+}
+
+void UPhysicsLODSubsystem::UnregisterBody(UPrimitiveComponent* body) {
+	int32 index = bodies.Find(body);
+	if (index == INDEX_NONE) {
+		return;
+	}
+	if (ballistic[index] && IsValid(body)) {
+		Promote(index);
+	}
+	RemoveAtSwap(index);
+}
+
+void UPhysicsLODSubsystem::RemoveAtSwap(int32 index) {
+	if (ballistic[index]) {
+		ballisticCount--;
+	}
+	bodies.RemoveAtSwap(index, 1, false);
+	scales.RemoveAtSwap(index, 1, false);
+	allowSolverGravity.RemoveAtSwap(index, 1, false);
+	ballistic.RemoveAtSwap(index, 1, false);
+	settleUntil.RemoveAtSwap(index, 1, false);
+	pathOrigins.RemoveAtSwap(index, 1, false);
+	pathVelocities.RemoveAtSwap(index, 1, false);
+	pathRotations.RemoveAtSwap(index, 1, false);
+	pathAngularVelocities.RemoveAtSwap(index, 1, false);
+	pathAccelerations.RemoveAtSwap(index, 1, false);
+	pathTimes.RemoveAtSwap(index, 1, false);
+	lastLocations.RemoveAtSwap(index, 1, false);
+	sweeps.RemoveAtSwap(index, 1, false);
+}
+
+FVector UPhysicsLODSubsystem::GetPathLocation(int32 index) const {
+	const float t = pathTimes[index];
+	return pathOrigins[index] + pathVelocities[index] * t + pathAccelerations[index] * (0.5f * t * t);
+}
+
+FVector UPhysicsLODSubsystem::GetPathVelocity(int32 index) const {
+	return pathVelocities[index] + pathAccelerations[index] * pathTimes[index];
+}
+
+FQuat UPhysicsLODSubsystem::GetPathRotation(int32 index) const {
+	// Nothing's acting on the spin, so it keeps turning at the same rate around the same axis.
+	const FVector& angular = pathAngularVelocities[index];
+	const float speed = angular.Size();
+	if (speed < KINDA_SMALL_NUMBER) {
+		return pathRotations[index];
+	}
+	return FQuat(angular / speed, speed * pathTimes[index]) * pathRotations[index];
+}
+
+void UPhysicsLODSubsystem::Demote(int32 index) {
+	UPrimitiveComponent* body = bodies[index];
+	pathOrigins[index] = body->GetComponentLocation();
+	pathVelocities[index] = body->GetPhysicsLinearVelocity();
+	pathRotations[index] = body->GetComponentQuat();
+	pathAngularVelocities[index] = body->GetPhysicsAngularVelocityInRadians();
+	pathAccelerations[index] = worldPhysics->GravityToAcceleration(worldPhysics->GetGravityAt(pathOrigins[index])) * scales[index];
+	pathTimes[index] = 0.0f;
+	lastLocations[index] = pathOrigins[index];
+	sweeps[index] = FTraceHandle();
+
+	// Out of the gravity pass too, since we're the ones moving it now.
+	worldPhysics->UnregisterBody(body);
+	body->SetSimulatePhysics(false);
+	ballistic[index] = true;
+	ballisticCount++;
+	INC_DWORD_STAT(STAT_PhysicsLODDemotions);
+}
+
+void UPhysicsLODSubsystem::Promote(int32 index, const FVector* location) {
+	UPrimitiveComponent* body = bodies[index];
+	body->SetWorldLocationAndRotation(location != nullptr ? *location : GetPathLocation(index), GetPathRotation(index), false, nullptr, ETeleportType::TeleportPhysics);
+	body->SetSimulatePhysics(true);
+	body->SetPhysicsLinearVelocity(GetPathVelocity(index));
+	body->SetPhysicsAngularVelocityInRadians(pathAngularVelocities[index]);
+	worldPhysics->RegisterBody(body, scales[index], allowSolverGravity[index]);
+	ballistic[index] = false;
+	ballisticCount--;
+	sweeps[index] = FTraceHandle();
+	INC_DWORD_STAT(STAT_PhysicsLODPromotions);
+}
+
+void UPhysicsLODSubsystem::Tick(float DeltaTime) {
+	TRACE_CPUPROFILER_EVENT_SCOPE(UPhysicsLODSubsystem::Tick);
+
+	// Anything destroyed without unregistering gets nulled out by GC.
+	for (int32 i = bodies.Num() - 1; i >= 0; i--) {
+		if (!IsValid(bodies[i])) {
+			RemoveAtSwap(i);
+		}
+	}
+
+	ResolveSweeps();
+
+	timeSinceUpdate += DeltaTime;
+	if (timeSinceUpdate >= UpdateInterval) {
+		timeSinceUpdate = 0.0f;
+		UpdateLOD();
+	}
+
+	StepBallistic(DeltaTime);
+
+	SET_DWORD_STAT(STAT_PhysicsLODBallistic, ballisticCount);
+	TRACE_COUNTER_SET(PhysicsLODBallisticCounter, ballisticCount);
+	CSV_CUSTOM_STAT(BoardingAction, PhysicsLODBallistic, ballisticCount, ECsvCustomStatOp::Set);
+}
+
+void UPhysicsLODSubsystem::UpdateLOD() {
+	SCOPE_CYCLE_COUNTER(STAT_PhysicsLODUpdate);
+
+	playerLocations.Reset();
+	for (FConstPlayerControllerIterator it = GetWorld()->GetPlayerControllerIterator(); it; ++it) {
+		if (APawn* pawn = it->IsValid() ? (*it)->GetPawn() : nullptr) {
+			playerLocations.Add(pawn->GetActorLocation());
+		}
+	}
+	// Nobody to be far away from.
+	if (playerLocations.Num() == 0) {
+		return;
+	}
+
+	const float now = GetWorld()->GetTimeSeconds();
+	int32 budget = MaxTransitionsPerUpdate;
+	for (int32 i = 0; i < bodies.Num() && budget > 0; i++) {
+		const FVector location = ballistic[i] ? GetPathLocation(i) : bodies[i]->GetComponentLocation();
+		float distanceSquared = MAX_FLT;
+		for (const FVector& player : playerLocations) {
+			distanceSquared = FMath::Min(distanceSquared, FVector::DistSquared(player, location));
+		}
+
+		if (ballistic[i]) {
+			if (distanceSquared < FMath::Square(PromoteDistance)) {
+				Promote(i);
+				budget--;
+			}
+		}
+		else if (distanceSquared > FMath::Square(DemoteDistance) && now >= settleUntil[i]) {
+			UPrimitiveComponent* body = bodies[i];
+			if (body->IsSimulatingPhysics() && body->RigidBodyIsAwake() && body->GetPhysicsLinearVelocity().SizeSquared() > FMath::Square(MinDemoteSpeed)) {
+				Demote(i);
+				budget--;
+			}
+		}
+	}
+}
+
+void UPhysicsLODSubsystem::ResolveSweeps() {
+	UWorld* world = GetWorld();
+	FTraceDatum datum;
+	for (int32 i = 0; i < bodies.Num(); i++) {
+		if (!ballistic[i] || !sweeps[i].IsValid() || !world->QueryTraceData(sweeps[i], datum)) {
+			continue;
+		}
+		sweeps[i] = FTraceHandle();
+		const FHitResult* hit = datum.OutHits.FindByPredicate([](const FHitResult& result) { return result.bBlockingHit; });
+		if (hit != nullptr) {
+			// It's gone a frame further since then, so put it back where it hit and let the physics scene sort out the contact.
+			const FVector location = hit->Location;
+			Promote(i, &location);
+			settleUntil[i] = world->GetTimeSeconds() + SettleTime;
+		}
+	}
+}
+
+void UPhysicsLODSubsystem::StepBallistic(float DeltaTime) {
+	SCOPE_CYCLE_COUNTER(STAT_PhysicsLODStep);
+	if (ballisticCount == 0) {
+		return;
+	}
+
+	stepIndices.Reset();
+	stepLocations.Reset();
+	for (int32 i = 0; i < bodies.Num(); i++) {
+		if (ballistic[i]) {
+			pathTimes[i] += DeltaTime;
+			stepIndices.Add(i);
+			stepLocations.Add(GetPathLocation(i));
+		}
+	}
+	stepGravity.SetNumUninitialized(stepLocations.Num(), false);
+	worldPhysics->GetGravityAtLocations(stepLocations, stepGravity);
+
+	UWorld* world = GetWorld();
+	const FCollisionObjectQueryParams objectParams(ECC_WorldStatic);
+	for (int32 k = 0; k < stepIndices.Num(); k++) {
+		const int32 i = stepIndices[k];
+		// Gravity changed, or the body moved into a field, so a new path starts from wherever it's got to.
+		const FVector acceleration = worldPhysics->GravityToAcceleration(stepGravity[k]) * scales[i];
+		if (!acceleration.Equals(pathAccelerations[i])) {
+			const FVector velocity = GetPathVelocity(i);
+			const FQuat rotation = GetPathRotation(i);
+			pathOrigins[i] = stepLocations[k];
+			pathVelocities[i] = velocity;
+			pathRotations[i] = rotation;
+			pathAccelerations[i] = acceleration;
+			pathTimes[i] = 0.0f;
+		}
+
+		UPrimitiveComponent* body = bodies[i];
+		body->SetWorldLocationAndRotation(stepLocations[k], GetPathRotation(i), false, nullptr, ETeleportType::TeleportPhysics);
+
+		// The smallest half extent, so grazing past something doesn't count but running into it still does.
+		const float radius = body->Bounds.BoxExtent.GetMin();
+		// The sweep starts inside the body, so it has to be ignored or it's all the sweep would ever hit. When the body
+		// is the whole prop, anything else on its actor is part of it too. Otherwise the actor is something bigger
+		// (like a ship section) whose other parts are real obstacles.
+		FCollisionQueryParams params = queryParams;
+		params.AddIgnoredComponent(body);
+		AActor* owner = body->GetOwner();
+		if (owner != nullptr && owner->GetRootComponent() == body) {
+			params.AddIgnoredActor(owner);
+		}
+		sweeps[i] = world->AsyncSweepByObjectType(EAsyncTraceType::Single, lastLocations[i], stepLocations[k], FQuat::Identity, objectParams, FCollisionShape::MakeSphere(radius), params);
+		lastLocations[i] = stepLocations[k];
+	}
+}
+
+ETickableTickType UPhysicsLODSubsystem::GetTickableTickType() const {
+	// The CDO should never be ticked.
+	return IsTemplate() ? ETickableTickType::Never : ETickableTickType::Conditional;
+}
+
+bool UPhysicsLODSubsystem::IsTickable() const {
+	return bodies.Num() > 0;
+}
+
+UWorld* UPhysicsLODSubsystem::GetTickableGameObjectWorld() const {
+	return GetWorld();
+}
+
+TStatId UPhysicsLODSubsystem::GetStatId() const {
+	RETURN_QUICK_DECLARE_CYCLE_STAT(UPhysicsLODSubsystem, STATGROUP_Tickables);
+}
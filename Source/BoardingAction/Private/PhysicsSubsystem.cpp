@@ -2,52 +2,1007 @@
 
 
 #include "PhysicsSubsystem.h"
+#include "BoardingAction.h"
+#include "GameFramework/CharacterMovementComponent.h"
+#include "GameFramework/PlayerController.h"
+#include "Engine/World.h"
+#include "PhysicsPublic.h"
+#if PHYSICS_INTERFACE_PHYSX
+#include "PhysXPublic.h"
+#elif WITH_CHAOS
+#include "PhysicsSolver.h"
+#endif
+
+DEFINE_LOG_CATEGORY_STATIC(LogPhysicsSubsystem, Log, All);
+
+DECLARE_CYCLE_STAT(TEXT("Gravity Pass"), STAT_GravityPass, STATGROUP_BoardingActionGravity);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Gravity Bodies Processed"), STAT_GravityBodiesProcessed, STATGROUP_BoardingActionGravity);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Gravity Pending Wake Ups"), STAT_GravityPendingWakes, STATGROUP_BoardingActionGravity);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Gravity Wake Ups"), STAT_GravityWakeUps, STATGROUP_BoardingActionGravity);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Gravity Bodies Awake"), STAT_GravityBodiesAwake, STATGROUP_BoardingActionGravity);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Gravity Bodies Sleeping"), STAT_GravityBodiesSleeping, STATGROUP_BoardingActionGravity);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Gravity Rest Checks"), STAT_GravityRestChecks, STATGROUP_BoardingActionGravity);
+DECLARE_CYCLE_STAT(TEXT("Impulse Flush"), STAT_ImpulseFlush, STATGROUP_BoardingActionGravity);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Impulses Queued"), STAT_ImpulsesQueued, STATGROUP_BoardingActionGravity);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Impulse Bodies Flushed"), STAT_ImpulseBodiesFlushed, STATGROUP_BoardingActionGravity);
+
+TRACE_DECLARE_INT_COUNTER(GravityBodiesCounter, TEXT("BoardingAction/Gravity Bodies"));
+TRACE_DECLARE_INT_COUNTER(GravityBodiesAwakeCounter, TEXT("BoardingAction/Gravity Bodies Awake"));
+TRACE_DECLARE_INT_COUNTER(GravityBodiesSleepingCounter, TEXT("BoardingAction/Gravity Bodies Sleeping"));
+TRACE_DECLARE_INT_COUNTER(GravityPendingWakesCounter, TEXT("BoardingAction/Gravity Pending Wake Ups"));
+TRACE_DECLARE_INT_COUNTER(ImpulseBodiesCounter, TEXT("BoardingAction/Impulse Bodies Flushed"));
+
+// Size of a cell in the gravity field grid. Roughly the size of a ship compartment.
+static const float FieldCellSize = 1000.0f;
+// Fields bigger than this many cells are checked on every lookup instead of being put in the grid.
+static const int32 MaxCellsPerField = 512;
+// Gravity directions are snapped to this many steps per unit before being used as an orientation cache key.
+static const float OrientationQuantization = 1024.0f;
+// A support only holds a body up if its surface faces against gravity by at least this much (as a cosine).
+static const float RestSupportNormal = 0.7f;
+// The orientation cache gets cleared (apart from the canonical orientations) once it grows past this.
+static const int32 MaxCachedOrientations = 4096;
+
+static const FVector GravityOrientations[] = {
+	FVector{0, 0, -1}, FVector{0, 0, 1}, FVector{1, 0, 0}, FVector{-1, 0, 0}, FVector{0, 1, 0}, FVector{0, -1, 0},
+	FVector{1, 1, 0}, FVector{1, -1, 0}, FVector{-1, 1, 0}, FVector{-1, -1, 0},
+	FVector{1, 0, 1}, FVector{1, 0, -1}, FVector{-1, 0, 1}, FVector{-1, 0, -1},
+	FVector{0, 1, 1}, FVector{0, 1, -1}, FVector{0, -1, 1}, FVector{0, -1, -1}
+};
+
+void FGravityBodyRegistry::Add(UPrimitiveComponent* body, int32 item, float scale, bool bEngineGravity) {
+	if (body == nullptr || Contains(body, item)) {
+		return;
+	}
+	indices.Add(TPair<FObjectKey, int32>(body, item), bodies.Add(body));
+	keys.Add(body);
+	items.Add(item);
+	scales.Add(scale);
+	flags.Add(EGravityBodyFlags::None);
+	stillFrames.Add(0);
+	engineGravity.Add(bEngineGravity);
+}
+
+int32 FGravityBodyRegistry::Find(UPrimitiveComponent* body, int32 item) const {
+	const int32* index = indices.Find(TPair<FObjectKey, int32>(body, item));
+	return index != nullptr ? *index : INDEX_NONE;
+}
+
+bool FGravityBodyRegistry::Remove(UPrimitiveComponent* body, int32 item) {
+	const int32 index = Find(body, item);
+	if (index == INDEX_NONE) {
+		return false;
+	}
+	RemoveAt(index);
+	return true;
+}
+
+void FGravityBodyRegistry::RemoveAt(int32 index) {
+	indices.Remove(TPair<FObjectKey, int32>(keys[index], items[index]));
+	bodies.RemoveAtSwap(index, 1, false);
+	keys.RemoveAtSwap(index, 1, false);
+	items.RemoveAtSwap(index, 1, false);
+	scales.RemoveAtSwap(index, 1, false);
+	flags.RemoveAtSwap(index, 1, false);
+	stillFrames.RemoveAtSwap(index, 1, false);
+	engineGravity.RemoveAtSwap(index, 1, false);
+	// Whatever was at the end of the arrays now lives where the removed body used to be.
+	if (bodies.IsValidIndex(index)) {
+		indices[TPair<FObjectKey, int32>(keys[index], items[index])] = index;
+	}
+}
+
+int32 FGravityBodyRegistry::RemoveCollected() {
+	int32 removed = 0;
+	// Backwards, so whatever gets swapped into a removed entry has already been looked at.
+	for (int32 i = bodies.Num() - 1; i >= 0; i--) {
+		if (bodies[i] == nullptr) {
+			RemoveAt(i);
+			removed++;
+		}
+	}
+	return removed;
+}
+
+void FGravityBodyRegistry::Empty() {
+	bodies.Empty();
+	keys.Empty();
+	items.Empty();
+	scales.Empty();
+	flags.Empty();
+	stillFrames.Empty();
+	engineGravity.Empty();
+	indices.Empty();
+}
+
+FBodyInstance* FGravityBodyRegistry::GetBodyInstance(int32 index) const {
+	// The component's own body is what its AddImpulse and friends use, and instanced components hand back the instance's.
+	return IsValid(bodies[index]) ? bodies[index]->GetBodyInstance(NAME_None, true, items[index]) : nullptr;
+}
+
+FVector FGravityBodyRegistry::GetLocation(int32 index) const {
+	if (!IsValid(bodies[index])) {
+		return FVector::ZeroVector;
+	}
+	if (items[index] == INDEX_NONE) {
+		return bodies[index]->GetComponentLocation();
+	}
+	// Instances move independently of the component, so the body's the only place to ask.
+	FBodyInstance* instance = GetBodyInstance(index);
+	return instance != nullptr ? instance->GetUnrealWorldTransform().GetLocation() : FVector::ZeroVector;
+}
+
+void FImpulseAccumulator::AddAtLocation(UPrimitiveComponent* body, int32 item, const FVector& impulse, const FVector& location) {
+	FBodyInstance* instance = body->GetBodyInstance(NAME_None, true, item);
+	if (instance == nullptr) {
+		return;
+	}
+	const TPair<FObjectKey, int32> key(body, item);
+	const int32* found = indices.Find(key);
+	int32 index = found != nullptr ? *found : INDEX_NONE;
+	if (index == INDEX_NONE) {
+		index = bodies.Add(body);
+		items.Add(item);
+		linear.Add(FVector::ZeroVector);
+		angular.Add(FVector::ZeroVector);
+		indices.Add(key, index);
+	}
+	linear[index] += impulse;
+	angular[index] += FVector::CrossProduct(location - instance->GetCOMPosition(), impulse);
+	rawCount++;
+}
+
+void FImpulseAccumulator::Reset() {
+	bodies.Reset();
+	items.Reset();
+	linear.Reset();
+	angular.Reset();
+	indices.Reset();
+	rawCount = 0;
+}
+
+// Pushes an acceleration straight into the physics scene's solver.
+static void SetSceneGravity(FPhysScene* scene, const FVector& acceleration) {
+#if PHYSICS_INTERFACE_PHYSX
+	if (physx::PxScene* pScene = scene->GetPxScene()) {
+		SCOPED_SCENE_WRITE_LOCK(pScene);
+		pScene->setGravity(U2PVector(acceleration));
+	}
+#elif WITH_CHAOS
+	if (Chaos::FPhysicsSolver* solver = scene->GetSolver()) {
+		solver->EnqueueCommandImmediate([solver, acceleration]() {
+			solver->GetEvolution()->GetGravityForces().SetAcceleration(acceleration);
+		});
+	}
+#endif
+}
+
+UPhysicsSubsystem::UPhysicsSubsystem() {
+	GravityMode = EGravityMode::PerBody;
+	GravityReferenceRate = 60.0f;
+	WakeBudgetPerFrame = 64;
+	RestLinearSpeed = 2.0f;
+	RestAngularSpeed = 0.05f;
+	RestFrames = 10;
+	RestSupportDistance = 5.0f;
+	RestCheckInterval = 30;
+}
 
 void UPhysicsSubsystem::Initialize(FSubsystemCollectionBase& Collection) {
+	if (GravityMode == EGravityMode::Async) {
+		UE_LOG(LogPhysicsSubsystem, Warning, TEXT("GravityMode=Async isn't available on this engine version, using PerBody instead."));
+		GravityMode = EGravityMode::PerBody;
+	}
 	gravity = FVector{0, 0, -9.8f};
+	gravityChangeTime = 0.0f;
+	gravityCatchUp = FVector::ZeroVector;
+	fieldIndex = MakeShared<FGravityFieldIndex, ESPMode::ThreadSafe>();
+
+	for (int32 i = 0; i < GetGravityOrientationCount(); i++) {
+		GetOrientationFromGravity(GetGravityOrientationDirection(i));
+	}
+}
+
+void UPhysicsSubsystem::Deinitialize() {
+	if (hookedScene != nullptr && GetWorld()->GetPhysicsScene() == hookedScene) {
+		hookedScene->OnPhysScenePreTick.Remove(preTickHandle);
+		hookedScene->OnPhysScenePostTick.Remove(postTickHandle);
+	}
+	hookedScene = nullptr;
+	orientationCache.Empty();
+
+	perBodyGravity.Empty();
+	solverGravity.Empty();
+	movers.Empty();
+	wakeQueue.Empty();
+	wakeQueueHead = 0;
+	moverGravity.Empty();
+	moverCallbacks.Empty();
+	moverAppliesGravity.Empty();
+	moverUpdateInterval.Empty();
+	moverPhase.Empty();
+	moverPendingTime.Empty();
+	queuedImpulses.Reset();
+	OnGravityChanged.Clear();
+	fieldComponents.Empty();
+	fieldIndex = MakeShared<FGravityFieldIndex, ESPMode::ThreadSafe>();
 }
 
 void UPhysicsSubsystem::SetGravity(float x, float y, float z) {
-	gravity = FVector{x, y, z};
+	SetGravity(FVector{x, y, z});
+}
+
+void UPhysicsSubsystem::SetGravity(const FVector& newGravity, float age) {
+	FVector oldGravity = gravity;
+	gravity = newGravity;
+	if (oldGravity != gravity) {
+		TRACE_CPUPROFILER_EVENT_SCOPE(UPhysicsSubsystem::SetGravity);
+		TRACE_BOOKMARK(TEXT("Gravity (%.1f, %.1f, %.1f)"), newGravity.X, newGravity.Y, newGravity.Z);
+		CSV_EVENT(BoardingAction, TEXT("Gravity (%.1f, %.1f, %.1f)"), newGravity.X, newGravity.Y, newGravity.Z);
+		gravityChangeTime = GetWorld()->GetTimeSeconds() - age;
+		// Sleeping bodies won't notice the change by themselves, but waking them all on the same frame is a huge spike.
+		ScheduleWakeUps();
+		if (age > 0.0f) {
+			FVector missed = GravityToAcceleration(gravity - oldGravity) * age;
+			gravityCatchUp += missed;
+			// Bodies still waiting to be woken get theirs from the integral instead.
+			if (GetPendingWakeCount() > 0) {
+				gravityIntegral += missed;
+			}
+		}
+		OnGravityChanged.Broadcast(oldGravity, gravity);
+	}
+}
+
+int32 UPhysicsSubsystem::GetPendingWakeCount() const {
+	return wakeQueue.Num() - wakeQueueHead;
+}
+
+void UPhysicsSubsystem::ScheduleWakeUps() {
+	TArray<FVector, TInlineAllocator<4>> players;
+	for (FConstPlayerControllerIterator it = GetWorld()->GetPlayerControllerIterator(); it; ++it) {
+		if (APawn* pawn = it->IsValid() ? (*it)->GetPawn() : nullptr) {
+			players.Add(pawn->GetActorLocation());
+		}
+	}
+
+	auto distanceToPlayers = [&players](const FVector& location) {
+		float best = players.Num() > 0 ? MAX_FLT : 0.0f;
+		for (const FVector& player : players) {
+			best = FMath::Min(best, FVector::DistSquared(player, location));
+		}
+		return best;
+	};
+
+	// Drop what's already been handled, and re-sort the rest since the players have probably moved.
+	wakeQueue.RemoveAt(0, wakeQueueHead, false);
+	wakeQueueHead = 0;
+	for (FPendingWake& pending : wakeQueue) {
+		if (UPrimitiveComponent* body = pending.body.Get()) {
+			FBodyInstance* instance = pending.item != INDEX_NONE ? body->GetBodyInstance(NAME_None, true, pending.item) : nullptr;
+			pending.distanceSquared = distanceToPlayers(instance != nullptr ? instance->GetUnrealWorldTransform().GetLocation() : body->GetComponentLocation());
+		}
+	}
+
+	auto enqueue = [&](FGravityBodyRegistry& registry) {
+		for (int32 i = 0; i < registry.Num(); i++) {
+			// Whatever it was resting on might not hold it up any more.
+			registry.flags[i] &= ~EGravityBodyFlags::Resting;
+			registry.stillFrames[i] = 0;
+			FBodyInstance* instance = registry.GetBodyInstance(i);
+			if (instance == nullptr || (registry.flags[i] & EGravityBodyFlags::PendingWake) || instance->IsInstanceAwake()) {
+				continue;
+			}
+			FVector location = registry.GetLocation(i);
+			// Bodies in a field don't care about the global gravity.
+			if (fieldIndex->FindFieldIndex(location) != INDEX_NONE) {
+				continue;
+			}
+			registry.flags[i] |= EGravityBodyFlags::PendingWake;
+			wakeQueue.Add(FPendingWake{registry.bodies[i], registry.items[i], gravityIntegral, distanceToPlayers(location)});
+		}
+	};
+	enqueue(perBodyGravity);
+	enqueue(solverGravity);
+
+	wakeQueue.Sort([](const FPendingWake& a, const FPendingWake& b) { return a.distanceSquared < b.distanceSquared; });
+	SET_DWORD_STAT(STAT_GravityPendingWakes, GetPendingWakeCount());
+	TRACE_COUNTER_SET(GravityPendingWakesCounter, GetPendingWakeCount());
+	CSV_CUSTOM_STAT(BoardingAction, GravityPendingWakes, GetPendingWakeCount(), ECsvCustomStatOp::Set);
+}
+
+void UPhysicsSubsystem::ProcessWakeQueue() {
+	int32 budget = WakeBudgetPerFrame;
+	while (budget > 0 && wakeQueueHead < wakeQueue.Num()) {
+		const FPendingWake& pending = wakeQueue[wakeQueueHead++];
+		if (ReleasePendingBody(pending.body.Get(), pending.item, pending.startIntegral)) {
+			budget--;
+		}
+	}
+	INC_DWORD_STAT_BY(STAT_GravityWakeUps, WakeBudgetPerFrame - budget);
+
+	if (wakeQueueHead >= wakeQueue.Num()) {
+		wakeQueue.Reset();
+		wakeQueueHead = 0;
+		gravityIntegral = FVector::ZeroVector;
+	}
+	SET_DWORD_STAT(STAT_GravityPendingWakes, GetPendingWakeCount());
+	TRACE_COUNTER_SET(GravityPendingWakesCounter, GetPendingWakeCount());
+	CSV_CUSTOM_STAT(BoardingAction, GravityPendingWakes, GetPendingWakeCount(), ECsvCustomStatOp::Set);
+}
+
+bool UPhysicsSubsystem::ReleasePendingBody(UPrimitiveComponent* body, int32 item, const FVector& startIntegral) {
+	if (!IsValid(body)) {
+		return false;
+	}
+
+	FGravityBodyRegistry* registry = &perBodyGravity;
+	int32 index = registry->Find(body, item);
+	if (index == INDEX_NONE) {
+		registry = &solverGravity;
+		index = registry->Find(body, item);
+	}
+	// It might have been unregistered, or disturbed and released early, while it was waiting.
+	if (index == INDEX_NONE || !(registry->flags[index] & EGravityBodyFlags::PendingWake)) {
+		return false;
+	}
+
+	registry->flags[index] &= ~EGravityBodyFlags::PendingWake;
+	FBodyInstance* instance = registry->GetBodyInstance(index);
+	// Something else (a hit, say) woke it while it waited, and it's been getting gravity from the pass or the solver
+	// ever since. Making up for the whole wait on top of that would give it double.
+	if (instance == nullptr || instance->IsInstanceAwake()) {
+		return false;
+	}
+	const FVector missed = (gravityIntegral - startIntegral) * registry->scales[index];
+	if (item == INDEX_NONE) {
+		body->WakeAllRigidBodies();
+		body->AddImpulse(missed, NAME_None, true);
+	}
+	else {
+		instance->WakeInstance();
+		instance->AddImpulse(missed, true);
+	}
+	return true;
+}
+
+bool UPhysicsSubsystem::UpdateRest(FGravityBodyRegistry& registry, int32 index, const FVector& grav) {
+	FBodyInstance* instance = registry.GetBodyInstance(index);
+	uint8& flags = registry.flags[index];
+	uint8& still = registry.stillFrames[index];
+
+	const bool bStill = instance != nullptr && instance->GetUnrealWorldVelocity().SizeSquared() < FMath::Square(RestLinearSpeed)
+		&& instance->GetUnrealWorldAngularVelocityInRadians().SizeSquared() < FMath::Square(RestAngularSpeed);
+	if (!bStill) {
+		// Knocked off whatever it was resting on, or never there in the first place.
+		flags &= ~EGravityBodyFlags::Resting;
+		still = 0;
+		return false;
+	}
+
+	if (!(flags & EGravityBodyFlags::Resting)) {
+		// Bodies are still for a moment at the top of every bounce, so it has to stay that way for a while.
+		if (still < FMath::Min(RestFrames, int32(MAX_uint8))) {
+			still++;
+			return false;
+		}
+		if (!HasRestingSupport(registry, index, grav)) {
+			still = 0;
+			return false;
+		}
+		flags |= EGravityBodyFlags::Resting;
+		return true;
+	}
+
+	// Still awake, so it's not touching anything asleep yet. Check now and again that the support hasn't gone anywhere.
+	// Offset by the index so they don't all come due on the same pass.
+	if ((passFrame + index) % FMath::Max(RestCheckInterval, 1) == 0 && !HasRestingSupport(registry, index, grav)) {
+		flags &= ~EGravityBodyFlags::Resting;
+		still = 0;
+		return false;
+	}
+	return true;
+}
+
+bool UPhysicsSubsystem::HasRestingSupport(const FGravityBodyRegistry& registry, int32 index, const FVector& grav) const {
+	INC_DWORD_STAT(STAT_GravityRestChecks);
+	UPrimitiveComponent* body = registry.bodies[index];
+	const int32 item = registry.items[index];
+	const FVector down = grav.GetSafeNormal();
+	FVector origin;
+	FVector extent;
+	if (item == INDEX_NONE) {
+		origin = body->Bounds.Origin;
+		extent = body->Bounds.BoxExtent;
+	}
+	else {
+		FBodyInstance* instance = registry.GetBodyInstance(index);
+		if (instance == nullptr) {
+			return false;
+		}
+		instance->GetBodyBounds().GetCenterAndExtents(origin, extent);
+	}
+	// How far the bounds reach along gravity, from the middle.
+	const float reach = FVector::DotProduct(extent, down.GetAbs());
+	const FVector end = origin + down * (reach + RestSupportDistance);
+	const ECollisionChannel channel = body->GetCollisionObjectType();
+
+	if (item == INDEX_NONE) {
+		FCollisionQueryParams params(SCENE_QUERY_STAT(GravityRest), false, body->GetOwner());
+		FHitResult hit;
+		if (!GetWorld()->LineTraceSingleByChannel(hit, origin, end, channel, params)) {
+			return false;
+		}
+		// It has to be pushing back against gravity, not just something we're leaning on.
+		return FVector::DotProduct(hit.ImpactNormal, -down) >= RestSupportNormal;
+	}
+
+	// An instance shares its component (and actor) with every other instance, which is usually what it's stacked on,
+	// so nothing can be ignored up front. Look at everything along the line, and take the first thing that isn't us
+	// and would actually block us.
+	FCollisionQueryParams params(SCENE_QUERY_STAT(GravityRest), false);
+	TArray<FHitResult, TInlineAllocator<4>> hits;
+	GetWorld()->LineTraceMultiByObjectType(hits, origin, end, FCollisionObjectQueryParams(FCollisionObjectQueryParams::InitType::AllObjects), params);
+	for (const FHitResult& hit : hits) {
+		UPrimitiveComponent* other = hit.GetComponent();
+		if (other == nullptr || (other == body && hit.Item == item) || other->GetCollisionResponseToChannel(channel) != ECR_Block) {
+			continue;
+		}
+		return FVector::DotProduct(hit.ImpactNormal, -down) >= RestSupportNormal;
+	}
+	return false;
 }
 
 FVector UPhysicsSubsystem::GetGravity() {
 	return gravity;
 }
 
+FVector UPhysicsSubsystem::GravityToAcceleration(const FVector& grav) const {
+	return grav * GravityReferenceRate;
+}
+
+void UPhysicsSubsystem::HookPhysicsScene() {
+	if (hookedScene != nullptr) {
+		return;
+	}
+
+	hookedScene = GetWorld()->GetPhysicsScene();
+	if (hookedScene == nullptr) {
+		return;
+	}
+
+	preTickHandle = hookedScene->OnPhysScenePreTick.AddUObject(this, &UPhysicsSubsystem::OnPhysScenePreTick);
+	postTickHandle = hookedScene->OnPhysScenePostTick.AddUObject(this, &UPhysicsSubsystem::OnPhysScenePostTick);
+}
+
+void UPhysicsSubsystem::OnPhysScenePreTick(FPhysScene* scene, float DeltaSeconds) {
+	if (GravityMode == EGravityMode::Solver) {
+		// The engine resets the scene to the world's GravityZ every frame before this gets called, so we have to override it every time.
+		SetSceneGravity(scene, GravityToAcceleration(gravity));
+	}
+	FlushImpulses();
+	physicsStepStart = FPlatformTime::Seconds();
+}
+
+void UPhysicsSubsystem::OnPhysScenePostTick(FPhysScene* scene) {
+	lastPhysicsStepTime = FPlatformTime::Seconds() - physicsStepStart;
+}
+
+void UPhysicsSubsystem::QueueImpulseAtLocation(UPrimitiveComponent* body, const FVector& impulse, const FVector& location, int32 item) {
+	if (body == nullptr) {
+		return;
+	}
+	HookPhysicsScene();
+	// Without a scene there's nothing to flush them before, so just hand it over.
+	if (hookedScene == nullptr) {
+		if (FBodyInstance* instance = body->GetBodyInstance(NAME_None, true, item)) {
+			instance->AddImpulseAtPosition(impulse, location);
+		}
+		return;
+	}
+	queuedImpulses.AddAtLocation(body, item, impulse, location);
+}
+
+void UPhysicsSubsystem::FlushImpulses() {
+	SCOPE_CYCLE_COUNTER(STAT_ImpulseFlush);
+	TRACE_CPUPROFILER_EVENT_SCOPE(UPhysicsSubsystem::FlushImpulses);
+
+	int32 flushed = 0;
+	for (int32 i = 0; i < queuedImpulses.Num(); i++) {
+		UPrimitiveComponent* body = queuedImpulses.bodies[i].Get();
+		FBodyInstance* instance = body != nullptr ? body->GetBodyInstance(NAME_None, true, queuedImpulses.items[i]) : nullptr;
+		// It could have stopped simulating, or been destroyed, since it was hit.
+		if (instance == nullptr || !instance->IsInstanceSimulatingPhysics()) {
+			continue;
+		}
+		instance->AddImpulse(queuedImpulses.linear[i], false);
+		if (!queuedImpulses.angular[i].IsNearlyZero()) {
+			instance->AddAngularImpulseInRadians(queuedImpulses.angular[i], false);
+		}
+		flushed++;
+	}
+	INC_DWORD_STAT_BY(STAT_ImpulsesQueued, queuedImpulses.rawCount);
+	INC_DWORD_STAT_BY(STAT_ImpulseBodiesFlushed, flushed);
+	TRACE_COUNTER_SET(ImpulseBodiesCounter, flushed);
+	CSV_CUSTOM_STAT(BoardingAction, ImpulseBodiesFlushed, flushed, ECsvCustomStatOp::Set);
+	queuedImpulses.Reset();
+}
+
+bool FGravityFieldData::Contains(const FVector& location) const {
+	FVector local = transform.InverseTransformPosition(location);
+	return FMath::Abs(local.X) <= extent.X && FMath::Abs(local.Y) <= extent.Y && FMath::Abs(local.Z) <= extent.Z;
+}
+
+FVector FGravityFieldData::Evaluate(const FVector& location) const {
+	switch (shape) {
+	case EGravityFieldShape::Point:
+		return (transform.GetLocation() - location).GetSafeNormal() * strength;
+	case EGravityFieldShape::Cylindrical: {
+		// Only the part of the offset that's perpendicular to the spin axis matters.
+		FVector offset = location - transform.GetLocation();
+		FVector radial = offset - direction * FVector::DotProduct(offset, direction);
+		return radial.GetSafeNormal() * strength;
+	}
+	default:
+		return direction * strength;
+	}
+}
+
+FVector UPhysicsSubsystem::GetGravityAt(const FVector& location) {
+	FVector result;
+	GetGravityAtLocations(MakeArrayView(&location, 1), MakeArrayView(&result, 1));
+	return result;
+}
+
+void UPhysicsSubsystem::GetGravityAtLocations(TArrayView<const FVector> locations, TArrayView<FVector> outGravity) {
+	check(locations.Num() == outGravity.Num());
+
+	if (bFieldsDirty) {
+		RebuildFieldIndex();
+	}
+
+	if (fieldIndex->IsEmpty()) {
+		for (FVector& out : outGravity) {
+			out = gravity;
+		}
+		return;
+	}
+
+	for (int32 i = 0; i < locations.Num(); i++) {
+		outGravity[i] = fieldIndex->GetGravityAt(locations[i], gravity);
+	}
+}
+
+void FGravityFieldIndex::Add(const FGravityFieldData& data) {
+	int32 index = fields.Add(data);
+
+	FBox bounds = FBox(-data.extent, data.extent).TransformBy(data.transform);
+	FIntVector minCell{FMath::FloorToInt(bounds.Min.X / FieldCellSize), FMath::FloorToInt(bounds.Min.Y / FieldCellSize), FMath::FloorToInt(bounds.Min.Z / FieldCellSize)};
+	FIntVector maxCell{FMath::FloorToInt(bounds.Max.X / FieldCellSize), FMath::FloorToInt(bounds.Max.Y / FieldCellSize), FMath::FloorToInt(bounds.Max.Z / FieldCellSize)};
+	int64 cellCount = int64(maxCell.X - minCell.X + 1) * (maxCell.Y - minCell.Y + 1) * (maxCell.Z - minCell.Z + 1);
+	if (cellCount > MaxCellsPerField) {
+		largeFields.Add(index);
+		return;
+	}
+
+	for (int32 x = minCell.X; x <= maxCell.X; x++) {
+		for (int32 y = minCell.Y; y <= maxCell.Y; y++) {
+			for (int32 z = minCell.Z; z <= maxCell.Z; z++) {
+				grid.FindOrAdd(FIntVector{x, y, z}).Add(index);
+			}
+		}
+	}
+}
+
+FVector FGravityFieldIndex::GetGravityAt(const FVector& location, const FVector& fallback) const {
+	int32 index = FindFieldIndex(location);
+	return index == INDEX_NONE ? fallback : fields[index].Evaluate(location);
+}
+
+int32 FGravityFieldIndex::FindFieldIndex(const FVector& location) const {
+	// Fields are sorted by priority, so the first hit in either list is the best that list has to offer.
+	int32 best = INDEX_NONE;
+	FIntVector cell{FMath::FloorToInt(location.X / FieldCellSize), FMath::FloorToInt(location.Y / FieldCellSize), FMath::FloorToInt(location.Z / FieldCellSize)};
+	if (const TArray<int32>* candidates = grid.Find(cell)) {
+		for (int32 index : *candidates) {
+			if (fields[index].Contains(location)) {
+				best = index;
+				break;
+			}
+		}
+	}
+
+	for (int32 index : largeFields) {
+		if (best != INDEX_NONE && index > best) {
+			break;
+		}
+		if (fields[index].Contains(location)) {
+			best = index;
+			break;
+		}
+	}
+	return best;
+}
+
+void UPhysicsSubsystem::RegisterField(UGravityFieldComponent* field) {
+	if (field != nullptr) {
+		fieldComponents.AddUnique(field);
+		MarkFieldsDirty();
+	}
+}
+
+void UPhysicsSubsystem::UnregisterField(UGravityFieldComponent* field) {
+	if (fieldComponents.RemoveSwap(field) > 0) {
+		MarkFieldsDirty();
+	}
+}
+
+void UPhysicsSubsystem::MarkFieldsDirty() {
+	bFieldsDirty = true;
+}
+
+void UPhysicsSubsystem::RebuildFieldIndex() {
+	bFieldsDirty = false;
+
+	fieldComponents.RemoveAllSwap([](UGravityFieldComponent* field) { return !IsValid(field); });
+	fieldComponents.StableSort([](const UGravityFieldComponent& a, const UGravityFieldComponent& b) { return a.Priority > b.Priority; });
+
+	// Always build a fresh index rather than editing the old one, since the physics thread might still be reading it.
+	TSharedRef<FGravityFieldIndex, ESPMode::ThreadSafe> newIndex = MakeShared<FGravityFieldIndex, ESPMode::ThreadSafe>();
+	for (UGravityFieldComponent* component : fieldComponents) {
+		FGravityFieldData data;
+		data.transform = component->GetComponentTransform();
+		data.transform.SetScale3D(FVector::OneVector);
+		data.extent = component->Extent * component->GetComponentScale().GetAbs();
+		data.shape = component->Shape;
+		data.direction = component->Shape == EGravityFieldShape::Cylindrical ? component->GetForwardVector() : data.transform.TransformVectorNoScale(component->Direction.GetSafeNormal());
+		data.strength = component->Strength;
+		data.priority = component->Priority;
+		newIndex->Add(data);
+	}
+	fieldIndex = newIndex;
+}
+
+void UPhysicsSubsystem::RegisterBody(UPrimitiveComponent* body, float gravityScale, bool bAllowSolverGravity) {
+	RegisterEntry(body, INDEX_NONE, gravityScale, bAllowSolverGravity);
+}
+
+void UPhysicsSubsystem::UnregisterBody(UPrimitiveComponent* body) {
+	UnregisterInstanceBody(body, INDEX_NONE);
+}
+
+void UPhysicsSubsystem::RegisterInstanceBody(UPrimitiveComponent* component, int32 instance, float gravityScale, bool bAllowSolverGravity) {
+	RegisterEntry(component, instance, gravityScale, bAllowSolverGravity);
+}
+
+void UPhysicsSubsystem::UnregisterInstanceBody(UPrimitiveComponent* component, int32 instance) {
+	FGravityBodyRegistry* registry = &perBodyGravity;
+	int32 index = registry->Find(component, instance);
+	if (index == INDEX_NONE) {
+		registry = &solverGravity;
+		index = registry->Find(component, instance);
+	}
+	if (index == INDEX_NONE) {
+		return;
+	}
+	// Give the body back with the engine's gravity the way we found it, since nothing else will be applying any.
+	FBodyInstance* body = registry->GetBodyInstance(index);
+	if (body != nullptr && body->bEnableGravity != registry->engineGravity[index]) {
+		body->SetEnableGravity(registry->engineGravity[index]);
+	}
+	// Its wait goes with it. Otherwise, registered again, it would be queued a second time and the old wait would
+	// make up for gravity from before it was back.
+	if (registry->flags[index] & EGravityBodyFlags::PendingWake) {
+		for (int32 i = wakeQueueHead; i < wakeQueue.Num(); i++) {
+			if (wakeQueue[i].item == instance && wakeQueue[i].body == component) {
+				wakeQueue.RemoveAt(i, 1, false);
+				break;
+			}
+		}
+	}
+	registry->Remove(component, instance);
+}
+
+void UPhysicsSubsystem::RegisterEntry(UPrimitiveComponent* body, int32 item, float gravityScale, bool bAllowSolverGravity) {
+	if (body == nullptr || perBodyGravity.Contains(body, item) || solverGravity.Contains(body, item)) {
+		return;
+	}
+
+	HookPhysicsScene();
+	FBodyInstance* instance = body->GetBodyInstance(NAME_None, true, item);
+	const bool bEngineGravity = instance != nullptr && instance->bEnableGravity;
+	if (GravityMode == EGravityMode::Solver) {
+		// The scene's gravity is ours now, so anything we're applying ourselves mustn't get it a second time.
+		bool bUseSolver = bAllowSolverGravity && gravityScale == 1.0f;
+		if (instance != nullptr) {
+			instance->SetEnableGravity(bUseSolver);
+		}
+		if (bUseSolver) {
+			solverGravity.Add(body, item, gravityScale, bEngineGravity);
+			return;
+		}
+	}
+	perBodyGravity.Add(body, item, gravityScale, bEngineGravity);
+}
+
+void UPhysicsSubsystem::RegisterMover(UCharacterMovementComponent* mover, FOnLocalGravityChanged onLocalGravityChanged, bool bApplyGravity) {
+	if (mover == nullptr || movers.Contains(mover)) {
+		return;
+	}
+	movers.Add(mover);
+	moverGravity.Add(mover->UpdatedComponent != nullptr ? GetGravityAt(mover->UpdatedComponent->GetComponentLocation()) : gravity);
+	moverCallbacks.Add(onLocalGravityChanged);
+	moverAppliesGravity.Add(bApplyGravity);
+	moverUpdateInterval.Add(1);
+	// Handing them out in turn spreads movers on the same interval evenly across its frames.
+	moverPhase.Add(nextMoverPhase++);
+	moverPendingTime.Add(0.0f);
+}
+
+void UPhysicsSubsystem::UnregisterMover(UCharacterMovementComponent* mover) {
+	int32 index = movers.Find(mover);
+	if (index != INDEX_NONE) {
+		movers.RemoveAtSwap(index, 1, false);
+		moverGravity.RemoveAtSwap(index, 1, false);
+		moverCallbacks.RemoveAtSwap(index, 1, false);
+		moverAppliesGravity.RemoveAtSwap(index, 1, false);
+		moverUpdateInterval.RemoveAtSwap(index, 1, false);
+		moverPhase.RemoveAtSwap(index, 1, false);
+		moverPendingTime.RemoveAtSwap(index, 1, false);
+	}
+}
+
+void UPhysicsSubsystem::SetMoverUpdateInterval(UCharacterMovementComponent* mover, int32 interval) {
+	int32 index = movers.Find(mover);
+	if (index != INDEX_NONE) {
+		moverUpdateInterval[index] = FMath::Clamp(interval, 1, int32(MAX_uint8));
+	}
+}
+
+void UPhysicsSubsystem::Tick(float DeltaTime) {
+	SCOPE_CYCLE_COUNTER(STAT_GravityPass);
+	TRACE_CPUPROFILER_EVENT_SCOPE(UPhysicsSubsystem::GravityPass);
+	CSV_SCOPED_TIMING_STAT(BoardingAction, GravityPass);
+	const double passStart = FPlatformTime::Seconds();
+
+	if (bFieldsDirty) {
+		RebuildFieldIndex();
+	}
+	// A body can be destroyed without its controller ever unregistering it, in which case GC will have nulled it out.
+	perBodyGravity.RemoveCollected();
+	solverGravity.RemoveCollected();
+
+	TArrayView<UPrimitiveComponent* const> bodies = perBodyGravity.bodies;
+	// Solver bodies already get the global gravity from the scene, so they only need a look when a field might be pulling them elsewhere.
+	TArrayView<UPrimitiveComponent* const> corrected;
+	if (fieldComponents.Num() > 0) {
+		corrected = solverGravity.bodies;
+	}
+	// Movers that aren't due this frame don't need their gravity looked up at all.
+	passFrame++;
+	passMovers.Reset();
+	for (int32 i = 0; i < movers.Num(); i++) {
+		moverPendingTime[i] += DeltaTime;
+		if ((passFrame + moverPhase[i]) % moverUpdateInterval[i] == 0) {
+			passMovers.Add(i);
+		}
+	}
+	const int32 moverStart = bodies.Num();
+	const int32 correctedStart = moverStart + passMovers.Num();
+
+	// Gather every location first so the field lookups happen as one batch.
+	int32 total = correctedStart + corrected.Num();
+	passLocations.SetNumUninitialized(total, false);
+	passGravity.SetNumUninitialized(total, false);
+	for (int32 i = 0; i < bodies.Num(); i++) {
+		// A destroyed body stays in the registry until GC has nulled it out, so it may not be valid yet.
+		passLocations[i] = perBodyGravity.GetLocation(i);
+	}
+	for (int32 i = 0; i < passMovers.Num(); i++) {
+		UCharacterMovementComponent* mover = movers[passMovers[i]];
+		passLocations[moverStart + i] = IsValid(mover) && mover->UpdatedComponent != nullptr ? mover->UpdatedComponent->GetComponentLocation() : FVector::ZeroVector;
+	}
+	for (int32 i = 0; i < corrected.Num(); i++) {
+		passLocations[correctedStart + i] = solverGravity.GetLocation(i);
+	}
+
+	GetGravityAtLocations(passLocations, passGravity);
+
+	// Gravity is an acceleration, so scale by the frame time to keep it the same at any frame rate.
+	const float step = GravityReferenceRate * DeltaTime;
+
+	// Callbacks are fired after the pass, since they're free to register or unregister movers.
+	TArray<TTuple<FOnLocalGravityChanged, FVector, FVector>, TInlineAllocator<4>> changed;
+
+	int32 processed = 0;
+	int32 sleeping = 0;
+	for (int32 i = 0; i < bodies.Num(); i++) {
+		FBodyInstance* instance = perBodyGravity.GetBodyInstance(i);
+		if (instance == nullptr) {
+			continue;
+		}
+		uint8& flags = perBodyGravity.flags[i];
+		// Any impulse wakes a body up, so anything that's asleep (or could be) mustn't get one.
+		// Sleeping bodies only ever get woken by gravity changing (through the wake queue) or by being disturbed.
+		// Only bodies the physics scene has actually put to sleep count as asleep. Ones drifting in zero gravity, or
+		// resting but not asleep yet, are still being simulated.
+		if (!instance->IsInstanceAwake()) {
+			sleeping++;
+			continue;
+		}
+		if (passGravity[i].IsZero()) {
+			continue;
+		}
+		if (flags & EGravityBodyFlags::PendingWake) {
+			// Something else woke it up before the scheduler got to it, so it can go back to normal. Solver bodies
+			// never come through here, and are sorted out by ReleasePendingBody instead.
+			flags &= ~EGravityBodyFlags::PendingWake;
+		}
+		if (UpdateRest(perBodyGravity, i, passGravity[i])) {
+			continue;
+		}
+		FVector impulse = passGravity[i] * step;
+		// Catching up only makes sense for bodies that feel the global gravity.
+		if (!gravityCatchUp.IsZero() && passGravity[i] == gravity) {
+			impulse += gravityCatchUp;
+		}
+		instance->AddImpulse(impulse * perBodyGravity.scales[i], true);
+		processed++;
+	}
+
+	for (int32 j = 0; j < passMovers.Num(); j++) {
+		const int32 i = passMovers[j];
+		const float moverTime = moverPendingTime[i];
+		moverPendingTime[i] = 0.0f;
+		if (IsValid(movers[i])) {
+			const FVector& moverGrav = passGravity[moverStart + j];
+			if (moverAppliesGravity[i]) {
+				movers[i]->AddImpulse(moverGrav * (GravityReferenceRate * moverTime), true);
+				processed++;
+			}
+
+			if (moverGrav != moverGravity[i]) {
+				if (moverCallbacks[i].IsBound()) {
+					changed.Emplace(moverCallbacks[i], moverGravity[i], moverGrav);
+				}
+				moverGravity[i] = moverGrav;
+			}
+		}
+	}
+
+	for (int32 i = 0; i < corrected.Num(); i++) {
+		// Only the difference between the field and the scene's gravity needs making up.
+		FVector difference = passGravity[correctedStart + i] - gravity;
+		// The scene doesn't apply gravity to sleeping bodies either, so leave those be.
+		FBodyInstance* instance = solverGravity.GetBodyInstance(i);
+		if (instance != nullptr && !difference.IsNearlyZero() && instance->IsInstanceAwake()) {
+			instance->AddImpulse(difference * step, true);
+			processed++;
+		}
+	}
+
+	// Solver bodies otherwise never go through the pass outside of fields, so they catch up in one go here.
+	if (!gravityCatchUp.IsZero()) {
+		for (int32 i = 0; i < solverGravity.Num(); i++) {
+			FBodyInstance* instance = solverGravity.GetBodyInstance(i);
+			if (instance != nullptr && !(solverGravity.flags[i] & EGravityBodyFlags::PendingWake) && instance->IsInstanceAwake()
+				&& fieldIndex->FindFieldIndex(solverGravity.GetLocation(i)) == INDEX_NONE) {
+				instance->AddImpulse(gravityCatchUp, true);
+			}
+		}
+		gravityCatchUp = FVector::ZeroVector;
+	}
+
+	INC_DWORD_STAT_BY(STAT_GravityBodiesProcessed, processed);
+	TRACE_COUNTER_SET(GravityBodiesCounter, processed);
+	CSV_CUSTOM_STAT(BoardingAction, GravityBodies, processed, ECsvCustomStatOp::Set);
+	lastPassBodies = processed;
+
+	// Only the bodies the pass is responsible for. Solver bodies are slept by the physics scene as normal.
+	lastSleepingBodies = sleeping;
+	lastAwakeBodies = bodies.Num() - sleeping;
+	SET_DWORD_STAT(STAT_GravityBodiesAwake, lastAwakeBodies);
+	SET_DWORD_STAT(STAT_GravityBodiesSleeping, lastSleepingBodies);
+	TRACE_COUNTER_SET(GravityBodiesAwakeCounter, lastAwakeBodies);
+	TRACE_COUNTER_SET(GravityBodiesSleepingCounter, lastSleepingBodies);
+	CSV_CUSTOM_STAT(BoardingAction, GravityBodiesAwake, lastAwakeBodies, ECsvCustomStatOp::Set);
+	CSV_CUSTOM_STAT(BoardingAction, GravityBodiesSleeping, lastSleepingBodies, ECsvCustomStatOp::Set);
+
+	// Done after the pass, so a body woken up this frame doesn't get this frame's gravity twice.
+	if (GetPendingWakeCount() > 0) {
+		gravityIntegral += GravityToAcceleration(gravity) * DeltaTime;
+		ProcessWakeQueue();
+	}
+
+	lastPassTime = FPlatformTime::Seconds() - passStart;
+
+	for (const TTuple<FOnLocalGravityChanged, FVector, FVector>& change : changed) {
+		change.Get<0>().ExecuteIfBound(change.Get<1>(), change.Get<2>());
+	}
+}
+
+ETickableTickType UPhysicsSubsystem::GetTickableTickType() const {
+	// The CDO should never be ticked.
+	return IsTemplate() ? ETickableTickType::Never : ETickableTickType::Conditional;
+}
+
+bool UPhysicsSubsystem::IsTickable() const {
+	return perBodyGravity.Num() > 0 || movers.Num() > 0 || GetPendingWakeCount() > 0 || (solverGravity.Num() > 0 && (fieldComponents.Num() > 0 || !gravityCatchUp.IsZero()));
+}
+
+UWorld* UPhysicsSubsystem::GetTickableGameObjectWorld() const {
+	return GetWorld();
+}
+
+TStatId UPhysicsSubsystem::GetStatId() const {
+	RETURN_QUICK_DECLARE_CYCLE_STAT(UPhysicsSubsystem, STATGROUP_Tickables);
+}
+
 FRotator UPhysicsSubsystem::GetRotatorFromGravity(FVector grav) {
+	TRACE_CPUPROFILER_EVENT_SCOPE(UPhysicsSubsystem::GetRotatorFromGravity);
+	return ComputeOrientationFromGravity(grav).Rotator();
+}
+
+FQuat UPhysicsSubsystem::ComputeOrientationFromGravity(const FVector& grav) {
 	// Primarily, this is about rotating the global down down vector (and everything else) to match the new gravity vector.
 	// So, when the gravity changes, look at how you can set the actor's rotation to match the new gravity.
 
 	FVector normalGrav = grav.GetSafeNormal();
 
-	// We want to use the universal down of gravity to figure out how to set the player's rotation. Otherwise, we'll be setting global rotation
-	// based on information calculated from local rotation:
-	FVector downGravCross = FVector::CrossProduct(FVector::DownVector, normalGrav);
+	// If the normalGrav is the zero vector, don't make any rotations.
+	if (normalGrav.IsZero()) {
+		return FQuat::Identity;
+	}
 
-	// If the cross product is zero, this means that normalGrav either goes directly up (globally), directly down (globally), or is the 0 vector.
-	if (downGravCross.IsNearlyZero()) {
-		// If the normalGrav is the zero vector, don't make any rotations.
-		// Otherwise, just pick the forward vector as the angle we want to rotate along.
-		if (!normalGrav.IsNearlyZero()) {
-			downGravCross = FVector::ForwardVector;
-		}
+	// If gravity goes directly up (globally), there's no single axis to rotate around. Just pick the forward vector.
+	if (FVector::DotProduct(FVector::DownVector, normalGrav) < -1 + KINDA_SMALL_NUMBER) {
+		return FQuat(FVector::ForwardVector, PI);
+	}
+
+	// This rotates around cross(down, gravity) by the angle between them, which is what the axis angle version used to build by hand.
+	return FQuat::FindBetweenNormals(FVector::DownVector, normalGrav);
+}
+
+FQuat UPhysicsSubsystem::GetOrientationFromGravity(const FVector& grav) {
+	FIntVector key = QuantizeDirection(grav);
+	if (const FQuat* cached = orientationCache.Find(key)) {
+		return *cached;
 	}
 
-	// In case downGravCross happens to be the zero vector and gets changed:
-	FVector actualCross = FVector::CrossProduct(FVector::DownVector, normalGrav);
+	TRACE_CPUPROFILER_EVENT_SCOPE(UPhysicsSubsystem::GetOrientationFromGravity_Miss);
+	if (orientationCache.Num() >= MaxCachedOrientations) {
+		orientationCache.Reset();
+		for (int32 i = 0; i < GetGravityOrientationCount(); i++) {
+			FVector direction = GetGravityOrientationDirection(i);
+			orientationCache.Add(QuantizeDirection(direction), ComputeOrientationFromGravity(direction));
+		}
+	}
 
-	//UE_LOG(LogTemp, Warning, TEXT("Vector we're rotating along: %s Cross product: %s Dot Product: %f"), *downGravCross.ToString(), *actualCross.ToString(), FVector::DotProduct(FVector::DownVector, normalGrav));
+	// Build it from the quantized direction, so the same key always gives the same answer.
+	FQuat orientation = ComputeOrientationFromGravity(FVector{key} / OrientationQuantization);
+	orientationCache.Add(key, orientation);
+	return orientation;
+}
 
-	// This is based on the sin(theta) = |cross(A, B)|/|A|*|B| and cos(theta) = dot(A, B)/|A|*|B|
-	float crossAngle = FMath::Atan2(actualCross.Size(), FVector::DotProduct(FVector::DownVector, normalGrav)) * 180 / PI; // We need to convert to degrees.
+FIntVector UPhysicsSubsystem::QuantizeDirection(const FVector& direction) {
+	FVector normal = direction.GetSafeNormal() * OrientationQuantization;
+	return FIntVector{FMath::RoundToInt(normal.X), FMath::RoundToInt(normal.Y), FMath::RoundToInt(normal.Z)};
+}
 
-	// Simplified from the nightmare that was before.
-	// We create an axis angle representation of our rotation, use the KismetMathLibrary to do the hard job of converting (https://en.wikipedia.org/wiki/Rotation_formalisms_in_three_dimensions#Conversion_formulae_between_formalisms)
-	// And then we apply that rotation to our actor.
-	FVector axisAngle = downGravCross.GetSafeNormal();
+int32 UPhysicsSubsystem::GetGravityOrientationCount() {
+	return UE_ARRAY_COUNT(GravityOrientations);
+}
 
-	FRotator newRot = UKismetMathLibrary::RotatorFromAxisAndAngle(axisAngle, crossAngle);
+FVector UPhysicsSubsystem::GetGravityOrientationDirection(int32 index) {
+	return GravityOrientations[index].GetSafeNormal();
+}
 
-	return newRot;
-}
\ No newline at end of file
+int32 UPhysicsSubsystem::FindGravityOrientation(const FVector& grav) {
+	FVector normal = grav.GetSafeNormal();
+	for (int32 i = 0; i < GetGravityOrientationCount(); i++) {
+		if (normal.Equals(GetGravityOrientationDirection(i), KINDA_SMALL_NUMBER)) {
+			return i;
+		}
+	}
+	return INDEX_NONE;
+}
@@ -0,0 +1,287 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "ProjectileManagerSubsystem.h"
+#include "BoardingAction.h"
+#include "BoardingActionProjectile.h"
+#include "PhysicsSubsystem.h"
+#include "Components/InstancedStaticMeshComponent.h"
+#include "Components/SphereComponent.h"
+#include "GameFramework/ProjectileMovementComponent.h"
+#include "Engine/StaticMesh.h"
+#include "Engine/World.h"
+#include "Async/ParallelFor.h"
+
+DECLARE_CYCLE_STAT(TEXT("Projectile Step"), STAT_ProjectileStep, STATGROUP_BoardingActionProjectiles);
+DECLARE_CYCLE_STAT(TEXT("Projectile Hits"), STAT_ProjectileHits, STATGROUP_BoardingActionProjectiles);
+DECLARE_CYCLE_STAT(TEXT("Projectile Instance Update"), STAT_ProjectileInstances, STATGROUP_BoardingActionProjectiles);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Projectiles Live (Batched)"), STAT_ProjectilesLive, STATGROUP_BoardingActionProjectiles);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Projectile Traces"), STAT_ProjectileTraces, STATGROUP_BoardingActionProjectiles);
+
+TRACE_DECLARE_INT_COUNTER(ProjectilesLiveCounter, TEXT("BoardingAction/Projectiles Live (Batched)"));
+
+// Below this many rounds it's not worth handing the integration out to worker threads.
+static const int32 ParallelStepThreshold = 1024;
+static const int32 ParallelStepBatch = 256;
+// How far to back a round off a surface it's bounced off, so the next trace doesn't start inside it.
+static const float BounceSkin = 0.1f;
+
+UProjectileManagerSubsystem::UProjectileManagerSubsystem() {
+	ProjectileMesh = FSoftObjectPath(TEXT("/Game/FirstPerson/Meshes/FirstPersonProjectileMesh.FirstPersonProjectileMesh"));
+	ProjectileMeshScale = FVector{0.06f};
+	CollisionProfile = TEXT("Projectile");
+	MaxProjectiles = 16384;
+}
+
+void UProjectileManagerSubsystem::Initialize(FSubsystemCollectionBase& Collection) {
+	worldPhysics = Cast<UPhysicsSubsystem>(Collection.InitializeDependency(UPhysicsSubsystem::StaticClass()));
+	queryParams = FCollisionQueryParams(SCENE_QUERY_STAT(ProjectileManager), false);
+	instigatorQueryParams = queryParams;
+}
+
+void UProjectileManagerSubsystem::Deinitialize() {
+	positions.Empty();
+	velocities.Empty();
+	lifeSpans.Empty();
+	types.Empty();
+	instigators.Empty();
+	traces.Empty();
+	typeData.Empty();
+	typeIndices.Empty();
+	renderActor = nullptr;
+	instances = nullptr;
+	drawnCount = 0;
+	worldPhysics = nullptr;
+}
+
+int32 UProjectileManagerSubsystem::FindOrAddType(UClass* projectileClass) {
+	if (const uint8* index = typeIndices.Find(projectileClass)) {
+		return *index;
+	}
+	if (typeData.Num() > MAX_uint8) {
+		return INDEX_NONE;
+	}
+
+	const ABoardingActionProjectile* defaults = projectileClass->GetDefaultObject<ABoardingActionProjectile>();
+	const UProjectileMovementComponent* movement = defaults->GetProjectileMovement();
+	FProjectileType type;
+	type.radius = defaults->GetCollisionComp()->GetUnscaledSphereRadius();
+	type.initialSpeed = movement->InitialSpeed;
+	type.maxSpeed = movement->MaxSpeed;
+	type.lifeSpan = defaults->ProjectileLifeSpan;
+	type.gravityScale = movement->ProjectileGravityScale;
+	type.bShouldBounce = movement->bShouldBounce;
+	type.bounciness = movement->Bounciness;
+	type.friction = movement->Friction;
+
+	int32 index = typeData.Add(type);
+	typeIndices.Add(projectileClass, index);
+	return index;
+}
+
+bool UProjectileManagerSubsystem::Fire(TSubclassOf<ABoardingActionProjectile> projectileClass, const FVector& location, const FRotator& rotation, AActor* instigator) {
+	if (projectileClass == nullptr || positions.Num() >= MaxProjectiles) {
+		return false;
+	}
+	int32 type = FindOrAddType(projectileClass);
+	if (type == INDEX_NONE) {
+		return false;
+	}
+
+	// A dedicated server has nothing to draw them with.
+	if (renderActor == nullptr && GetWorld()->GetNetMode() != NM_DedicatedServer) {
+		FActorSpawnParameters params;
+		params.ObjectFlags |= RF_Transient;
+		renderActor = GetWorld()->SpawnActor<AActor>(params);
+		instances = NewObject<UInstancedStaticMeshComponent>(renderActor);
+		instances->SetStaticMesh(Cast<UStaticMesh>(ProjectileMesh.TryLoad()));
+		instances->SetCollisionEnabled(ECollisionEnabled::NoCollision);
+		instances->SetCanEverAffectNavigation(false);
+		instances->SetCastShadow(false);
+		renderActor->SetRootComponent(instances);
+		instances->RegisterComponent();
+	}
+
+	positions.Add(location);
+	velocities.Add(rotation.Vector() * typeData[type].initialSpeed);
+	lifeSpans.Add(typeData[type].lifeSpan);
+	types.Add(type);
+	instigators.Add(instigator);
+	traces.Add(FTraceHandle());
+	return true;
+}
+
+void UProjectileManagerSubsystem::RemoveAtSwap(int32 index) {
+	positions.RemoveAtSwap(index, 1, false);
+	velocities.RemoveAtSwap(index, 1, false);
+	lifeSpans.RemoveAtSwap(index, 1, false);
+	types.RemoveAtSwap(index, 1, false);
+	instigators.RemoveAtSwap(index, 1, false);
+	traces.RemoveAtSwap(index, 1, false);
+}
+
+void UProjectileManagerSubsystem::Tick(float DeltaTime) {
+	SCOPE_CYCLE_COUNTER(STAT_ProjectileStep);
+	TRACE_CPUPROFILER_EVENT_SCOPE(UProjectileManagerSubsystem::Tick);
+
+	ResolveHits();
+
+	// Backwards, since removing swaps the last round into the gap.
+	for (int32 i = positions.Num() - 1; i >= 0; i--) {
+		lifeSpans[i] -= DeltaTime;
+		if (lifeSpans[i] <= 0.0f) {
+			RemoveAtSwap(i);
+		}
+	}
+
+	Step(DeltaTime);
+	UpdateInstances();
+	SET_DWORD_STAT(STAT_ProjectilesLive, positions.Num());
+	TRACE_COUNTER_SET(ProjectilesLiveCounter, positions.Num());
+	CSV_CUSTOM_STAT(BoardingAction, ProjectilesLive, positions.Num(), ECsvCustomStatOp::Set);
+}
+
+void UProjectileManagerSubsystem::ResolveHits() {
+	SCOPE_CYCLE_COUNTER(STAT_ProjectileHits);
+
+	UWorld* world = GetWorld();
+	FTraceDatum datum;
+	for (int32 i = positions.Num() - 1; i >= 0; i--) {
+		if (!traces[i].IsValid() || !world->QueryTraceData(traces[i], datum)) {
+			continue;
+		}
+		traces[i] = FTraceHandle();
+		const FHitResult* hit = datum.OutHits.FindByPredicate([](const FHitResult& result) { return result.bBlockingHit; });
+		if (hit == nullptr) {
+			continue;
+		}
+
+		UPrimitiveComponent* other = hit->GetComponent();
+		FBodyInstance* otherBody = other != nullptr ? other->GetBodyInstance(NAME_None, true, hit->Item) : nullptr;
+		if (otherBody != nullptr && otherBody->IsInstanceSimulatingPhysics()) {
+			// Same push as ABoardingActionProjectile::OnHit, and the round is used up.
+			worldPhysics->QueueImpulseAtLocation(other, velocities[i] * 100.0f, hit->Location, hit->Item);
+			RemoveAtSwap(i);
+			continue;
+		}
+
+		const FProjectileType& type = typeData[types[i]];
+		if (!type.bShouldBounce) {
+			RemoveAtSwap(i);
+			continue;
+		}
+		// Same bounce as UProjectileMovementComponent::ComputeBounceDelta: bounciness along the normal, friction along the surface.
+		const FVector normal = hit->Normal;
+		const FVector velocity = velocities[i];
+		const FVector normalVelocity = normal * FVector::DotProduct(velocity, normal);
+		const FVector tangentVelocity = velocity - normalVelocity;
+		velocities[i] = tangentVelocity * FMath::Clamp(1.0f - type.friction, 0.0f, 1.0f) - normalVelocity * type.bounciness;
+		// The round has already moved on past the hit by now, so put it back where it actually hit.
+		positions[i] = hit->Location + normal * BounceSkin;
+	}
+}
+
+void UProjectileManagerSubsystem::Step(float DeltaTime) {
+	const int32 count = positions.Num();
+	if (count == 0) {
+		return;
+	}
+
+	stepGravity.SetNumUninitialized(count, false);
+	worldPhysics->GetGravityAtLocations(positions, stepGravity);
+
+	// Kept so the traces know where each round started from.
+	stepStarts = positions;
+
+	auto integrate = [this, DeltaTime](int32 i) {
+		const FProjectileType& type = typeData[types[i]];
+		FVector velocity = velocities[i] + worldPhysics->GravityToAcceleration(stepGravity[i]) * (type.gravityScale * DeltaTime);
+		if (type.maxSpeed > 0.0f) {
+			velocity = velocity.GetClampedToMaxSize(type.maxSpeed);
+		}
+		velocities[i] = velocity;
+		positions[i] += velocity * DeltaTime;
+	};
+	if (count >= ParallelStepThreshold) {
+		ParallelFor(FMath::DivideAndRoundUp(count, ParallelStepBatch), [count, &integrate](int32 batch) {
+			const int32 end = FMath::Min((batch + 1) * ParallelStepBatch, count);
+			for (int32 i = batch * ParallelStepBatch; i < end; i++) {
+				integrate(i);
+			}
+		});
+	}
+	else {
+		for (int32 i = 0; i < count; i++) {
+			integrate(i);
+		}
+	}
+
+	// Queuing async traces isn't thread safe, but the traces themselves run on worker threads and come back next frame.
+	UWorld* world = GetWorld();
+	AActor* lastInstigator = nullptr;
+	for (int32 i = 0; i < count; i++) {
+		// Each trace takes a copy of its params, so one set can be reused. Rounds from the same shooter tend to be
+		// next to each other, so it rarely needs rebuilding.
+		AActor* instigator = instigators[i].Get();
+		if (instigator != nullptr && instigator != lastInstigator) {
+			instigatorQueryParams.ClearIgnoredActors();
+			instigatorQueryParams.AddIgnoredActor(instigator);
+			lastInstigator = instigator;
+		}
+		const FCollisionQueryParams& params = instigator != nullptr ? instigatorQueryParams : queryParams;
+
+		const float radius = typeData[types[i]].radius;
+		if (radius > 0.0f) {
+			traces[i] = world->AsyncSweepByProfile(EAsyncTraceType::Single, stepStarts[i], positions[i], FQuat::Identity, CollisionProfile, FCollisionShape::MakeSphere(radius), params);
+		}
+		else {
+			traces[i] = world->AsyncLineTraceByProfile(EAsyncTraceType::Single, stepStarts[i], positions[i], CollisionProfile, params);
+		}
+	}
+	INC_DWORD_STAT_BY(STAT_ProjectileTraces, count);
+}
+
+void UProjectileManagerSubsystem::UpdateInstances() {
+	SCOPE_CYCLE_COUNTER(STAT_ProjectileInstances);
+
+	if (instances == nullptr) {
+		return;
+	}
+
+	// Instances are never removed, just shrunk out of sight, so the mesh doesn't have to shuffle its instance data around.
+	const int32 count = positions.Num();
+	const int32 instanceCount = FMath::Max(count, instances->GetInstanceCount());
+	instanceTransforms.SetNumUninitialized(instanceCount, false);
+	for (int32 i = 0; i < count; i++) {
+		instanceTransforms[i] = FTransform(FQuat::Identity, positions[i], ProjectileMeshScale);
+	}
+	for (int32 i = count; i < instanceCount; i++) {
+		instanceTransforms[i] = FTransform(FQuat::Identity, FVector::ZeroVector, FVector::ZeroVector);
+	}
+
+	for (int32 i = instances->GetInstanceCount(); i < instanceCount; i++) {
+		instances->AddInstanceWorldSpace(instanceTransforms[i]);
+	}
+	if (instanceCount > 0) {
+		instances->BatchUpdateInstancesTransforms(0, instanceTransforms, true, true, true);
+	}
+	drawnCount = count;
+}
+
+ETickableTickType UProjectileManagerSubsystem::GetTickableTickType() const {
+	// The CDO should never be ticked.
+	return IsTemplate() ? ETickableTickType::Never : ETickableTickType::Conditional;
+}
+
+bool UProjectileManagerSubsystem::IsTickable() const {
+	// Keep going for one more tick after the last round is gone, so its instance gets hidden.
+	return positions.Num() > 0 || drawnCount > 0;
+}
+
+UWorld* UProjectileManagerSubsystem::GetTickableGameObjectWorld() const {
+	return GetWorld();
+}
+
+TStatId UProjectileManagerSubsystem::GetStatId() const {
+	RETURN_QUICK_DECLARE_CYCLE_STAT(UProjectileManagerSubsystem, STATGROUP_Tickables);
+}
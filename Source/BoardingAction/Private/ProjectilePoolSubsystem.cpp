@@ -0,0 +1,133 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "ProjectilePoolSubsystem.h"
+#include "BoardingAction.h"
+#include "BoardingActionProjectile.h"
+#include "Engine/World.h"
+
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Projectile Pool Size"), STAT_ProjectilePoolSize, STATGROUP_BoardingActionProjectiles);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Projectiles Active"), STAT_ProjectilesActive, STATGROUP_BoardingActionProjectiles);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Projectile Pool High Water"), STAT_ProjectilePoolHighWater, STATGROUP_BoardingActionProjectiles);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Projectile Pool Misses"), STAT_ProjectilePoolMisses, STATGROUP_BoardingActionProjectiles);
+
+TRACE_DECLARE_INT_COUNTER(ProjectilesActiveCounter, TEXT("BoardingAction/Projectiles Active"));
+
+UProjectilePoolSubsystem::UProjectilePoolSubsystem() {
+	PrewarmCount = 64;
+	MaxPoolSize = 512;
+}
+
+void UProjectilePoolSubsystem::Deinitialize() {
+	// The world is going away, and it takes the pooled actors with it.
+	pools.Empty();
+	highWater = 0;
+}
+
+void UProjectilePoolSubsystem::Prewarm(TSubclassOf<ABoardingActionProjectile> projectileClass, int32 count) {
+	if (projectileClass == nullptr) {
+		return;
+	}
+	FProjectilePool& pool = pools.FindOrAdd(projectileClass);
+	count = FMath::Min(count, MaxPoolSize);
+	pool.available.Reserve(count);
+	while (pool.available.Num() < count) {
+		ABoardingActionProjectile* projectile = SpawnPooled(projectileClass, pool);
+		if (projectile == nullptr) {
+			break;
+		}
+		pool.available.Add(projectile);
+	}
+	UpdateStats();
+}
+
+ABoardingActionProjectile* UProjectilePoolSubsystem::SpawnPooled(UClass* projectileClass, FProjectilePool& pool) {
+	FActorSpawnParameters params;
+	params.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+	ABoardingActionProjectile* projectile = GetWorld()->SpawnActor<ABoardingActionProjectile>(projectileClass, FTransform::Identity, params);
+	if (projectile == nullptr) {
+		return nullptr;
+	}
+	projectile->SetPool(this);
+	projectile->Deactivate();
+	pool.total++;
+	return projectile;
+}
+
+ABoardingActionProjectile* UProjectilePoolSubsystem::Acquire(TSubclassOf<ABoardingActionProjectile> projectileClass, const FVector& location, const FRotator& rotation, AActor* owner, APawn* instigator) {
+	if (projectileClass == nullptr) {
+		return nullptr;
+	}
+	FProjectilePool& pool = pools.FindOrAdd(projectileClass);
+
+	ABoardingActionProjectile* projectile = nullptr;
+	while (projectile == nullptr && pool.available.Num() > 0) {
+		projectile = pool.available.Pop(false);
+		// Anything destroyed behind our back gets nulled out by GC.
+		if (!IsValid(projectile)) {
+			projectile = nullptr;
+		}
+	}
+	if (projectile == nullptr) {
+		INC_DWORD_STAT(STAT_ProjectilePoolMisses);
+		projectile = SpawnPooled(projectileClass, pool);
+		if (projectile == nullptr) {
+			return nullptr;
+		}
+	}
+
+	projectile->SetOwner(owner);
+	projectile->SetInstigator(instigator);
+	projectile->Fire(location, rotation);
+
+	highWater = FMath::Max(highWater, GetActiveCount());
+	UpdateStats();
+	return projectile;
+}
+
+void UProjectilePoolSubsystem::Release(ABoardingActionProjectile* projectile) {
+	// Already back in the pool, e.g. it hit something on the same frame its life span ran out.
+	if (!IsValid(projectile) || !projectile->IsActive()) {
+		return;
+	}
+	FProjectilePool* pool = projectile->GetPool() == this ? pools.Find(projectile->GetClass()) : nullptr;
+	if (pool == nullptr || pool->available.Num() >= MaxPoolSize) {
+		projectile->Destroy();
+		return;
+	}
+	projectile->Deactivate();
+	pool->available.Add(projectile);
+	UpdateStats();
+}
+
+void UProjectilePoolSubsystem::OnProjectileDestroyed(ABoardingActionProjectile* projectile) {
+	if (FProjectilePool* pool = pools.Find(projectile->GetClass())) {
+		pool->available.RemoveSingleSwap(projectile, false);
+		pool->total--;
+		UpdateStats();
+	}
+}
+
+int32 UProjectilePoolSubsystem::GetPooledCount() const {
+	int32 count = 0;
+	for (const auto& pair : pools) {
+		count += pair.Value.available.Num();
+	}
+	return count;
+}
+
+int32 UProjectilePoolSubsystem::GetActiveCount() const {
+	int32 count = 0;
+	for (const auto& pair : pools) {
+		count += pair.Value.total - pair.Value.available.Num();
+	}
+	return count;
+}
+
+void UProjectilePoolSubsystem::UpdateStats() const {
+	SET_DWORD_STAT(STAT_ProjectilePoolSize, GetPooledCount());
+	SET_DWORD_STAT(STAT_ProjectilesActive, GetActiveCount());
+	SET_DWORD_STAT(STAT_ProjectilePoolHighWater, highWater);
+	TRACE_COUNTER_SET(ProjectilesActiveCounter, GetActiveCount());
+	CSV_CUSTOM_STAT(BoardingAction, ProjectilesActive, GetActiveCount(), ECsvCustomStatOp::Set);
+}
@@ -0,0 +1,303 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "ShipSectionSubsystem.h"
+#include "BoardingAction.h"
+#include "ShipSectionVolume.h"
+#include "GravityController.h"
+#include "GravityPropCollection.h"
+#include "Components/BoxComponent.h"
+#include "Engine/Level.h"
+#include "Engine/LevelStreaming.h"
+#include "Engine/LevelStreamingDynamic.h"
+#include "Engine/World.h"
+#include "GameFramework/Pawn.h"
+#include "GameFramework/PlayerController.h"
+#include "Kismet/GameplayStatics.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogShipSections, Log, All);
+
+DECLARE_CYCLE_STAT(TEXT("Ship Section Update"), STAT_ShipSectionUpdate, STATGROUP_BoardingAction);
+DECLARE_CYCLE_STAT(TEXT("Ship Section Save"), STAT_ShipSectionSave, STATGROUP_BoardingAction);
+DECLARE_CYCLE_STAT(TEXT("Ship Section Restore"), STAT_ShipSectionRestore, STATGROUP_BoardingAction);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Ship Sections Resident"), STAT_ShipSectionsResident, STATGROUP_BoardingAction);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Ship Sections Frozen"), STAT_ShipSectionsFrozen, STATGROUP_BoardingAction);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Ship Section Saved Bodies"), STAT_ShipSectionSavedBodies, STATGROUP_BoardingAction);
+
+TRACE_DECLARE_INT_COUNTER(ShipSectionsResidentCounter, TEXT("BoardingAction/Ship Sections Resident"));
+
+UShipSectionSubsystem::UShipSectionSubsystem() {
+	ShowDistance = 3000.0f;
+	KeepLoadedDistance = 8000.0f;
+	Hysteresis = 500.0f;
+	UpdateInterval = 0.5f;
+}
+
+void UShipSectionSubsystem::Initialize(FSubsystemCollectionBase& Collection) {
+	timeSinceUpdate = 0.0f;
+}
+
+void UShipSectionSubsystem::Deinitialize() {
+	sections.Empty();
+	streamingLevels.Empty();
+	saved.Empty();
+	wasVisible.Empty();
+}
+
+void UShipSectionSubsystem::RegisterSection(AShipSectionVolume* section) {
+	if (section == nullptr || sections.Contains(section)) {
+		return;
+	}
+	if (section->Level.IsNull()) {
+		UE_LOG(LogShipSections, Warning, TEXT("%s has no level to stream."), *section->GetName());
+	}
+	sections.Add(section);
+	streamingLevels.Add(nullptr);
+	saved.AddDefaulted();
+	wasVisible.Add(false);
+	// Don't leave whoever's standing in it waiting for the first update.
+	timeSinceUpdate = UpdateInterval;
+}
+
+void UShipSectionSubsystem::UnregisterSection(AShipSectionVolume* section) {
+	int32 index = sections.Find(section);
+	if (index != INDEX_NONE) {
+		sections.RemoveAtSwap(index, 1, false);
+		streamingLevels.RemoveAtSwap(index, 1, false);
+		saved.RemoveAtSwap(index, 1, false);
+		wasVisible.RemoveAtSwap(index, 1, false);
+	}
+}
+
+int32 UShipSectionSubsystem::GetResidentCount() const {
+	int32 count = 0;
+	for (ULevelStreaming* level : streamingLevels) {
+		count += level != nullptr && level->IsLevelVisible();
+	}
+	return count;
+}
+
+int32 UShipSectionSubsystem::GetFrozenCount() const {
+	int32 count = 0;
+	for (ULevelStreaming* level : streamingLevels) {
+		count += level != nullptr && level->IsLevelLoaded() && !level->IsLevelVisible();
+	}
+	return count;
+}
+
+int32 UShipSectionSubsystem::GetSavedBodyCount() const {
+	int32 count = 0;
+	for (const FSavedSection& section : saved) {
+		count += section.bodies.Num();
+	}
+	return count;
+}
+
+ULevelStreaming* UShipSectionSubsystem::GetStreamingLevel(int32 index) {
+	if (streamingLevels[index] != nullptr || sections[index]->Level.IsNull()) {
+		return streamingLevels[index];
+	}
+
+	const TSoftObjectPtr<UWorld>& level = sections[index]->Level;
+	ULevelStreaming* streaming = UGameplayStatics::GetStreamingLevel(GetWorld(), FName(*level.GetLongPackageName()));
+	if (streaming == nullptr) {
+		bool bSuccess = false;
+		streaming = ULevelStreamingDynamic::LoadLevelInstanceBySoftObjectPtr(GetWorld(), level, FVector::ZeroVector, FRotator::ZeroRotator, bSuccess);
+		if (!bSuccess) {
+			UE_LOG(LogShipSections, Warning, TEXT("%s couldn't stream %s."), *sections[index]->GetName(), *level.ToString());
+		}
+	}
+	streamingLevels[index] = streaming;
+	return streaming;
+}
+
+void UShipSectionSubsystem::Tick(float DeltaTime) {
+	// Shown levels have had BeginPlay by the time they count as visible, so the bodies are there to put back.
+	for (int32 i = 0; i < sections.Num(); i++) {
+		const bool bVisible = streamingLevels[i] != nullptr && streamingLevels[i]->IsLevelVisible();
+		if (bVisible && !wasVisible[i]) {
+			RestoreSection(i);
+		}
+		wasVisible[i] = bVisible;
+	}
+
+	timeSinceUpdate += DeltaTime;
+	if (timeSinceUpdate >= UpdateInterval) {
+		timeSinceUpdate = 0.0f;
+		UpdateSections();
+	}
+}
+
+void UShipSectionSubsystem::UpdateSections() {
+	SCOPE_CYCLE_COUNTER(STAT_ShipSectionUpdate);
+	TRACE_CPUPROFILER_EVENT_SCOPE(UShipSectionSubsystem::UpdateSections);
+
+	playerLocations.Reset();
+	for (FConstPlayerControllerIterator it = GetWorld()->GetPlayerControllerIterator(); it; ++it) {
+		if (APawn* pawn = it->IsValid() ? (*it)->GetPawn() : nullptr) {
+			playerLocations.Add(pawn->GetActorLocation());
+		}
+	}
+
+	for (int32 i = 0; i < sections.Num(); i++) {
+		AShipSectionVolume* section = sections[i];
+		if (!IsValid(section)) {
+			continue;
+		}
+		const FBox box = section->Bounds->Bounds.GetBox();
+		float distanceSquared = MAX_FLT;
+		for (const FVector& player : playerLocations) {
+			distanceSquared = FMath::Min(distanceSquared, box.ComputeSquaredDistanceToPoint(player));
+		}
+		const float distance = FMath::Sqrt(distanceSquared);
+
+		ULevelStreaming* level = streamingLevels[i];
+		const bool bShown = level != nullptr && level->ShouldBeVisible();
+		const bool bLoaded = level != nullptr && level->ShouldBeLoaded();
+		const bool bShow = distance < ShowDistance + (bShown ? Hysteresis : 0.0f);
+		const bool bKeepLoaded = bShow || distance < KeepLoadedDistance + (bLoaded ? Hysteresis : 0.0f) || (bLoaded && !section->bUnloadWhenFar);
+		if (level == nullptr) {
+			// Never been near it, so there's nothing to do until someone is.
+			if (!bKeepLoaded || (level = GetStreamingLevel(i)) == nullptr) {
+				continue;
+			}
+		}
+
+		// Saved while it's still in the world, since hiding it takes every body out.
+		if (bShown && !bShow && level->IsLevelVisible()) {
+			SaveSection(i);
+		}
+		// A player standing in a section that isn't there yet would fall straight through it, so that one can't wait.
+		level->bShouldBlockOnLoad = bShow && distance == 0.0f && !level->IsLevelVisible();
+		level->SetShouldBeLoaded(bKeepLoaded);
+		level->SetShouldBeVisible(bShow);
+	}
+
+	const int32 resident = GetResidentCount();
+	SET_DWORD_STAT(STAT_ShipSectionsResident, resident);
+	SET_DWORD_STAT(STAT_ShipSectionsFrozen, GetFrozenCount());
+	SET_DWORD_STAT(STAT_ShipSectionSavedBodies, GetSavedBodyCount());
+	TRACE_COUNTER_SET(ShipSectionsResidentCounter, resident);
+	CSV_CUSTOM_STAT(BoardingAction, ShipSectionsResident, resident, ECsvCustomStatOp::Set);
+}
+
+void UShipSectionSubsystem::SaveSection(int32 index) {
+	SCOPE_CYCLE_COUNTER(STAT_ShipSectionSave);
+	TRACE_CPUPROFILER_EVENT_SCOPE(UShipSectionSubsystem::SaveSection);
+	ULevel* level = streamingLevels[index]->GetLoadedLevel();
+	if (level == nullptr) {
+		return;
+	}
+
+	FSavedSection& state = saved[index];
+	state.bodies.Reset();
+	state.motions.Reset();
+	auto save = [&state](AActor* actor, FName component, int32 item, FBodyInstance* body) {
+		if (body == nullptr || !body->IsInstanceSimulatingPhysics()) {
+			return;
+		}
+		const FTransform transform = body->GetUnrealWorldTransform();
+		const FRotator rotation = transform.Rotator();
+		FSavedSectionBody& entry = state.bodies.AddDefaulted_GetRef();
+		entry.actor = actor->GetFName();
+		entry.component = component;
+		entry.item = item;
+		entry.location = transform.GetLocation();
+		entry.rotation[0] = FRotator::CompressAxisToShort(rotation.Pitch);
+		entry.rotation[1] = FRotator::CompressAxisToShort(rotation.Yaw);
+		entry.rotation[2] = FRotator::CompressAxisToShort(rotation.Roll);
+		entry.motion = INDEX_NONE;
+		if (body->IsInstanceAwake()) {
+			entry.motion = state.motions.Add(FSavedSectionMotion{body->GetUnrealWorldVelocity(), body->GetUnrealWorldAngularVelocityInRadians()});
+		}
+	};
+
+	for (AActor* actor : level->Actors) {
+		// Anything spawned at runtime won't be there to restore into once the level's reloaded, and pawns look after themselves.
+		if (!IsValid(actor) || !actor->HasAnyFlags(RF_WasLoaded) || actor->IsA<APawn>()) {
+			continue;
+		}
+		if (actor->FindComponentByClass<UGravityController>() != nullptr) {
+			// The same body the controller registers.
+			if (UPrimitiveComponent* body = actor->FindComponentByClass<UPrimitiveComponent>()) {
+				save(actor, NAME_None, INDEX_NONE, body->GetBodyInstance());
+			}
+		}
+		TInlineComponentArray<UGravityPropCollection*> collections(actor);
+		for (UGravityPropCollection* collection : collections) {
+			for (int32 i = 0; i < collection->GetInstanceCount(); i++) {
+				save(actor, collection->GetFName(), i, collection->GetBodyInstance(NAME_None, true, i));
+			}
+		}
+	}
+	state.bodies.Shrink();
+	state.motions.Shrink();
+	UE_LOG(LogShipSections, Verbose, TEXT("Saved %d bodies (%d moving) in %s."), state.bodies.Num(), state.motions.Num(), *sections[index]->GetName());
+}
+
+void UShipSectionSubsystem::RestoreSection(int32 index) {
+	SCOPE_CYCLE_COUNTER(STAT_ShipSectionRestore);
+	TRACE_CPUPROFILER_EVENT_SCOPE(UShipSectionSubsystem::RestoreSection);
+	ULevel* level = streamingLevels[index]->GetLoadedLevel();
+	FSavedSection& state = saved[index];
+	if (level == nullptr || state.bodies.Num() == 0) {
+		return;
+	}
+
+	for (const FSavedSectionBody& body : state.bodies) {
+		AActor* actor = FindObjectFast<AActor>(level, body.actor);
+		if (actor == nullptr) {
+			continue;
+		}
+		const FQuat rotation = FRotator{FRotator::DecompressAxisFromShort(body.rotation[0]), FRotator::DecompressAxisFromShort(body.rotation[1]), FRotator::DecompressAxisFromShort(body.rotation[2])}.Quaternion();
+
+		FBodyInstance* instance = nullptr;
+		if (body.component.IsNone()) {
+			UPrimitiveComponent* component = actor->FindComponentByClass<UPrimitiveComponent>();
+			if (component == nullptr) {
+				continue;
+			}
+			component->SetWorldLocationAndRotation(body.location, rotation, false, nullptr, ETeleportType::TeleportPhysics);
+			instance = component->GetBodyInstance();
+		}
+		else if (UGravityPropCollection* collection = FindObjectFast<UGravityPropCollection>(actor, body.component)) {
+			collection->TeleportInstance(body.item, FTransform(rotation, body.location));
+			instance = collection->GetBodyInstance(NAME_None, true, body.item);
+		}
+		if (instance == nullptr || !instance->IsInstanceSimulatingPhysics()) {
+			continue;
+		}
+
+		if (body.motion != INDEX_NONE) {
+			const FSavedSectionMotion& motion = state.motions[body.motion];
+			instance->SetLinearVelocity(motion.linear, false);
+			instance->SetAngularVelocityInRadians(motion.angular, false);
+		}
+		else {
+			// It was asleep when it left, and would only wake up to settle back down onto what it was lying on.
+			instance->PutInstanceToSleep();
+		}
+	}
+	UE_LOG(LogShipSections, Verbose, TEXT("Restored %d bodies in %s."), state.bodies.Num(), *sections[index]->GetName());
+
+	// Only needed while the section's away.
+	state.bodies.Empty();
+	state.motions.Empty();
+}
+
+ETickableTickType UShipSectionSubsystem::GetTickableTickType() const {
+	// The CDO should never be ticked.
+	return IsTemplate() ? ETickableTickType::Never : ETickableTickType::Conditional;
+}
+
+bool UShipSectionSubsystem::IsTickable() const {
+	return sections.Num() > 0;
+}
+
+UWorld* UShipSectionSubsystem::GetTickableGameObjectWorld() const {
+	return GetWorld();
+}
+
+TStatId UShipSectionSubsystem::GetStatId() const {
+	RETURN_QUICK_DECLARE_CYCLE_STAT(UShipSectionSubsystem, STATGROUP_Tickables);
+}
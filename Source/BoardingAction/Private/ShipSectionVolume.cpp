@@ -0,0 +1,37 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "ShipSectionVolume.h"
+#include "ShipSectionSubsystem.h"
+#include "Components/BoxComponent.h"
+#include "Engine/World.h"
+
+AShipSectionVolume::AShipSectionVolume()
+{
+	PrimaryActorTick.bCanEverTick = false;
+
+	Bounds = CreateDefaultSubobject<UBoxComponent>(TEXT("Bounds"));
+	Bounds->InitBoxExtent(FVector{2000, 2000, 1000});
+	Bounds->SetCollisionEnabled(ECollisionEnabled::NoCollision);
+	Bounds->SetCanEverAffectNavigation(false);
+	RootComponent = Bounds;
+
+	bUnloadWhenFar = true;
+}
+
+void AShipSectionVolume::BeginPlay()
+{
+	Super::BeginPlay();
+	sections = GetWorld()->GetSubsystem<UShipSectionSubsystem>();
+	if (sections != nullptr) {
+		sections->RegisterSection(this);
+	}
+}
+
+void AShipSectionVolume::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	if (sections != nullptr) {
+		sections->UnregisterSection(this);
+	}
+	Super::EndPlay(EndPlayReason);
+}
@@ -0,0 +1,156 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "Tickable.h"
+#include "BenchmarkSubsystem.generated.h"
+
+class ABoardingActionProjectile;
+class AEnemy;
+class UPhysicsSubsystem;
+
+// One timing (in milliseconds) recorded every benchmark frame.
+struct FBenchmarkMetric
+{
+	FString name;
+	TArray<float> samples;
+
+	// p is in [0, 1]. Nearest rank, so it's always a value that was actually recorded.
+	float GetPercentile(float p) const;
+	float GetMean() const;
+};
+
+/**
+ * Headless performance benchmark. Only exists when the game is started with -GravityBenchmark, e.g.
+ *   UE4Editor-Cmd BoardingAction.uproject /Engine/Maps/Entry -game -nullrhi -nosound -unattended -benchmark -fps=60 -GravityBenchmark
+ * Builds a closed test arena, fills it with gravity props, enemies and projectiles, cycles gravity the way
+ * ABoardingActionCharacter::OnRightClick does, and records game thread, physics and gravity timings every frame.
+ * When it's done it writes them out (per frame as CSV, percentiles as JSON), compares against the stored baseline
+ * and exits with a nonzero code if anything regressed.
+ */
+UCLASS(config=Game)
+class BOARDINGACTION_API UBenchmarkSubsystem : public UWorldSubsystem, public FTickableGameObject
+{
+	GENERATED_BODY()
+public:
+	UBenchmarkSubsystem();
+
+	virtual bool ShouldCreateSubsystem(UObject* Outer) const override;
+	virtual void Initialize(FSubsystemCollectionBase& Collection);
+	virtual void Deinitialize();
+
+	// Everything below can be overridden on the command line with -Benchmark<Name>=, e.g. -BenchmarkProps=2000.
+
+	// Seconds of game time to let things settle before recording, then how long to record for.
+	UPROPERTY(Config)
+	float WarmupTime;
+
+	UPROPERTY(Config)
+	float Duration;
+
+	// Seconds between gravity changes.
+	UPROPERTY(Config)
+	float GravityChangeInterval;
+
+	// Physics simulated cubes with a UGravityController.
+	UPROPERTY(Config)
+	int32 PropCount;
+
+	// Spawn the props as instances of one UGravityPropCollection rather than as actors.
+	UPROPERTY(Config)
+	bool bUseInstancedProps;
+
+	UPROPERTY(Config)
+	int32 EnemyCount;
+
+	// Boarders simulated by UCrowdSubsystem rather than as actors.
+	UPROPERTY(Config)
+	int32 CrowdCount;
+
+	UPROPERTY(Config)
+	float ProjectilesPerSecond;
+
+	// Fire through UProjectileManagerSubsystem rather than pooled actors, same as ABoardingActionCharacter::bUseProjectileManager.
+	UPROPERTY(Config)
+	bool bUseProjectileManager;
+
+	UPROPERTY(Config)
+	TSubclassOf<AEnemy> EnemyClass;
+
+	UPROPERTY(Config)
+	TSubclassOf<ABoardingActionProjectile> ProjectileClass;
+
+	// Used (unscaled, 100cm) for the props, and scaled up for the arena's walls.
+	UPROPERTY(Config)
+	FSoftObjectPath CubeMesh;
+
+	// Inside size of the arena, which is a closed box so every gravity direction has something to land on.
+	UPROPERTY(Config)
+	float ArenaSize;
+
+	// Seed for everything placed at random, so every run starts out the same.
+	UPROPERTY(Config)
+	int32 RandomSeed;
+
+	// Relative to the project directory.
+	UPROPERTY(Config)
+	FString OutputDirectory;
+
+	UPROPERTY(Config)
+	FString BaselineFile;
+
+	// How much slower (as a fraction) a percentile can get before it counts as a regression.
+	UPROPERTY(Config)
+	float RegressionTolerance;
+
+	// FTickableGameObject
+	virtual void Tick(float DeltaTime) override;
+	virtual ETickableTickType GetTickableTickType() const override;
+	virtual bool IsTickable() const override;
+	virtual UWorld* GetTickableGameObjectWorld() const override;
+	virtual TStatId GetStatId() const override;
+protected:
+	enum class EBenchmarkPhase : uint8
+	{
+		// Waiting for the world to begin play.
+		Setup,
+		Warmup,
+		Recording,
+		Finished
+	};
+
+	void ParseCommandLine();
+	void BuildArena();
+	AActor* SpawnCube(const FVector& location, const FVector& scale, bool bSimulatePhysics);
+	void SpawnProps();
+	void SpawnEnemies();
+	void FireProjectiles(float DeltaTime);
+	void AdvanceGravity();
+	void Record(double frameSeconds);
+	// Writes the results out and compares them to the baseline. Returns the exit code.
+	int32 Finish();
+	FString BuildSummaryJson() const;
+	// Returns how many metrics got slower than the baseline allows, or INDEX_NONE if there's no baseline to compare to.
+	int32 CompareToBaseline(const FString& baselinePath) const;
+
+	EBenchmarkPhase phase;
+	float phaseTime;
+	float gravityTime;
+	int32 gravityStep;
+	float projectileBudget;
+	double lastFrameSeconds;
+	// Set with -BenchmarkSaveBaseline, writes this run's results over the baseline instead of comparing to it.
+	bool bSaveBaseline;
+
+	FRandomStream random;
+
+	TArray<FBenchmarkMetric> metrics;
+	// Parallel to each metric's samples, so the CSV shows how busy the frame was.
+	TArray<int32> bodyCounts;
+	TArray<int32> projectileCounts;
+
+	UPROPERTY()
+	UPhysicsSubsystem* worldPhysics;
+};
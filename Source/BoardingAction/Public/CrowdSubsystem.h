@@ -0,0 +1,156 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "Tickable.h"
+#include "WorldCollision.h"
+#include "CrowdSubsystem.generated.h"
+
+class AEnemy;
+struct FStreamableHandle;
+class UInstancedStaticMeshComponent;
+class UPhysicsSubsystem;
+
+UENUM()
+enum class ECrowdEntityState : uint8
+{
+	// Standing on a floor, walking along it towards the closest player.
+	Grounded,
+	// No floor underneath, so falling along its gravity until it lands.
+	Falling,
+	// Close enough to a player that it's a real AEnemy for now. The entity's data is stale until it's demoted again.
+	Promoted
+};
+
+/**
+ * Boarders that are too far from any player to need a full AEnemy, kept as packed arrays and simulated in parallel batches.
+ * They walk towards the players on whatever floor their gravity gives them, and are all drawn through one instanced mesh.
+ * An entity is swapped for a real AEnemy when it gets close to a player, and swapped back once it's far enough away again.
+ */
+UCLASS(config=Game)
+class BOARDINGACTION_API UCrowdSubsystem : public UWorldSubsystem, public FTickableGameObject
+{
+	GENERATED_BODY()
+public:
+	UCrowdSubsystem();
+
+	virtual void Initialize(FSubsystemCollectionBase& Collection);
+	virtual void Deinitialize();
+
+	// Adds a boarder standing at location (its feet, not its centre). Returns false if we're already at MaxEntities.
+	bool AddEntity(const FVector& location);
+	// Scatters count boarders in a disc of radius around location, perpendicular to the gravity there.
+	int32 AddEntities(const FVector& location, int32 count, float radius);
+
+	int32 GetEntityCount() const { return positions.Num(); }
+	int32 GetPromotedCount() const { return promotedCount; }
+
+	// The enemy an entity becomes when it's promoted.
+	UPROPERTY(Config)
+	TSoftClassPtr<AEnemy> EnemyClass;
+
+	// Mesh every non-promoted entity is drawn with. It's meant to have a vertex animated material, which gets the
+	// entity's animation time and speed through per instance custom data 0 and 1.
+	UPROPERTY(Config)
+	FSoftObjectPath CrowdMesh;
+
+	UPROPERTY(Config)
+	int32 MaxEntities;
+
+	// Entities closer than this to a player are promoted, and promoted enemies further than DemoteDistance are demoted.
+	UPROPERTY(Config)
+	float PromoteDistance;
+
+	UPROPERTY(Config)
+	float DemoteDistance;
+
+	// Caps on promotion, so a whole wave arriving at once doesn't spawn a wave of actors on the same frame.
+	UPROPERTY(Config)
+	int32 MaxPromotionsPerFrame;
+
+	UPROPERTY(Config)
+	int32 MaxPromoted;
+
+	UPROPERTY(Config)
+	float WalkSpeed;
+
+	// Grounded entities look for their floor every this many frames, staggered.
+	UPROPERTY(Config)
+	int32 GroundCheckInterval;
+
+	// How far above its feet an entity looks for its floor from, and how far below them.
+	UPROPERTY(Config)
+	float StepHeight;
+
+	UPROPERTY(Config)
+	float GroundProbeDistance;
+
+	// How far an entity keeps from walls, roughly the promoted enemy's capsule radius.
+	UPROPERTY(Config)
+	float EntityRadius;
+
+	// FTickableGameObject
+	virtual void Tick(float DeltaTime) override;
+	virtual ETickableTickType GetTickableTickType() const override;
+	virtual bool IsTickable() const override;
+	virtual UWorld* GetTickableGameObjectWorld() const override;
+	virtual TStatId GetStatId() const override;
+protected:
+	// Applies last frame's floor and wall traces.
+	void ResolveTraces();
+	// Keeps an entity out of a wall it's walked or fallen into, sliding along it.
+	void HitWall(int32 index, const FHitResult& hit);
+	// Moves every entity that isn't promoted, in parallel batches.
+	void Simulate(float DeltaTime);
+	// Queues the floor and wall traces for the next frame.
+	void QueueTraces(float DeltaTime);
+	void UpdatePromotions();
+	// Returns false if there wasn't room to spawn the enemy, in which case the entity stays in the crowd.
+	bool Promote(int32 index);
+	void Demote(int32 index);
+	void RemoveAtSwap(int32 index);
+	void UpdateInstances();
+	void OnEnemyClassLoaded();
+
+	// One entry per entity, all parallel. Positions are at the entity's feet.
+	TArray<FVector> positions;
+	TArray<FVector> velocities;
+	// The gravity the entity felt last step. It's what decides which way is down for it.
+	TArray<FVector> gravities;
+	TArray<ECrowdEntityState> states;
+	TArray<float> animationTimes;
+	TArray<FTraceHandle> traces;
+	// Grounded entities look ahead along their walk every frame, so they don't walk through walls.
+	TArray<FTraceHandle> wallTraces;
+	UPROPERTY()
+	TArray<AEnemy*> actors;
+
+	int32 promotedCount;
+	uint32 frame;
+
+	// Scratch space, kept around so we don't reallocate every frame.
+	TArray<FVector> playerLocations;
+	TArray<FVector> stepGravity;
+	TArray<FTransform> instanceTransforms;
+
+	UPROPERTY()
+	UPhysicsSubsystem* worldPhysics;
+
+	UPROPERTY()
+	AActor* renderActor;
+
+	UPROPERTY()
+	UInstancedStaticMeshComponent* instances;
+	int32 drawnCount;
+
+	// EnemyClass, once it's loaded. Nothing is promoted until then.
+	UPROPERTY()
+	TSubclassOf<AEnemy> enemyClass;
+	TSharedPtr<FStreamableHandle> enemyClassHandle;
+	// Half height of the promoted enemy's capsule, so it's spawned standing on the entity's feet.
+	float enemyHalfHeight;
+
+	FCollisionQueryParams queryParams;
+};
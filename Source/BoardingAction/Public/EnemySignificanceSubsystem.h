@@ -0,0 +1,102 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "Tickable.h"
+#include "EnemySignificanceSubsystem.generated.h"
+
+class AEnemy;
+
+// How often an enemy in one significance tier gets to update. An interval of 0 means every frame.
+USTRUCT()
+struct FEnemySignificanceTier
+{
+	GENERATED_BODY()
+
+	// Enemies further than this from every player (after HiddenDistanceScale) drop to the next tier.
+	UPROPERTY()
+	float MaxDistance = BIG_NUMBER;
+
+	// The most enemies that can be in this tier at once. The furthest ones past that get pushed down a tier. 0 means no limit.
+	UPROPERTY()
+	int32 MaxCount = 0;
+
+	UPROPERTY()
+	float ActorTickInterval = 0.0f;
+
+	UPROPERTY()
+	float MovementTickInterval = 0.0f;
+
+	UPROPERTY()
+	float AnimationTickInterval = 0.0f;
+
+	// In frames, see UPhysicsSubsystem::SetMoverUpdateInterval.
+	UPROPERTY()
+	int32 GravityUpdateInterval = 1;
+
+	// Whether the pose still gets ticked when nobody can see the enemy. Montages are always ticked.
+	UPROPERTY()
+	bool bTickPoseWhenHidden = true;
+};
+
+/**
+ * Ranks enemies by how far they are from the players (and whether anyone can see them), and turns down how often
+ * the less significant ones tick, move, animate and check their gravity.
+ */
+UCLASS(config=Game)
+class BOARDINGACTION_API UEnemySignificanceSubsystem : public UWorldSubsystem, public FTickableGameObject
+{
+	GENERATED_BODY()
+public:
+	UEnemySignificanceSubsystem();
+
+	virtual void Deinitialize();
+
+	void RegisterEnemy(AEnemy* enemy);
+	void UnregisterEnemy(AEnemy* enemy);
+
+	// Ordered from most to least significant. The last tier catches everything.
+	UPROPERTY(Config)
+	TArray<FEnemySignificanceTier> Tiers;
+
+	// Seconds between re-rankings.
+	UPROPERTY(Config)
+	float UpdateInterval;
+
+	// Enemies no one has seen recently count as this much further away.
+	UPROPERTY(Config)
+	float HiddenDistanceScale;
+
+	// How far (as a fraction of the tier's MaxDistance) an enemy has to get past a tier's edge before it changes tier,
+	// so enemies sitting right on the edge don't flicker between the two.
+	UPROPERTY(Config)
+	float Hysteresis;
+
+	int32 GetTierCount(int32 tier) const { return tierCounts.IsValidIndex(tier) ? tierCounts[tier] : 0; }
+	int32 GetEnemyCount() const { return enemies.Num(); }
+
+	// FTickableGameObject
+	virtual void Tick(float DeltaTime) override;
+	virtual ETickableTickType GetTickableTickType() const override;
+	virtual bool IsTickable() const override;
+	virtual UWorld* GetTickableGameObjectWorld() const override;
+	virtual TStatId GetStatId() const override;
+protected:
+	void Rank();
+	// The tier an enemy this far away belongs in, given the tier it's in now.
+	int32 GetTierForDistance(float distance, int32 currentTier) const;
+
+	UPROPERTY()
+	TArray<AEnemy*> enemies;
+	// Parallel to enemies.
+	TArray<uint8> enemyTiers;
+	TArray<float> enemyScores;
+
+	// Scratch space for ranking.
+	TArray<int32> rankOrder;
+	TArray<int32> tierCounts;
+
+	float timeSinceRank;
+};
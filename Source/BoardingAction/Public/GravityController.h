@@ -17,16 +17,29 @@ public:
 	// Sets default values for this component's properties
 	UGravityController();
 
+	// Multiplier on the gravity this body feels. Anything other than 1 means the body can't use solver gravity.
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category=Gravity)
+	float GravityScale;
+
+	// When UPhysicsSubsystem is in Solver mode, let the physics scene apply gravity to this body instead of the gravity pass.
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category=Gravity)
+	bool bUseSolverGravity;
+
+	// Let UPhysicsLODSubsystem take this body out of the physics scene while it's far from every player.
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category=Gravity)
+	bool bAllowPhysicsLOD;
+
 protected:
 	// Called when the game starts
 	virtual void BeginPlay() override;
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
+	// Gravity itself is applied by UPhysicsSubsystem in one batch, so all we do is hand it whatever it should pull on.
+	virtual void RegisterWithSubsystem();
+	virtual void UnregisterFromSubsystem();
+
 	AActor* parent;
 	UPhysicsSubsystem *worldPhysics;
+	class UPhysicsLODSubsystem* physicsLOD;
 	UPrimitiveComponent* mesh;
-
-public:	
-	// Called every frame
-	virtual void TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction) override;
-
-		
 };
@@ -0,0 +1,58 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Components/SceneComponent.h"
+#include "GravityFieldComponent.generated.h"
+
+class UPhysicsSubsystem;
+
+UENUM(BlueprintType)
+enum class EGravityFieldShape : uint8
+{
+	// Pulls along a fixed direction (in the component's local space).
+	Directional,
+	// Pulls towards the component's location.
+	Point,
+	// Pushes away from the component's local X axis, like a spinning ring section.
+	Cylindrical
+};
+
+/**
+ * A box shaped region of the level with its own gravity. Where fields overlap, the one with the highest priority wins.
+ * Anywhere outside of a field falls back to UPhysicsSubsystem's global gravity.
+ */
+UCLASS( ClassGroup=(Custom), meta=(BlueprintSpawnableComponent) )
+class BOARDINGACTION_API UGravityFieldComponent : public USceneComponent
+{
+	GENERATED_BODY()
+
+public:
+	UGravityFieldComponent();
+
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category=Gravity)
+	EGravityFieldShape Shape;
+
+	// Half size of the box (in local space) that this field covers.
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category=Gravity)
+	FVector Extent;
+
+	// Same units as UPhysicsSubsystem::SetGravity. Negative values flip the field.
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category=Gravity)
+	float Strength;
+
+	// Only used by Directional fields.
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category=Gravity, meta=(EditCondition="Shape == EGravityFieldShape::Directional"))
+	FVector Direction;
+
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category=Gravity)
+	int32 Priority;
+
+protected:
+	virtual void BeginPlay() override;
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+	virtual void OnUpdateTransform(EUpdateTransformFlags UpdateTransformFlags, ETeleportType Teleport) override;
+
+	UPhysicsSubsystem* worldPhysics;
+};
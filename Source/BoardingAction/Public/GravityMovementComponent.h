@@ -0,0 +1,85 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "GameFramework/CharacterMovementComponent.h"
+#include "PhysicsSubsystem.h"
+#include "GravityMovementComponent.generated.h"
+
+/**
+ * Character movement that falls, jumps, finds floors and walks relative to the gravity UPhysicsSubsystem gives it,
+ * instead of the world's -Z, so walls and ceilings can be walked on like any floor. The capsule is turned to match
+ * gravity as part of the movement update.
+ * While gravity points straight down this behaves exactly like UCharacterMovementComponent.
+ */
+UCLASS()
+class BOARDINGACTION_API UGravityMovementComponent : public UCharacterMovementComponent
+{
+	GENERATED_BODY()
+
+public:
+	UGravityMovementComponent();
+
+	// How much of a gravity transition happens per second, e.g. 2 means it takes half a second.
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category="Character Movement: Gravity")
+	float GravityRotationRate;
+
+	// Degrees gravity has to turn away from where the capsule is headed before it turns again. Point and cylindrical
+	// fields pull a little differently every frame as we move, and that shouldn't restart the transition each time.
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category="Character Movement: Gravity")
+	float GravityTransitionAngle;
+
+	// Unit vector pointing along the gravity this character currently feels.
+	FVector GetGravityDirection() const { return gravityDirection; }
+
+	virtual float GetGravityZ() const override;
+	virtual FVector NewFallingVelocity(const FVector& InitialVelocity, const FVector& Gravity, float DeltaTime) const override;
+	virtual bool DoJump(bool bReplayingMoves) override;
+	virtual bool IsWalkable(const FHitResult& Hit) const override;
+	virtual bool IsValidLandingSpot(const FVector& CapsuleLocation, const FHitResult& Hit) const override;
+	virtual void ComputeFloorDist(const FVector& CapsuleLocation, float LineDistance, float SweepDistance, FFindFloorResult& OutFloorResult, float SweepRadius, const FHitResult* DownwardSweepResult = NULL) const override;
+	virtual bool StepUp(const FVector& GravDir, const FVector& Delta, const FHitResult& Hit, FStepDownResult* OutStepDownResult = NULL) override;
+	virtual void AdjustFloorHeight() override;
+	virtual float SlideAlongSurface(const FVector& Delta, float Time, const FVector& Normal, FHitResult& Hit, bool bHandleImpact) override;
+	virtual FVector GetLedgeMove(const FVector& OldLocation, const FVector& Delta, const FVector& GravDir) const override;
+	virtual FVector GetFallingLateralAcceleration(float DeltaTime) override;
+	virtual float BoostAirControl(float DeltaTime, float TickAirControl, const FVector& FallAcceleration) override;
+
+protected:
+	virtual void BeginPlay() override;
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
+	virtual FVector ConstrainInputAcceleration(const FVector& InputAcceleration) const override;
+	virtual void MaintainHorizontalGroundVelocity() override;
+	virtual FVector ComputeGroundMovementDelta(const FVector& Delta, const FHitResult& RampHit, const bool bHitFromLineTrace) const override;
+	virtual void PhysicsRotation(float DeltaTime) override;
+	virtual void PhysWalking(float deltaTime, int32 Iterations) override;
+	virtual void MoveAlongFloor(const FVector& InVelocity, float DeltaSeconds, FStepDownResult* OutStepDownResult = NULL) override;
+	virtual FVector LimitAirControl(float DeltaTime, const FVector& FallAcceleration, const FHitResult& HitResult, bool bCheckForValidLandingSpot) override;
+
+	void OnGravityChanged(const FVector& oldGravity, const FVector& newGravity);
+	void OnLocalGravityChanged(const FVector& oldGravity, const FVector& newGravity);
+	// Switches over to newGravity and starts turning the capsule to match it, as if it had started turning age seconds ago.
+	void SetGravity(const FVector& newGravity, float age = 0.0f);
+	// GravityScale, and how much the physics volume we're in scales the world's gravity, as the base class applies them.
+	float GetGravityScaleFactor() const;
+	// True when gravity is straight down, in which case the base class already does the right thing.
+	bool IsDefaultGravityDirection() const;
+	// Same as IsWithinEdgeTolerance, measured across gravity instead of in the world's XY plane.
+	bool IsWithinGravityEdgeTolerance(const FVector& CapsuleLocation, const FVector& TestImpactPoint, float CapsuleRadius) const;
+
+	UPhysicsSubsystem* worldPhysics;
+
+	// In UPhysicsSubsystem units, so we can tell when it's actually changed.
+	FVector gravity;
+	FVector gravityDirection;
+	FVector gravityAcceleration;
+
+	// The gravity direction the capsule was last told to turn to.
+	FVector transitionDirection;
+
+	FQuat rotGravity;
+	FQuat oldRotation;
+	float rotGravityPercent;
+};
@@ -0,0 +1,120 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "Tickable.h"
+#include "Containers/Queue.h"
+#include "GravityNavSubsystem.generated.h"
+
+class AGravityNavVolume;
+class UPhysicsSubsystem;
+struct FGravityNavGraph;
+
+// Shared by the subsystem and the volumes that bake its graphs.
+DECLARE_LOG_CATEGORY_EXTERN(LogGravityNav, Log, All);
+
+// Fired on the game thread once a path request has been answered. The path runs from start to goal, in world space.
+DECLARE_DELEGATE_TwoParams(FOnGravityPathFound, bool /* bSuccess */, const TArray<FVector>& /* path */);
+
+// A baked FGravityNavGraph unpacked for searching. Immutable once built, so path queries can use it off the game thread.
+struct FGravityNavSearchGraph
+{
+	explicit FGravityNavSearchGraph(const FGravityNavGraph& graph);
+
+	// The closest node to location that's within maxDistance of it, or INDEX_NONE.
+	int32 FindNearestNode(const FVector& location, float maxDistance) const;
+	// A* from start to goal, giving up after visiting maxVisits nodes.
+	bool FindPath(int32 start, int32 goal, int32 maxVisits, TArray<FVector>& outPath) const;
+
+	int32 orientation;
+	FTransform frame;
+	float cellSize;
+	TArray<FVector> locations;
+	TArray<int32> firstEdge;
+	TArray<int32> edges;
+	// Nodes by grid cell, for FindNearestNode.
+	TMap<uint32, TArray<int32, TInlineAllocator<2>>> cells;
+};
+
+/**
+ * Answers path queries on the AGravityNavVolume graphs baked for the current gravity. When gravity changes, the active
+ * graphs are swapped for the ones baked for the new orientation, so nothing has to be rebuilt.
+ * Queries are collected over a frame and answered in batches on a worker thread.
+ */
+UCLASS(config=Game)
+class BOARDINGACTION_API UGravityNavSubsystem : public UWorldSubsystem, public FTickableGameObject
+{
+	GENERATED_BODY()
+public:
+	UGravityNavSubsystem();
+
+	virtual void Initialize(FSubsystemCollectionBase& Collection);
+	virtual void Deinitialize();
+
+	void RegisterVolume(AGravityNavVolume* volume);
+	void UnregisterVolume(AGravityNavVolume* volume);
+
+	// Queues up a path query. onFound is called on the game thread in a later frame. If gravity changes before the answer
+	// comes back, it fails, since the path would be for the wrong orientation.
+	void RequestPath(const FVector& start, const FVector& goal, FOnGravityPathFound onFound);
+
+	// The orientation the active graphs are for, or INDEX_NONE if the current gravity isn't one that gets baked.
+	int32 GetActiveOrientation() const { return activeOrientation; }
+
+	UPROPERTY(Config)
+	int32 MaxQueriesPerBatch;
+
+	// Nodes A* can visit before giving up on a query.
+	UPROPERTY(Config)
+	int32 MaxSearchVisits;
+
+	// How far from the nearest node a path's start or goal can be.
+	UPROPERTY(Config)
+	float MaxSnapDistance;
+
+	// FTickableGameObject
+	virtual void Tick(float DeltaTime) override;
+	virtual ETickableTickType GetTickableTickType() const override;
+	virtual bool IsTickable() const override;
+	virtual UWorld* GetTickableGameObjectWorld() const override;
+	virtual TStatId GetStatId() const override;
+protected:
+	typedef TSharedPtr<const FGravityNavSearchGraph, ESPMode::ThreadSafe> FSearchGraphPtr;
+
+	struct FPathQuery
+	{
+		int32 id;
+		FVector start;
+		FVector goal;
+	};
+
+	struct FPathResult
+	{
+		int32 id;
+		int32 orientation;
+		bool bSuccess;
+		TArray<FVector> path;
+	};
+
+	void OnGravityChanged(const FVector& oldGravity, const FVector& newGravity);
+	void SetActiveOrientation(int32 orientation);
+	void DispatchBatch();
+
+	UPhysicsSubsystem* worldPhysics;
+
+	UPROPERTY()
+	TArray<AGravityNavVolume*> volumes;
+	// Parallel to volumes, indexed by orientation.
+	TArray<TArray<FSearchGraphPtr>> volumeGraphs;
+	// One graph per volume for the current orientation. Swapped out wholesale, never edited.
+	TSharedPtr<const TArray<FSearchGraphPtr>, ESPMode::ThreadSafe> activeGraphs;
+	int32 activeOrientation;
+
+	TArray<FPathQuery> pendingQueries;
+	TMap<int32, FOnGravityPathFound> callbacks;
+	int32 nextQueryId;
+	// Filled in by the workers, emptied on the game thread. Shared, so a batch finishing after we're gone has somewhere to go.
+	TSharedPtr<TQueue<FPathResult, EQueueMode::Mpsc>, ESPMode::ThreadSafe> completed;
+};
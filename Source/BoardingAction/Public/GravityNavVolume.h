@@ -0,0 +1,115 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "GameFramework/Actor.h"
+#include "GravityNavVolume.generated.h"
+
+class UBoxComponent;
+class UGravityNavSubsystem;
+
+// A walkable spot in a FGravityNavGraph. Nodes sit on a grid in the graph's frame, so only the cell and the height are kept.
+USTRUCT()
+struct FGravityNavNode
+{
+	GENERATED_BODY()
+
+	UPROPERTY()
+	uint16 X = 0;
+
+	UPROPERTY()
+	uint16 Y = 0;
+
+	// Along the graph's up, i.e. against gravity.
+	UPROPERTY()
+	float Height = 0.0f;
+};
+
+// Where an agent can walk while gravity points along one of UPhysicsSubsystem's canonical orientations.
+USTRUCT()
+struct FGravityNavGraph
+{
+	GENERATED_BODY()
+
+	// Index into UPhysicsSubsystem's gravity orientations.
+	UPROPERTY()
+	int32 Orientation = INDEX_NONE;
+
+	// Corner of the grid, with Z pointing away from gravity.
+	UPROPERTY()
+	FTransform Frame;
+
+	UPROPERTY()
+	float CellSize = 0.0f;
+
+	UPROPERTY()
+	TArray<FGravityNavNode> Nodes;
+
+	// Node i's neighbours are Edges[FirstEdge[i]] up to (not including) Edges[FirstEdge[i + 1]].
+	UPROPERTY()
+	TArray<int32> FirstEdge;
+
+	UPROPERTY()
+	TArray<int32> Edges;
+
+	FVector GetNodeLocation(int32 node) const {
+		return Frame.TransformPosition(FVector{Nodes[node].X * CellSize, Nodes[node].Y * CellSize, Nodes[node].Height});
+	}
+};
+
+/**
+ * A box of the level that gets a navigation graph baked for every gravity orientation, so enemies can keep pathing on
+ * floors, walls and ceilings when the ship flips. Bake with Build Graphs in the details panel after changing the level.
+ */
+UCLASS()
+class BOARDINGACTION_API AGravityNavVolume : public AActor
+{
+	GENERATED_BODY()
+
+public:
+	AGravityNavVolume();
+
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category=Navigation)
+	UBoxComponent* Bounds;
+
+	UPROPERTY(EditAnywhere, Category=Navigation)
+	float CellSize;
+
+	UPROPERTY(EditAnywhere, Category=Navigation)
+	float AgentRadius;
+
+	UPROPERTY(EditAnywhere, Category=Navigation)
+	float AgentHalfHeight;
+
+	UPROPERTY(EditAnywhere, Category=Navigation)
+	float StepHeight;
+
+	// Cosine of the steepest floor an agent can stand on, relative to its up.
+	UPROPERTY(EditAnywhere, Category=Navigation)
+	float WalkableFloorZ;
+
+	// How many floors stacked on top of each other a single grid column can have.
+	UPROPERTY(EditAnywhere, Category=Navigation)
+	int32 MaxLayersPerColumn;
+
+	// Baked graphs, one per gravity orientation.
+	UPROPERTY()
+	TArray<FGravityNavGraph> Graphs;
+
+#if WITH_EDITOR
+	// Traces the level inside Bounds for every gravity orientation and stores the result in Graphs.
+	UFUNCTION(CallInEditor, Category=Navigation)
+	void BuildGraphs();
+#endif
+
+protected:
+	virtual void BeginPlay() override;
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
+#if WITH_EDITOR
+	void BuildGraph(int32 orientation, FGravityNavGraph& graph) const;
+#endif
+
+	UGravityNavSubsystem* navigation;
+};
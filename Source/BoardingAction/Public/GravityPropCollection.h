@@ -0,0 +1,50 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Components/InstancedStaticMeshComponent.h"
+#include "GravityPropCollection.generated.h"
+
+class UPhysicsSubsystem;
+
+/**
+ * A pile of identical props (crates and the like) as one component, instead of an actor and UGravityController each.
+ * Every instance gets its own simulated physics body, registered with UPhysicsSubsystem like any other gravity body,
+ * and the instances are moved to wherever their bodies ended up after physics.
+ * Instances are fixed once play begins: adding or removing them after that isn't supported.
+ */
+UCLASS(ClassGroup=(Custom), meta=(BlueprintSpawnableComponent))
+class BOARDINGACTION_API UGravityPropCollection : public UInstancedStaticMeshComponent
+{
+	GENERATED_BODY()
+
+public:
+	UGravityPropCollection();
+
+	// Same as UGravityController::GravityScale, for every instance.
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category=Gravity)
+	float GravityScale;
+
+	// Same as UGravityController::bUseSolverGravity, for every instance.
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category=Gravity)
+	bool bUseSolverGravity;
+
+	virtual void BeginPlay() override;
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+	virtual void TickComponent(float DeltaTime, enum ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction) override;
+	// The instance bodies are ours to make, so the engine shouldn't make its own (kinematic) ones in game.
+	virtual bool ShouldCreatePhysicsState() const override;
+
+	// Moves the instance and its body together, keeping its scale. For putting saved instances back, e.g. by UShipSectionSubsystem.
+	void TeleportInstance(int32 instance, const FTransform& transform);
+
+protected:
+	void CreateInstanceBodies();
+	void DestroyInstanceBodies();
+
+	// Each instance's scale, since the bodies only know their position and rotation.
+	TArray<FVector> instanceScales;
+
+	UPhysicsSubsystem* worldPhysics;
+};
@@ -21,10 +21,10 @@ public:
 protected:
 	// Called when the game starts
 	virtual void BeginPlay() override;
-	UCharacterMovementComponent* mover;
-public:	
-	// Called every frame
-	virtual void TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction) override;
 
-		
+	// Pawns are pulled through their movement component rather than their collision primitive.
+	virtual void RegisterWithSubsystem() override;
+	virtual void UnregisterFromSubsystem() override;
+
+	UCharacterMovementComponent* mover;
 };
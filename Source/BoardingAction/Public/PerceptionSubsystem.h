@@ -0,0 +1,81 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "Tickable.h"
+#include "WorldCollision.h"
+#include "PerceptionSubsystem.generated.h"
+
+/**
+ * Line of sight checks shared by every enemy. Asking whether an observer can see a target hands back whatever is
+ * cached for that pair and, if it's getting old, queues a new async trace for it. Only TraceBudgetPerFrame traces are
+ * sent off per frame, stalest first, so the cost stays flat however many enemies are looking.
+ */
+UCLASS(config=Game)
+class BOARDINGACTION_API UPerceptionSubsystem : public UWorldSubsystem, public FTickableGameObject
+{
+	GENERATED_BODY()
+public:
+	UPerceptionSubsystem();
+
+	virtual void Initialize(FSubsystemCollectionBase& Collection);
+	virtual void Deinitialize();
+
+	// Whether observer had line of sight to target as of the last trace for the pair, or false if there hasn't been one yet.
+	// Requests a new trace if the result is older than MaxStaleness. outAge is how old the answer is, in seconds.
+	bool CanSee(AActor* observer, AActor* target, float* outAge = nullptr);
+	// Forget everything about observer, e.g. when it's destroyed.
+	void RemoveObserver(AActor* observer);
+
+	UPROPERTY(Config)
+	int32 TraceBudgetPerFrame;
+
+	// Cached results older than this get traced again the next time they're asked for.
+	UPROPERTY(Config)
+	float MaxStaleness;
+
+	// Pairs nobody has asked about for this long are dropped from the cache.
+	UPROPERTY(Config)
+	float ForgetAfter;
+
+	UPROPERTY(Config)
+	TEnumAsByte<ECollisionChannel> TraceChannel;
+
+	// FTickableGameObject
+	virtual void Tick(float DeltaTime) override;
+	virtual ETickableTickType GetTickableTickType() const override;
+	virtual bool IsTickable() const override;
+	virtual UWorld* GetTickableGameObjectWorld() const override;
+	virtual TStatId GetStatId() const override;
+protected:
+	typedef TPair<TWeakObjectPtr<AActor>, TWeakObjectPtr<AActor>> FPerceptionKey;
+
+	struct FPerceptionEntry
+	{
+		bool bVisible = false;
+		bool bEverTraced = false;
+		// When the current answer was traced, and when someone last asked for it.
+		double tracedTime = 0.0;
+		double requestedTime = 0.0;
+		bool bQueued = false;
+		FTraceHandle trace;
+	};
+
+	// Picks up last frame's traces.
+	void ResolveTraces();
+	// Sends off up to TraceBudgetPerFrame of the queued pairs.
+	void SendTraces();
+	void ForgetUnused();
+
+	TMap<FPerceptionKey, FPerceptionEntry> entries;
+	// Pairs waiting for a trace. Sorted stalest first when the budget gets handed out.
+	TArray<FPerceptionKey> queue;
+	// Pairs with a trace in flight.
+	TArray<FPerceptionKey> inFlight;
+
+	double timeSinceForget;
+
+	FCollisionQueryParams queryParams;
+};
@@ -0,0 +1,115 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "Tickable.h"
+#include "WorldCollision.h"
+#include "PhysicsLODSubsystem.generated.h"
+
+class UPhysicsSubsystem;
+
+/**
+ * Physics level of detail for gravity bodies. Bodies that are moving but far from every player stop being simulated,
+ * and instead follow the closed form path a body under constant gravity would take, with a swept check against static
+ * geometry. When a player comes near, or the path hits something, they go back to full simulation with the velocity
+ * they'd have had. Bodies at rest are left alone, since the physics scene already puts those to sleep.
+ */
+UCLASS(config=Game)
+class BOARDINGACTION_API UPhysicsLODSubsystem : public UWorldSubsystem, public FTickableGameObject
+{
+	GENERATED_BODY()
+public:
+	UPhysicsLODSubsystem();
+
+	virtual void Initialize(FSubsystemCollectionBase& Collection);
+	virtual void Deinitialize();
+
+	// Same arguments as UPhysicsSubsystem::RegisterBody, which this calls again whenever the body goes back to being simulated.
+	// The body should already be registered with UPhysicsSubsystem.
+	void RegisterBody(UPrimitiveComponent* body, float gravityScale = 1.0f, bool bAllowSolverGravity = true);
+	// Hands the body back to the physics scene first if it's ballistic, which registers it with UPhysicsSubsystem again.
+	void UnregisterBody(UPrimitiveComponent* body);
+
+	int32 GetBodyCount() const { return bodies.Num(); }
+	int32 GetBallisticCount() const { return ballisticCount; }
+
+	// Bodies further than DemoteDistance from every player go ballistic, and come back once one is within PromoteDistance.
+	UPROPERTY(Config)
+	float DemoteDistance;
+
+	UPROPERTY(Config)
+	float PromoteDistance;
+
+	// Seconds between checking distances.
+	UPROPERTY(Config)
+	float UpdateInterval;
+
+	// Most bodies that can change over, either way, per update.
+	UPROPERTY(Config)
+	int32 MaxTransitionsPerUpdate;
+
+	// After a ballistic path hits something, the body is simulated for at least this long so it can settle and fall asleep.
+	UPROPERTY(Config)
+	float SettleTime;
+
+	// FTickableGameObject
+	virtual void Tick(float DeltaTime) override;
+	virtual ETickableTickType GetTickableTickType() const override;
+	virtual bool IsTickable() const override;
+	virtual UWorld* GetTickableGameObjectWorld() const override;
+	virtual TStatId GetStatId() const override;
+protected:
+	// Moves bodies between simulated and ballistic depending on how close the players are.
+	void UpdateLOD();
+	void Demote(int32 index);
+	// Puts the body back in the physics scene where its path has it, at location if given.
+	void Promote(int32 index, const FVector* location = nullptr);
+	// Picks up last frame's sweeps, promoting whatever hit something.
+	void ResolveSweeps();
+	// Moves every ballistic body along its path, and sends off a sweep for the distance each one just covered.
+	void StepBallistic(float DeltaTime);
+	void RemoveAtSwap(int32 index);
+
+	// Where body index is along its current path.
+	FVector GetPathLocation(int32 index) const;
+	FVector GetPathVelocity(int32 index) const;
+	FQuat GetPathRotation(int32 index) const;
+
+	// One entry per registered body, all parallel.
+	UPROPERTY()
+	TArray<UPrimitiveComponent*> bodies;
+	TArray<float> scales;
+	TArray<bool> allowSolverGravity;
+	TArray<bool> ballistic;
+	// World time before which the body can't go ballistic again.
+	TArray<float> settleUntil;
+
+	// The path each ballistic body is on: where it started, how fast it was going and spinning, and the (constant)
+	// acceleration it's under. A new path starts whenever the gravity the body feels changes.
+	TArray<FVector> pathOrigins;
+	TArray<FVector> pathVelocities;
+	TArray<FQuat> pathRotations;
+	TArray<FVector> pathAngularVelocities;
+	TArray<FVector> pathAccelerations;
+	TArray<float> pathTimes;
+	// Where the body was drawn last frame, so the sweep covers the whole move.
+	TArray<FVector> lastLocations;
+	// Sweep over the body's last move. Results come back a frame later.
+	TArray<FTraceHandle> sweeps;
+
+	int32 ballisticCount;
+	float timeSinceUpdate;
+
+	// Scratch space, kept around so we don't reallocate every frame.
+	TArray<FVector> playerLocations;
+	TArray<FVector> stepLocations;
+	TArray<FVector> stepGravity;
+	TArray<int32> stepIndices;
+
+	UPROPERTY()
+	UPhysicsSubsystem* worldPhysics;
+
+	FCollisionQueryParams queryParams;
+};
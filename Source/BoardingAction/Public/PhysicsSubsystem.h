@@ -4,21 +4,348 @@
 
 #include "CoreMinimal.h"
 #include "Subsystems/WorldSubsystem.h"
+#include "Tickable.h"
 #include "Kismet/KismetMathLibrary.h"
+#include "Physics/PhysicsInterfaceDeclares.h"
+#include "UObject/ObjectKey.h"
+#include "GravityFieldComponent.h"
 #include "PhysicsSubsystem.generated.h"
 
+class UCharacterMovementComponent;
+
+// Fired whenever the global gravity changes.
+DECLARE_MULTICAST_DELEGATE_TwoParams(FOnGravityChanged, const FVector& /* oldGravity */, const FVector& /* newGravity */);
+// Fired for a single mover when the gravity at its location changes, e.g. when it walks into a gravity field.
+DECLARE_DELEGATE_TwoParams(FOnLocalGravityChanged, const FVector& /* oldGravity */, const FVector& /* newGravity */);
+
+// World space snapshot of a UGravityFieldComponent, so lookups never have to go through the component itself.
+struct FGravityFieldData
+{
+	FTransform transform;
+	FVector extent;
+	EGravityFieldShape shape;
+	// World space direction for directional fields, or the spin axis for cylindrical ones.
+	FVector direction;
+	float strength;
+	int32 priority;
+
+	bool Contains(const FVector& location) const;
+	FVector Evaluate(const FVector& location) const;
+};
+
+// Uniform grid of gravity fields. Immutable once built, so it can be shared with the physics thread.
+struct FGravityFieldIndex
+{
+	// Fields have to be added in order of descending priority, so a lower index always wins.
+	void Add(const FGravityFieldData& data);
+	bool IsEmpty() const { return fields.Num() == 0; }
+	// Gravity from the highest priority field containing location, or fallback if there isn't one.
+	FVector GetGravityAt(const FVector& location, const FVector& fallback) const;
+	// Returns the index into fields of the highest priority field containing location, or INDEX_NONE.
+	int32 FindFieldIndex(const FVector& location) const;
+
+	TArray<FGravityFieldData> fields;
+	TMap<FIntVector, TArray<int32>> grid;
+	// Fields that would cover too many cells go here instead of the grid and are always checked.
+	TArray<int32> largeFields;
+};
+
+UENUM()
+enum class EGravityMode : uint8
+{
+	// Every body gets a velocity change from the gravity pass each frame.
+	PerBody,
+	// The global gravity is handed to the physics scene, so the solver applies it (substepped) to every simulated body.
+	// Only bodies that opt out, use a custom scale or sit inside a gravity field still go through the gravity pass.
+	Solver,
+	// Reserved for applying gravity from a Chaos sim callback on every async physics step, at the async physics tick's
+	// fixed rate. That needs the sim callback API from 4.27, which this project's engine doesn't have, so for now it
+	// falls back to PerBody with a warning.
+	Async
+};
+
+// Per body state bits, see FGravityBodyRegistry::flags.
+namespace EGravityBodyFlags
+{
+	enum Type : uint8
+	{
+		None = 0,
+		// Asleep when gravity changed and waiting for the wake scheduler to get to it. Gets no gravity until then.
+		PendingWake = 1 << 0,
+		// Sitting still on something that holds it up against gravity. Gets no gravity, so the physics scene can put it to sleep.
+		Resting = 1 << 1
+	};
+}
+
+// Bodies that the gravity pass pulls on, stored as parallel arrays. Removal swaps with the last element.
+// An entry is either a component's own body, or one instance's body in an instanced component (see UGravityPropCollection).
+USTRUCT()
+struct FGravityBodyRegistry
+{
+	GENERATED_BODY()
+
+	UPROPERTY()
+	TArray<UPrimitiveComponent*> bodies;
+	// Instance index into bodies[i]'s instance bodies, or INDEX_NONE for the component's own body.
+	TArray<int32> items;
+	TArray<float> scales;
+	TArray<uint8> flags;
+	// How many passes in a row the body has been still for, up to RestFrames.
+	TArray<uint8> stillFrames;
+	// Whether the engine's own gravity was on for the body before it was registered, so it can be put back afterwards.
+	TArray<bool> engineGravity;
+
+	void Add(UPrimitiveComponent* body, int32 item, float scale, bool bEngineGravity);
+	bool Remove(UPrimitiveComponent* body, int32 item);
+	bool Contains(UPrimitiveComponent* body, int32 item) const { return indices.Contains(TPair<FObjectKey, int32>(body, item)); }
+	// Index of body in the arrays, or INDEX_NONE.
+	int32 Find(UPrimitiveComponent* body, int32 item) const;
+	int32 Num() const { return bodies.Num(); }
+	void Empty();
+	// Drops every entry whose component has been garbage collected (which nulls it out of bodies). Returns how many went.
+	int32 RemoveCollected();
+
+	// The physics body for entry index. Null if the component's gone or has no physics state.
+	FBodyInstance* GetBodyInstance(int32 index) const;
+	FVector GetLocation(int32 index) const;
+
+private:
+	void RemoveAt(int32 index);
+
+	// Parallel to bodies. GC nulls bodies out from under us, but these keep telling entries apart after their
+	// component's gone, and never match a new component that ends up at the same address.
+	TArray<FObjectKey> keys;
+	TMap<TPair<FObjectKey, int32>, int32> indices;
+};
+
+// Impulses collected over a frame, summed up per body so each body only gets one linear and one angular impulse.
+struct FImpulseAccumulator
+{
+	// The angular part is worked out around the body's centre of mass as it is now.
+	void AddAtLocation(UPrimitiveComponent* body, int32 item, const FVector& impulse, const FVector& location);
+	int32 Num() const { return bodies.Num(); }
+	void Reset();
+
+	TArray<TWeakObjectPtr<UPrimitiveComponent>> bodies;
+	// Same as FGravityBodyRegistry::items.
+	TArray<int32> items;
+	TArray<FVector> linear;
+	TArray<FVector> angular;
+	// How many impulses went in, as opposed to how many bodies they ended up on.
+	int32 rawCount = 0;
+
+private:
+	TMap<TPair<FObjectKey, int32>, int32> indices;
+};
+
 /**
- * 
+ * Owns the world's gravity and applies it to every registered body in a single pass per frame.
+ * Gravity controllers register their bodies here instead of ticking on their own.
  */
-UCLASS()
-class BOARDINGACTION_API UPhysicsSubsystem : public UWorldSubsystem
+UCLASS(config=Game)
+class BOARDINGACTION_API UPhysicsSubsystem : public UWorldSubsystem, public FTickableGameObject
 {
 	GENERATED_BODY()
 public:
+	UPhysicsSubsystem();
+
 	virtual void Initialize(FSubsystemCollectionBase& Collection);
+	virtual void Deinitialize();
 	void SetGravity(float x, float y, float z);
+	// For a change that actually happened age seconds ago, e.g. on the server. Bodies are given the velocity they'd have
+	// picked up since then, and GetGravityChangeTime is backdated so transitions can pick up where they should be.
+	void SetGravity(const FVector& newGravity, float age = 0.0f);
 	FVector GetGravity();
+	// World time (GetTimeSeconds) at which the current gravity took effect.
+	float GetGravityChangeTime() const { return gravityChangeTime; }
 	static FRotator GetRotatorFromGravity(FVector grav);
+
+	// The rotation that takes the global down onto grav. Same as GetRotatorFromGravity, without the caching.
+	static FQuat ComputeOrientationFromGravity(const FVector& grav);
+	// Cached version of ComputeOrientationFromGravity, keyed by the quantized direction of grav.
+	// Every canonical gravity orientation is precomputed.
+	FQuat GetOrientationFromGravity(const FVector& grav);
+
+	// The canonical gravity directions: the six axes, plus the twelve diagonals between them (which OnRightClick uses).
+	static int32 GetGravityOrientationCount();
+	static FVector GetGravityOrientationDirection(int32 index);
+	// Index of the canonical orientation grav points along, or INDEX_NONE if it isn't one of them.
+	static int32 FindGravityOrientation(const FVector& grav);
+
+	// Gravity at a point in the world, taking gravity fields into account.
+	FVector GetGravityAt(const FVector& location);
+	// Batched version of GetGravityAt. outGravity needs to be the same size as locations.
+	void GetGravityAtLocations(TArrayView<const FVector> locations, TArrayView<FVector> outGravity);
+
+	void RegisterField(UGravityFieldComponent* field);
+	void UnregisterField(UGravityFieldComponent* field);
+	// Call when a field has moved or changed shape so the spatial index gets rebuilt before the next lookup.
+	void MarkFieldsDirty();
+
+	// Bodies (physics simulated primitives) and movers (character movement) that should be pulled by gravity.
+	// Bodies with a custom gravityScale, or that don't allow solver gravity, always go through the gravity pass.
+	void RegisterBody(UPrimitiveComponent* body, float gravityScale = 1.0f, bool bAllowSolverGravity = true);
+	void UnregisterBody(UPrimitiveComponent* body);
+	// Same again for a single instance body of an instanced component, which otherwise behaves just like any other body.
+	void RegisterInstanceBody(UPrimitiveComponent* component, int32 instance, float gravityScale = 1.0f, bool bAllowSolverGravity = true);
+	void UnregisterInstanceBody(UPrimitiveComponent* component, int32 instance);
+	// Movers that handle gravity themselves (bApplyGravity false) only get told when their local gravity changes.
+	void RegisterMover(UCharacterMovementComponent* mover, FOnLocalGravityChanged onLocalGravityChanged = FOnLocalGravityChanged(), bool bApplyGravity = true);
+	void UnregisterMover(UCharacterMovementComponent* mover);
+	// Only look at this mover every interval frames, staggered across movers. Its local gravity isn't even looked up in
+	// between, so a mover that applies its own gravity hears about changes later, and one we apply gravity to gets
+	// what it missed made up for when it's next looked at. Used to turn down the gravity cost of pawns nobody is close to.
+	void SetMoverUpdateInterval(UCharacterMovementComponent* mover, int32 interval);
+
+	FOnGravityChanged OnGravityChanged;
+
+	// Same as body->AddImpulseAtLocation, except that every impulse a body gets during a frame is added up and
+	// handed to it as one, right before the physics scene steps. Use this for anything that can hit the same body a lot.
+	// Pass the hit's Item along, so instanced components push the instance that was actually hit.
+	void QueueImpulseAtLocation(UPrimitiveComponent* body, const FVector& impulse, const FVector& location, int32 item = INDEX_NONE);
+
+	// Gravity is expressed as the velocity change per frame at GravityReferenceRate frames per second.
+	// This turns it into an acceleration (cm/s^2), so it can be applied independently of the frame rate.
+	FVector GravityToAcceleration(const FVector& grav) const;
+
+	UPROPERTY(Config)
+	EGravityMode GravityMode;
+
+	UPROPERTY(Config)
+	float GravityReferenceRate;
+
+	// How many sleeping bodies get woken up per frame after gravity changes. The closest to a player go first.
+	UPROPERTY(Config)
+	int32 WakeBudgetPerFrame;
+
+	// Sleeping bodies still waiting to be woken up after the last gravity change.
+	int32 GetPendingWakeCount() const;
+
+	// A body going slower than this (cm/s and rad/s) for RestFrames passes in a row, with a support under it along gravity,
+	// stops getting gravity so that it can fall asleep. Gravity changing, or the body being knocked, starts it up again.
+	UPROPERTY(Config)
+	float RestLinearSpeed;
+
+	UPROPERTY(Config)
+	float RestAngularSpeed;
+
+	UPROPERTY(Config)
+	int32 RestFrames;
+
+	// How far past its bounds (along gravity) a support can be.
+	UPROPERTY(Config)
+	float RestSupportDistance;
+
+	// Resting bodies that haven't fallen asleep yet get their support checked again this often, in passes.
+	UPROPERTY(Config)
+	int32 RestCheckInterval;
+
+	// Bodies the last gravity pass found awake, and asleep. Bodies resting on a support or drifting in zero gravity
+	// don't get gravity from the pass, but count as awake until the physics scene puts them to sleep.
+	int32 GetAwakeBodyCount() const { return lastAwakeBodies; }
+	int32 GetSleepingBodyCount() const { return lastSleepingBodies; }
+
+	// How many bodies the last gravity pass touched, and how long it took in seconds.
+	int32 GetLastPassBodyCount() const { return lastPassBodies; }
+	double GetLastPassTime() const { return lastPassTime; }
+	// Seconds from the physics scene starting its last step to its results being fetched.
+	double GetLastPhysicsStepTime() const { return lastPhysicsStepTime; }
+
+	// FTickableGameObject
+	virtual void Tick(float DeltaTime) override;
+	virtual ETickableTickType GetTickableTickType() const override;
+	virtual bool IsTickable() const override;
+	virtual UWorld* GetTickableGameObjectWorld() const override;
+	virtual TStatId GetStatId() const override;
 protected:
 	FVector gravity;
+	float gravityChangeTime;
+	// Velocity owed to every awake body on the next pass, from changes that arrived late.
+	FVector gravityCatchUp;
+
+	// Bodies that the gravity pass applies gravity to.
+	UPROPERTY()
+	FGravityBodyRegistry perBodyGravity;
+	// Bodies that the physics scene applies gravity to. Only visited when gravity fields exist.
+	UPROPERTY()
+	FGravityBodyRegistry solverGravity;
+
+	UPROPERTY()
+	TArray<UCharacterMovementComponent*> movers;
+	// Parallel to movers. The gravity each mover felt last pass, so we can tell them when it changes.
+	TArray<FVector> moverGravity;
+	TArray<FOnLocalGravityChanged> moverCallbacks;
+	TArray<bool> moverAppliesGravity;
+	TArray<uint8> moverUpdateInterval;
+	// Which frame of its interval the mover comes due on. Fixed when it registers, so movers coming and going
+	// (and being swapped around in the arrays) doesn't move anyone else's turn.
+	TArray<uint8> moverPhase;
+	// Time since the mover was last looked at by the gravity pass.
+	TArray<float> moverPendingTime;
+	uint32 passFrame;
+	uint8 nextMoverPhase;
+
+	// Scratch space for the gravity pass, kept around so we don't reallocate every frame.
+	TArray<FVector> passLocations;
+	TArray<FVector> passGravity;
+	// The movers that are due this frame, which are the only ones that get looked up.
+	TArray<int32> passMovers;
+
+	// Hooks into the physics scene so queued impulses get flushed (and, in Solver mode, our gravity gets picked up) before every step.
+	void HookPhysicsScene();
+	void OnPhysScenePreTick(FPhysScene* scene, float DeltaSeconds);
+	void OnPhysScenePostTick(FPhysScene* scene);
+	FPhysScene* hookedScene;
+	FDelegateHandle preTickHandle;
+	FDelegateHandle postTickHandle;
+
+	int32 lastPassBodies;
+	int32 lastAwakeBodies;
+	int32 lastSleepingBodies;
+	double lastPassTime;
+	double physicsStepStart;
+	double lastPhysicsStepTime;
+
+	FImpulseAccumulator queuedImpulses;
+	void FlushImpulses();
+
+	// A sleeping body waiting to feel a gravity change.
+	struct FPendingWake
+	{
+		TWeakObjectPtr<UPrimitiveComponent> body;
+		int32 item;
+		// gravityIntegral at the time the body was queued. The difference is the velocity it's missed out on.
+		FVector startIntegral;
+		float distanceSquared;
+	};
+
+	// Queues up every sleeping body whose gravity just changed, closest to a player first.
+	void ScheduleWakeUps();
+	// Wakes up to WakeBudgetPerFrame bodies, giving each the velocity gravity would have given it while it waited.
+	void ProcessWakeQueue();
+	bool ReleasePendingBody(UPrimitiveComponent* body, int32 item, const FVector& startIntegral);
+	// Shared by RegisterBody and RegisterInstanceBody.
+	void RegisterEntry(UPrimitiveComponent* body, int32 item, float gravityScale, bool bAllowSolverGravity);
+
+	// Whether registry entry index is sitting on something that holds it up against grav.
+	bool HasRestingSupport(const FGravityBodyRegistry& registry, int32 index, const FVector& grav) const;
+	// Works out whether an awake body has come to rest. Returns true if it shouldn't get gravity this pass.
+	bool UpdateRest(FGravityBodyRegistry& registry, int32 index, const FVector& grav);
+
+	TArray<FPendingWake> wakeQueue;
+	// Everything before this in wakeQueue has already been handled.
+	int32 wakeQueueHead;
+	// The global gravity's acceleration integrated over time since the wake queue started, i.e. a velocity.
+	FVector gravityIntegral;
+
+	static FIntVector QuantizeDirection(const FVector& direction);
+	TMap<FIntVector, FQuat> orientationCache;
+
+	void RebuildFieldIndex();
+
+	UPROPERTY()
+	TArray<UGravityFieldComponent*> fieldComponents;
+
+	TSharedPtr<const FGravityFieldIndex, ESPMode::ThreadSafe> fieldIndex;
+	bool bFieldsDirty;
 };
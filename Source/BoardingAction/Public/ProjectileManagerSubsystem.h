@@ -0,0 +1,112 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "Tickable.h"
+#include "WorldCollision.h"
+#include "ProjectileManagerSubsystem.generated.h"
+
+class ABoardingActionProjectile;
+class UInstancedStaticMeshComponent;
+class UPhysicsSubsystem;
+
+// Ballistics shared by every round fired from the same projectile class, read off that class's defaults.
+struct FProjectileType
+{
+	float radius;
+	float initialSpeed;
+	// 0 means no limit, same as UProjectileMovementComponent.
+	float maxSpeed;
+	float lifeSpan;
+	float gravityScale;
+	bool bShouldBounce;
+	float bounciness;
+	float friction;
+};
+
+/**
+ * Simulates rounds as plain data instead of as actors, so thousands of them can be in the air at once.
+ * Every round is stepped in one pass, checked for hits with batched async traces, and drawn through a single instanced mesh.
+ * Hits behave like ABoardingActionProjectile::OnHit: physics bodies get pushed and the round is used up, anything else it bounces off.
+ */
+UCLASS(config=Game)
+class BOARDINGACTION_API UProjectileManagerSubsystem : public UWorldSubsystem, public FTickableGameObject
+{
+	GENERATED_BODY()
+public:
+	UProjectileManagerSubsystem();
+
+	virtual void Initialize(FSubsystemCollectionBase& Collection);
+	virtual void Deinitialize();
+
+	// Fires a round that flies like the given projectile class would. Returns false if we're already at MaxProjectiles.
+	// The round never hits whoever fired it, so it can start inside them at the muzzle.
+	bool Fire(TSubclassOf<ABoardingActionProjectile> projectileClass, const FVector& location, const FRotator& rotation, AActor* instigator = nullptr);
+
+	int32 GetLiveCount() const { return positions.Num(); }
+
+	// Mesh drawn for every round, and the scale it's drawn at.
+	UPROPERTY(Config)
+	FSoftObjectPath ProjectileMesh;
+
+	UPROPERTY(Config)
+	FVector ProjectileMeshScale;
+
+	// Collision profile the hit traces use.
+	UPROPERTY(Config)
+	FName CollisionProfile;
+
+	UPROPERTY(Config)
+	int32 MaxProjectiles;
+
+	// FTickableGameObject
+	virtual void Tick(float DeltaTime) override;
+	virtual ETickableTickType GetTickableTickType() const override;
+	virtual bool IsTickable() const override;
+	virtual UWorld* GetTickableGameObjectWorld() const override;
+	virtual TStatId GetStatId() const override;
+protected:
+	int32 FindOrAddType(UClass* projectileClass);
+	// Picks up last frame's trace results, bouncing or removing whatever hit something.
+	void ResolveHits();
+	// Applies gravity and moves every round, then sends off the traces for the distance each one just covered.
+	void Step(float DeltaTime);
+	void RemoveAtSwap(int32 index);
+	void UpdateInstances();
+
+	// One entry per live round, all parallel.
+	TArray<FVector> positions;
+	TArray<FVector> velocities;
+	TArray<float> lifeSpans;
+	TArray<uint8> types;
+	// Whoever fired the round, which its traces ignore.
+	TArray<TWeakObjectPtr<AActor>> instigators;
+	// The trace covering the round's last move. Results come back a frame later.
+	TArray<FTraceHandle> traces;
+
+	TArray<FProjectileType> typeData;
+	TMap<UClass*, uint8> typeIndices;
+
+	// Scratch space, kept around so we don't reallocate every frame.
+	TArray<FVector> stepGravity;
+	TArray<FVector> stepStarts;
+	TArray<FTransform> instanceTransforms;
+
+	UPROPERTY()
+	UPhysicsSubsystem* worldPhysics;
+
+	// Actor that holds the instanced mesh. Created the first time something is fired.
+	UPROPERTY()
+	AActor* renderActor;
+
+	UPROPERTY()
+	UInstancedStaticMeshComponent* instances;
+	// How many instances were showing a round after the last update.
+	int32 drawnCount;
+
+	FCollisionQueryParams queryParams;
+	// queryParams plus one instigator, rebuilt whenever the instigator changes from one round to the next.
+	FCollisionQueryParams instigatorQueryParams;
+};
@@ -0,0 +1,63 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "ProjectilePoolSubsystem.generated.h"
+
+class ABoardingActionProjectile;
+
+// Every projectile of one class that the pool has spawned, and which of them are free to be fired again.
+USTRUCT()
+struct FProjectilePool
+{
+	GENERATED_BODY()
+
+	UPROPERTY()
+	TArray<ABoardingActionProjectile*> available;
+	// Everything this pool has spawned that's still alive, in flight or not.
+	int32 total = 0;
+};
+
+/**
+ * Keeps spent projectiles around so they can be fired again, instead of spawning and destroying an actor for every shot.
+ */
+UCLASS(config=Game)
+class BOARDINGACTION_API UProjectilePoolSubsystem : public UWorldSubsystem
+{
+	GENERATED_BODY()
+public:
+	UProjectilePoolSubsystem();
+
+	virtual void Deinitialize();
+
+	// Spawns projectiles of the given class until at least count of them are sitting in the pool.
+	void Prewarm(TSubclassOf<ABoardingActionProjectile> projectileClass, int32 count);
+	// Fires a projectile from the pool, only spawning a new one if the pool is empty. Returns nullptr if that spawn failed.
+	ABoardingActionProjectile* Acquire(TSubclassOf<ABoardingActionProjectile> projectileClass, const FVector& location, const FRotator& rotation, AActor* owner = nullptr, APawn* instigator = nullptr);
+	// Puts a projectile back in its pool. Projectiles that didn't come from a pool are destroyed.
+	void Release(ABoardingActionProjectile* projectile);
+	// Lets the pool know one of its projectiles was destroyed anyway, e.g. by falling out of the world.
+	void OnProjectileDestroyed(ABoardingActionProjectile* projectile);
+
+	// How many projectiles of each class get spawned up front when something first asks to prewarm that class.
+	UPROPERTY(Config)
+	int32 PrewarmCount;
+
+	// The most projectiles a single pool will hold on to. Anything released past this is destroyed.
+	UPROPERTY(Config)
+	int32 MaxPoolSize;
+
+	int32 GetPooledCount() const;
+	int32 GetActiveCount() const;
+protected:
+	ABoardingActionProjectile* SpawnPooled(UClass* projectileClass, FProjectilePool& pool);
+	void UpdateStats() const;
+
+	UPROPERTY()
+	TMap<UClass*, FProjectilePool> pools;
+
+	// Most projectiles in flight at once across every pool, for the Projectile Pool High Water stat.
+	int32 highWater;
+};
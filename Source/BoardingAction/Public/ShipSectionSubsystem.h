@@ -0,0 +1,107 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "Tickable.h"
+#include "ShipSectionSubsystem.generated.h"
+
+class AShipSectionVolume;
+class ULevelStreaming;
+
+// A gravity body in a section, as it was when the section was last hidden.
+struct FSavedSectionBody
+{
+	// Names are the same every time the section's level is loaded, so they're how the body gets found again.
+	FName actor;
+	// Only set for UGravityPropCollection instances, where item is the instance.
+	FName component;
+	int32 item;
+	FVector location;
+	// Pitch, yaw and roll, through FRotator::CompressAxisToShort.
+	uint16 rotation[3];
+	// Index into FSavedSection::motions, or INDEX_NONE if the body was asleep. Most of them are.
+	int32 motion;
+};
+
+struct FSavedSectionMotion
+{
+	FVector linear;
+	FVector angular;
+};
+
+struct FSavedSection
+{
+	TArray<FSavedSectionBody> bodies;
+	TArray<FSavedSectionMotion> motions;
+};
+
+/**
+ * Streams AShipSectionVolume sublevels by how close the nearest player is. Sections load asynchronously (hidden) once
+ * a player is within KeepLoadedDistance, and are shown once within ShowDistance. Going the other way they're frozen,
+ * i.e. hidden, which takes every actor and physics body out of the world but keeps the level in memory, and then
+ * unloaded. The gravity bodies in a section are saved whenever it's hidden, and put back when it's shown again.
+ */
+UCLASS(config=Game)
+class BOARDINGACTION_API UShipSectionSubsystem : public UWorldSubsystem, public FTickableGameObject
+{
+	GENERATED_BODY()
+public:
+	UShipSectionSubsystem();
+
+	virtual void Initialize(FSubsystemCollectionBase& Collection);
+	virtual void Deinitialize();
+
+	void RegisterSection(AShipSectionVolume* section);
+	void UnregisterSection(AShipSectionVolume* section);
+
+	// Sections shown, and loaded but hidden (whether preloading ahead of a player or frozen behind one).
+	int32 GetResidentCount() const;
+	int32 GetFrozenCount() const;
+	// Bodies saved across every hidden or unloaded section.
+	int32 GetSavedBodyCount() const;
+
+	// Distances are from the nearest player to the section's bounds, so a player inside a section is always 0 from it.
+	UPROPERTY(Config)
+	float ShowDistance;
+
+	UPROPERTY(Config)
+	float KeepLoadedDistance;
+
+	// Added to a distance when the section is already past it, so walking along a boundary doesn't stream it in and out.
+	UPROPERTY(Config)
+	float Hysteresis;
+
+	// Seconds between checking distances.
+	UPROPERTY(Config)
+	float UpdateInterval;
+
+	// FTickableGameObject
+	virtual void Tick(float DeltaTime) override;
+	virtual ETickableTickType GetTickableTickType() const override;
+	virtual bool IsTickable() const override;
+	virtual UWorld* GetTickableGameObjectWorld() const override;
+	virtual TStatId GetStatId() const override;
+protected:
+	// Decides which sections should be loaded and shown.
+	void UpdateSections();
+	// Finds the section's level in the world's streaming levels, making an instance of it if it isn't there.
+	ULevelStreaming* GetStreamingLevel(int32 index);
+	void SaveSection(int32 index);
+	void RestoreSection(int32 index);
+
+	// One entry per registered section, all parallel.
+	UPROPERTY()
+	TArray<AShipSectionVolume*> sections;
+	UPROPERTY()
+	TArray<ULevelStreaming*> streamingLevels;
+	TArray<FSavedSection> saved;
+	// Whether the level was visible last tick, so we can tell when it's just been shown.
+	TArray<bool> wasVisible;
+
+	float timeSinceUpdate;
+
+	// Scratch space, kept around so we don't reallocate every update.
+	TArray<FVector> playerLocations;
+};
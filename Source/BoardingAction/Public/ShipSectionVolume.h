@@ -0,0 +1,41 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "GameFramework/Actor.h"
+#include "ShipSectionVolume.generated.h"
+
+class UBoxComponent;
+class UShipSectionSubsystem;
+
+/**
+ * One section of the ship, kept in its own sublevel and streamed in and out by UShipSectionSubsystem as players come
+ * and go. Goes in the persistent level, with Bounds covering the section. The sublevel can either be set up in the
+ * Levels window (with its streaming method set to Blueprint) or not at all, in which case an instance of it is made.
+ */
+UCLASS()
+class BOARDINGACTION_API AShipSectionVolume : public AActor
+{
+	GENERATED_BODY()
+
+public:
+	AShipSectionVolume();
+
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category=Streaming)
+	UBoxComponent* Bounds;
+
+	UPROPERTY(EditAnywhere, Category=Streaming)
+	TSoftObjectPtr<UWorld> Level;
+
+	// Unload the sublevel once every player is far enough away. Otherwise it's only ever frozen (hidden but kept in
+	// memory), which is quicker to come back from and worth it for small sections.
+	UPROPERTY(EditAnywhere, Category=Streaming)
+	bool bUnloadWhenFar;
+
+protected:
+	virtual void BeginPlay() override;
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
+	UShipSectionSubsystem* sections;
+};